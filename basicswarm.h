@@ -0,0 +1,63 @@
+// UMBC - CMSC 341 - Fall 2024 - Proj2
+#ifndef BASICSWARM_H
+#define BASICSWARM_H
+#include "robot.h"
+#include "basictree.h"
+
+/*
+BasicSwarm<BalancePolicy, NodeLayout, Storage> is a robot tree whose tree type and
+node contents are fixed at compile time, a BasicTree keyed by the robot id. With
+the default storage the type and state are stored inline in the node, there is
+no branching on a runtime type and a node only carries the fields its layout asks
+for (a SPLAY tree of PlainLayout nodes has no height at all).
+Swarm holds one BasicSwarm with RobotStorage for its current type, whose nodes are
+its Robots; setType replaces it with the one of the new type. Those keep the
+height for SPLAY as well, the dump and the image of a swarm show it.
+
+Unlike Swarm::remove, remove deletes the robot for every policy, splay included.
+*/
+
+//The robot data a BasicSwarm node stores next to the id
+struct RobotData{
+    ROBOTTYPE m_type;
+    STATE m_state;
+    RobotData(ROBOTTYPE type = DEFAULT_TYPE, STATE state = DEFAULT_STATE) : m_type(type), m_state(state) {}
+    ROBOTTYPE getType() const {return m_type;}
+    STATE getState() const {return m_state;}
+    void setState(STATE state){m_state=state;}
+};
+
+//Layout field that counts the ALIVE robots of a subtree
+struct AliveField{
+    int m_alive = 1;
+    template <class Node>
+    static int aliveOf(const Node* node) { return node == nullptr ? 0 : node->m_alive; }
+    template <class Node>
+    static void update(Node* node) {
+        node->m_alive = (node->m_payload.m_state == ALIVE) + aliveOf(node->m_left) + aliveOf(node->m_right);
+    }
+};
+
+template <class BalancePolicy, class Layout = PlainLayout, class Storage = TreePool<int, RobotData, Layout>>
+class BasicSwarm : public BasicTree<int, typename Storage::Record, less<int>, BalancePolicy, Layout, Storage>{
+    public:
+    typedef BasicTree<int, typename Storage::Record, less<int>, BalancePolicy, Layout, Storage> Tree;
+    typedef typename Tree::Node Node;
+    using Tree::Tree;
+
+    //Adds the robot and returns true, or returns false if the id is taken
+    bool insert(const Robot& robot) {return insert(robot.getID(), robot.getType(), robot.getState());}
+
+    bool insert(int id, ROBOTTYPE type = DEFAULT_TYPE, STATE state = DEFAULT_STATE){
+        return this->emplace(id, type, state).second;
+    }
+
+    //Sets the state of the robot with the id, returns false if it is missing
+    bool setState(int id, STATE state){
+        return this->modify(id, [state](auto& robot) { robot.setState(state); });
+    }
+
+    //Number of ALIVE robots; needs a layout with an AliveField and the default storage
+    int countAlive() const {return AliveField::aliveOf(this->getRoot());}
+};
+#endif
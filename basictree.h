@@ -0,0 +1,684 @@
+// UMBC - CMSC 341 - Fall 2024 - Proj2
+#ifndef BASICTREE_H
+#define BASICTREE_H
+#include <algorithm>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+using namespace std;
+
+/*
+BasicTree<Key, Payload, Compare, BalancePolicy, NodeLayout, Storage> is the
+BST/AVL/splay/WAVL machinery of the robot trees for any kind of record. A node
+holds the key, the payload, the two children and the fields of its layout. The
+tree type and the layout are fixed at compile time: every operation is compiled
+for one policy and a node only carries the fields its layout asks for. Keys are
+ordered by Compare, two keys are equal when neither is less than the other.
+The nodes are kept by the storage. The default TreePool owns BasicTreeNodes with
+the payload inline, constructed in place by emplace. Swarm passes a RobotStorage
+instead, whose nodes are the Robots of the swarm pool and whose root is
+Swarm::m_root, so the inserts, removes and splays of every Swarm tree type run here.
+*/
+
+const int TREEPOOLBLOCKSIZE = 16;       // nodes in the first block the pool allocates
+const int TREEMAXPOOLBLOCKSIZE = 4096;  // cap for the geometric growth of pool blocks
+
+enum TREECOUNTER {TREECOMPARISONS, TREELEFTROTATIONS, TREERIGHTROTATIONS, TREEREBALANCES,
+                  TREESPLAYS, TREESPLAYDEPTH, TREEUPDATES}; // work a BasicTree reports to its storage
+
+//Balance policies, tags that select the algorithms BasicTree compiles in
+struct BSTPolicy{
+    static constexpr bool balances = false;
+    static constexpr bool splays = false;
+    static constexpr bool ranks = false;
+};
+struct AVLPolicy{
+    static constexpr bool balances = true;
+    static constexpr bool splays = false;
+    static constexpr bool ranks = false;
+};
+struct SplayPolicy{
+    static constexpr bool balances = false;
+    static constexpr bool splays = true;
+    static constexpr bool ranks = false;
+};
+//A weak AVL tree. The HeightField of a node holds its rank: a leaf has rank 0, a missing
+//child rank -1 and every child is ranked 1 or 2 below its parent. An insertion only
+//promotes ranks on the way up and needs at most two rotations.
+struct WAVLPolicy{
+    static constexpr bool balances = false;
+    static constexpr bool splays = false;
+    static constexpr bool ranks = true;
+};
+
+//Node fields a layout can be made of, update recomputes the field from the children
+struct HeightField{
+    int m_height = 0;   // a leaf has height 0
+    template <class Node>
+    static int heightOf(const Node* node) { return node == nullptr ? -1 : node->m_height; }
+    template <class Node>
+    static void update(Node* node) {
+        node->m_height = 1 + max(heightOf(node->m_left), heightOf(node->m_right));
+    }
+};
+struct SizeField{
+    int m_size = 1;     // nodes in the subtree
+    template <class Node>
+    static int sizeOf(const Node* node) { return node == nullptr ? 0 : node->m_size; }
+    template <class Node>
+    static void update(Node* node) {
+        node->m_size = 1 + sizeOf(node->m_left) + sizeOf(node->m_right);
+    }
+};
+
+//A node layout is the set of fields every node carries besides the record and its children
+template <class... Fields>
+struct NodeLayout : Fields...{
+    static constexpr bool augmented = sizeof...(Fields) > 0;
+    template <class Node>
+    static void update([[maybe_unused]] Node* node) { (Fields::update(node), ...); }
+};
+using PlainLayout = NodeLayout<>;
+using HeightLayout = NodeLayout<HeightField>;
+
+//The node of a BasicTree, plain data so that the layout fields are reached directly
+template <class Key, class Payload, class Layout>
+struct BasicTreeNode : Layout{
+    Key m_key;
+    Payload m_payload;
+    BasicTreeNode* m_left;
+    BasicTreeNode* m_right;
+    template <class... Args>
+    BasicTreeNode(const Key& key, Args&&... args)
+        : m_key(key), m_payload(forward<Args>(args)...), m_left(nullptr), m_right(nullptr) {}
+    const Key& getKey() const {return m_key;}
+    Payload& getPayload() {return m_payload;}
+    const Payload& getPayload() const {return m_payload;}
+};
+
+/*
+The default storage of a BasicTree, BasicTreeNodes in blocks owned by the tree.
+A storage provides the root link, the node count, the key and the payload of a
+node, allocate and release, and count, which is told about the work of the tree
+(a pool ignores it, RobotStorage adds it to the Swarm statistics).
+*/
+template <class Key, class Payload, class Layout>
+class TreePool{
+    public:
+    typedef BasicTreeNode<Key, Payload, Layout> Node;
+    typedef Payload Record; // what a node stores for its key
+
+    TreePool() : m_root(nullptr), m_count(0), m_freeList(nullptr), m_nextBlockSize(TREEPOOLBLOCKSIZE) {}
+    ~TreePool() { clear(); }
+    TreePool(const TreePool&) = delete;
+    TreePool& operator=(const TreePool&) = delete;
+
+    Node*& root() {return m_root;}
+    Node* root() const {return m_root;}
+    int size() const {return m_count;}
+    static const Key& keyOf(const Node* node) {return node->m_key;}
+    static Payload& payloadOf(Node* node) {return node->m_payload;}
+    void count(TREECOUNTER, int = 1) {}
+
+    //Construct a node in a slot from the pool, the blocks grow geometrically like the Swarm pool
+    template <class... Args>
+    Node* allocate(const Key& key, Args&&... args){
+        if (m_freeList == nullptr) {
+            Slot* block = new Slot[m_nextBlockSize];
+            m_blocks.push_back(block);
+            for (int i = 0; i < m_nextBlockSize; i++) {
+                block[i].m_next = m_freeList;
+                m_freeList = &block[i];
+            }
+            m_nextBlockSize = min(m_nextBlockSize * 2, TREEMAXPOOLBLOCKSIZE);
+        }
+        Slot* slot = m_freeList;
+        m_freeList = slot->m_next;
+        m_count++;
+        return new (slot->m_storage) Node(key, forward<Args>(args)...);
+    }
+
+    //Destroy a node and return its slot to the pool
+    void release(Node* node){
+        node->~Node();
+        Slot* slot = reinterpret_cast<Slot*>(node);
+        slot->m_next = m_freeList;
+        m_freeList = slot;
+        m_count--;
+    }
+
+    //Destroys every record and releases the node blocks
+    void clear(){
+        if constexpr (!is_trivially_destructible<Node>::value) {
+            vector<Node*> stack;
+            if (m_root != nullptr) {
+                stack.push_back(m_root);
+            }
+            while (!stack.empty()) {
+                Node* node = stack.back();
+                stack.pop_back();
+                if (node->m_left != nullptr) {
+                    stack.push_back(node->m_left);
+                }
+                if (node->m_right != nullptr) {
+                    stack.push_back(node->m_right);
+                }
+                node->~Node();
+            }
+        }
+        for (Slot* block : m_blocks) {
+            delete [] block;
+        }
+        m_blocks.clear();
+        m_root = nullptr;
+        m_freeList = nullptr;
+        m_count = 0;
+        m_nextBlockSize = TREEPOOLBLOCKSIZE;
+    }
+
+    private:
+    //Pool storage for one node, a free slot links to the next free one
+    union Slot{
+        Slot* m_next;
+        alignas(Node) unsigned char m_storage[sizeof(Node)];
+    };
+
+    Node* m_root;               // the root of the tree
+    int m_count;                // nodes in the tree
+    Slot* m_freeList;           // unused slots of the blocks
+    vector<Slot*> m_blocks;     // node blocks owned by this tree
+    int m_nextBlockSize;        // size of the next block the pool allocates
+};
+
+template <class Key, class Payload, class Compare = less<Key>, class BalancePolicy = AVLPolicy,
+          class Layout = HeightLayout, class Storage = TreePool<Key, Payload, Layout>>
+class BasicTree{
+    public:
+    typedef typename Storage::Node Node;
+    static_assert(!(BalancePolicy::balances or BalancePolicy::ranks) or is_base_of<HeightField, Layout>::value,
+                  "an AVL or WAVL tree needs a layout with a HeightField");
+    static_assert(!BalancePolicy::ranks or is_same<Layout, HeightLayout>::value,
+                  "a WAVL tree keeps its ranks in the HeightField and no other fields");
+
+    BasicTree(const Compare& compare = Compare()) : m_compare(compare) {}
+    //A tree on a storage that is set up by the caller, such as the RobotStorage of a Swarm
+    BasicTree(const Storage& storage, const Compare& compare = Compare())
+        : m_storage(storage), m_compare(compare) {}
+    BasicTree(const BasicTree&) = delete;
+    BasicTree& operator=(const BasicTree&) = delete;
+
+    //Destroys every record and releases the node blocks
+    void clear() {m_storage.clear();}
+
+    int size() const {return m_storage.size();}
+    const Node* getRoot() const {return m_storage.root();}
+
+    //Height of the tree, -1 when it is empty; needs a layout with a HeightField
+    int height() const {return HeightField::heightOf(getRoot());}
+
+    /*
+    Constructs the payload from args in a new node for key, unless the key is already
+    in the tree: the key is searched first, so nothing is allocated or constructed
+    for a duplicate. Returns the node of the key and whether it was added.
+    A SPLAY tree splays the node of the key, or the last node visited, to the root
+    and a new node is added above it.
+    */
+    template <class... Args>
+    pair<Node*, bool> emplace(const Key& key, Args&&... args){
+        if constexpr (BalancePolicy::splays) {
+            descend(key);
+            splayPath();
+            Node* root = m_storage.root();
+            if (root != nullptr and equal(keyOf(root), key)) {
+                return make_pair(root, false);
+            }
+            Node* node = m_storage.allocate(key, forward<Args>(args)...);
+            splitRoot(node);
+            return make_pair(node, true);
+        }else {
+            Node** slot = descend(key);
+            if (*slot != nullptr) {
+                return make_pair(*slot, false);
+            }
+            Node* node = m_storage.allocate(key, forward<Args>(args)...);
+            link(slot, node);
+            return make_pair(node, true);
+        }
+    }
+
+    //Adds a copy of payload for key, returns false if the key is taken
+    bool insert(const Key& key, const Payload& payload) {return emplace(key, payload).second;}
+
+    /*
+    Links node, which is in no tree and whose key is not in this one, like emplace
+    would have added it. Swarm moves its nodes into a tree of another type with it
+    without allocating.
+    */
+    void attach(Node* node){
+        node->m_left = nullptr;
+        node->m_right = nullptr;
+        if constexpr (BalancePolicy::splays) {
+            descend(keyOf(node));
+            splayPath();
+            splitRoot(node);
+        }else {
+            link(descend(keyOf(node)), node);
+        }
+    }
+
+    //Deletes the record of key and returns true, or returns false if it is missing
+    bool remove(const Key& key){
+        Node** slot = descend(key);
+        if constexpr (BalancePolicy::splays) {
+            //splay the node (or the last one visited) to the root and delete it there
+            splayPath();
+            Node*& root = m_storage.root();
+            if (root == nullptr or !equal(keyOf(root), key)) {
+                return false;
+            }
+            m_path.assign(1, &root);
+            slot = &root;
+        }else if (*slot == nullptr) {
+            return false;
+        }
+        Node* node = *slot;
+        int changed = (int)m_path.size() - 2;
+        if (node->m_left == nullptr or node->m_right == nullptr) {
+            *slot = (node->m_left != nullptr) ? node->m_left : node->m_right;
+        }else {
+            //the successor takes the place of the node, the path is followed down to it
+            int position = (int)m_path.size();
+            Node** successorSlot = &node->m_right;
+            while ((*successorSlot)->m_left != nullptr) {
+                m_path.push_back(successorSlot);
+                successorSlot = &(*successorSlot)->m_left;
+            }
+            Node* successor = *successorSlot;
+            *successorSlot = successor->m_right;
+            successor->m_left = node->m_left;
+            successor->m_right = node->m_right;
+            if constexpr (BalancePolicy::ranks) {
+                //and its rank
+                successor->m_height = node->m_height;
+            }
+            *slot = successor;
+            if (position < (int)m_path.size()) {
+                m_path[position] = &successor->m_right;
+            }
+            //the parent of the successor is the lowest node that changed
+            changed = (int)m_path.size() - 1;
+        }
+        m_storage.release(node);
+        fixPath(changed, true);
+        return true;
+    }
+
+    //Returns the node of key or nullptr, a SPLAY tree splays the node visited last
+    Node* find(const Key& key){
+        if constexpr (BalancePolicy::splays) {
+            Node* node = *descend(key);
+            splayPath();
+            return node;
+        }else {
+            Node* node = m_storage.root();
+            if constexpr (is_same<Compare, less<Key>>::value) {
+                //with the default order the search is written like the Swarm one, which
+                //compiles to a conditional move instead of a branch on the direction
+                while (node != nullptr and keyOf(node) != key) {
+                    node = (key < keyOf(node)) ? node->m_left : node->m_right;
+                }
+            }else {
+                while (node != nullptr and !equal(keyOf(node), key)) {
+                    node = m_compare(key, keyOf(node)) ? node->m_left : node->m_right;
+                }
+            }
+            return node;
+        }
+    }
+
+    //Calls change(Payload&) on the payload of key and updates the layout fields above it,
+    //returns false if the key is missing. change must not alter the order of the key.
+    template <class Change>
+    bool modify(const Key& key, Change change){
+        Node** slot = descend(key);
+        if (*slot == nullptr) {
+            return false;
+        }
+        change(Storage::payloadOf(*slot));
+        if constexpr (!BalancePolicy::ranks) {
+            //ranks do not depend on the payload
+            fixPath((int)m_path.size() - 1, false);
+        }
+        return true;
+    }
+
+    //Returns the node with the k-th smallest key (k from 0) or nullptr; needs a layout with a SizeField
+    const Node* select(int k) const{
+        const Node* node = getRoot();
+        while (node != nullptr) {
+            int leftSize = SizeField::sizeOf(node->m_left);
+            if (k == leftSize) {
+                return node;
+            }
+            if (k < leftSize) {
+                node = node->m_left;
+            }else {
+                k = k - leftSize - 1;
+                node = node->m_right;
+            }
+        }
+        return nullptr;
+    }
+
+    //Calls visit(const Node&) for every node in key order
+    template <class Visit>
+    void forEach(Visit visit) const{
+        vector<const Node*> stack;
+        const Node* node = getRoot();
+        while (node != nullptr or !stack.empty()) {
+            while (node != nullptr) {
+                stack.push_back(node);
+                node = node->m_left;
+            }
+            node = stack.back();
+            stack.pop_back();
+            visit(*node);
+            node = node->m_right;
+        }
+    }
+
+    private:
+    Storage m_storage;          // the nodes and the root
+    vector<Node**> m_path;      // links followed by the latest descend, m_path[0] is the root link
+    Compare m_compare;          // the order of the keys
+
+    static decltype(auto) keyOf(const Node* node) {return Storage::keyOf(node);}
+
+    bool equal(const Key& first, const Key& second) const{
+        return !m_compare(first, second) and !m_compare(second, first);
+    }
+
+    //Follow the links to key and return the one that points at it (or would), the links
+    //are recorded only when a policy or the layout has to revisit them
+    Node** descend(const Key& key){
+        constexpr bool record = BalancePolicy::balances or BalancePolicy::splays or BalancePolicy::ranks
+                                or Layout::augmented;
+        Node** slot = &m_storage.root();
+        if constexpr (record) {
+            m_path.clear();
+            m_path.push_back(slot);
+        }
+        while (*slot != nullptr) {
+            m_storage.count(TREECOMPARISONS);
+            bool less = m_compare(key, keyOf(*slot));
+            if (!less and !m_compare(keyOf(*slot), key)) {
+                break;
+            }
+            slot = less ? &(*slot)->m_left : &(*slot)->m_right;
+            if constexpr (record) {
+                m_path.push_back(slot);
+            }
+        }
+        if constexpr (BalancePolicy::splays) {
+            //the splay starts at the last node visited
+            if (*slot == nullptr and m_path.size() > 1) {
+                m_path.pop_back();
+            }
+        }
+        return slot;
+    }
+
+    //Link the new leaf node at the empty link slot found by descend and fix the path above it
+    void link(Node** slot, Node* node){
+        Layout::update(node);
+        *slot = node;
+        fixPath((int)m_path.size() - 2, false);
+    }
+
+    //Make node the root with the old root below it, on the side its key falls on, the
+    //insertion of a SPLAY tree once the closest key is splayed to the root
+    void splitRoot(Node* node){
+        Node*& root = m_storage.root();
+        if (root != nullptr) {
+            if (m_compare(keyOf(root), keyOf(node))) {
+                node->m_left = root;
+                node->m_right = root->m_right;
+                root->m_right = nullptr;
+            }else {
+                node->m_right = root;
+                node->m_left = root->m_left;
+                root->m_left = nullptr;
+            }
+            update(root);
+        }
+        update(node);
+        root = node;
+    }
+
+    //Recompute the layout fields of node from its children
+    void update(Node* node){
+        if constexpr (Layout::augmented) {
+            Layout::update(node);
+            m_storage.count(TREEUPDATES);
+        }
+    }
+
+    //Restore the layout fields and the balance or rank rule of the nodes at m_path[last] and
+    //above, after an insertion or a removal below them
+    void fixPath(int last, bool removed){
+        if constexpr (BalancePolicy::ranks) {
+            for (int i = last; i >= 0; i--) {
+                if (removed) {
+                    fixRemoveRank(m_path[i]);
+                }else {
+                    fixInsertRank(m_path[i]);
+                }
+            }
+        }else if constexpr (BalancePolicy::balances or Layout::augmented) {
+            for (int i = last; i >= 0; i--) {
+                update(*m_path[i]);
+                if constexpr (BalancePolicy::balances) {
+                    rebalance(m_path[i]);
+                }
+            }
+        }
+    }
+
+    //Restore the AVL property at the node *slot
+    void rebalance(Node** slot){
+        Node* node = *slot;
+        int balance = HeightField::heightOf(node->m_left) - HeightField::heightOf(node->m_right);
+        if (balance > 1) {
+            m_storage.count(TREEREBALANCES);
+            Node* left = node->m_left;
+            if (HeightField::heightOf(left->m_left) < HeightField::heightOf(left->m_right)) {
+                //left-right case, the left child leans right and is rotated left first
+                rotateUp(&node->m_left, left->m_right);
+            }
+            rotateUp(slot, node->m_left);
+        }else if (balance < -1) {
+            m_storage.count(TREEREBALANCES);
+            Node* right = node->m_right;
+            if (HeightField::heightOf(right->m_right) < HeightField::heightOf(right->m_left)) {
+                //right-left case
+                rotateUp(&node->m_right, right->m_left);
+            }
+            rotateUp(slot, node->m_right);
+        }
+    }
+
+    //A child of *slot may have reached its rank (a 0-child). Promote the node if its other
+    //child is a 1-child, otherwise rotate; the rotations set heights, so the ranks are
+    //assigned again after them.
+    void fixInsertRank(Node** slot){
+        Node* node = *slot;
+        int rank = node->m_height;
+        Node* left = node->m_left;
+        Node* right = node->m_right;
+        if (HeightField::heightOf(left) == rank) {
+            if (rank - HeightField::heightOf(right) == 1) {
+                m_storage.count(TREEUPDATES);
+                node->m_height = rank + 1;
+                return;
+            }
+            m_storage.count(TREEREBALANCES);
+            if (rank - HeightField::heightOf(left->m_right) == 2) {
+                //the outer child of left grew, a single rotation
+                rotateUp(slot, left);
+                left->m_height = rank;
+                node->m_height = rank - 1;
+                return;
+            }
+            Node* inner = left->m_right;
+            rotateUp(&node->m_left, inner);
+            rotateUp(slot, inner);
+            inner->m_height = rank;
+            left->m_height = rank - 1;
+            node->m_height = rank - 1;
+        }else if (HeightField::heightOf(right) == rank) {
+            if (rank - HeightField::heightOf(left) == 1) {
+                m_storage.count(TREEUPDATES);
+                node->m_height = rank + 1;
+                return;
+            }
+            m_storage.count(TREEREBALANCES);
+            if (rank - HeightField::heightOf(right->m_left) == 2) {
+                rotateUp(slot, right);
+                right->m_height = rank;
+                node->m_height = rank - 1;
+                return;
+            }
+            Node* inner = right->m_left;
+            rotateUp(&node->m_right, inner);
+            rotateUp(slot, inner);
+            inner->m_height = rank;
+            right->m_height = rank - 1;
+            node->m_height = rank - 1;
+        }
+    }
+
+    //A child of *slot may have dropped to 3 ranks below it or the node became a leaf of
+    //rank 1. Demote the node (and its sibling if that one is a 2,2 node) or rotate.
+    void fixRemoveRank(Node** slot){
+        Node* node = *slot;
+        int rank = node->m_height;
+        Node* left = node->m_left;
+        Node* right = node->m_right;
+        if (left == nullptr and right == nullptr) {
+            if (rank != 0) {
+                m_storage.count(TREEUPDATES);
+                node->m_height = 0;
+            }
+            return;
+        }
+        if (rank - HeightField::heightOf(left) == 3) {
+            int siblingRank = right->m_height;
+            if (rank - siblingRank == 2) {
+                m_storage.count(TREEUPDATES);
+                node->m_height = rank - 1;
+                return;
+            }
+            int outerGap = siblingRank - HeightField::heightOf(right->m_right);
+            int innerGap = siblingRank - HeightField::heightOf(right->m_left);
+            if (outerGap == 2 and innerGap == 2) {
+                m_storage.count(TREEUPDATES, 2);
+                node->m_height = rank - 1;
+                right->m_height = siblingRank - 1;
+                return;
+            }
+            m_storage.count(TREEREBALANCES);
+            if (outerGap == 1) {
+                rotateUp(slot, right);
+                right->m_height = rank;
+                //a node left without children must be a leaf of rank 0
+                node->m_height = (node->m_left == nullptr and node->m_right == nullptr) ? 0 : rank - 1;
+                return;
+            }
+            Node* inner = right->m_left;
+            rotateUp(&node->m_right, inner);
+            rotateUp(slot, inner);
+            inner->m_height = rank;
+            right->m_height = siblingRank - 1;
+            node->m_height = rank - 2;
+        }else if (rank - HeightField::heightOf(right) == 3) {
+            int siblingRank = left->m_height;
+            if (rank - siblingRank == 2) {
+                m_storage.count(TREEUPDATES);
+                node->m_height = rank - 1;
+                return;
+            }
+            int outerGap = siblingRank - HeightField::heightOf(left->m_left);
+            int innerGap = siblingRank - HeightField::heightOf(left->m_right);
+            if (outerGap == 2 and innerGap == 2) {
+                m_storage.count(TREEUPDATES, 2);
+                node->m_height = rank - 1;
+                left->m_height = siblingRank - 1;
+                return;
+            }
+            m_storage.count(TREEREBALANCES);
+            if (outerGap == 1) {
+                rotateUp(slot, left);
+                left->m_height = rank;
+                node->m_height = (node->m_left == nullptr and node->m_right == nullptr) ? 0 : rank - 1;
+                return;
+            }
+            Node* inner = left->m_right;
+            rotateUp(&node->m_left, inner);
+            rotateUp(slot, inner);
+            inner->m_height = rank;
+            left->m_height = siblingRank - 1;
+            node->m_height = rank - 2;
+        }
+    }
+
+    //Rotate child above its parent *slot and update both
+    void rotateUp(Node** slot, Node* child){
+        Node* parent = *slot;
+        if (parent->m_left == child) {
+            m_storage.count(TREERIGHTROTATIONS);
+            parent->m_left = child->m_right;
+            child->m_right = parent;
+        }else {
+            m_storage.count(TREELEFTROTATIONS);
+            parent->m_right = child->m_left;
+            child->m_left = parent;
+        }
+        update(parent);
+        update(child);
+        *slot = child;
+    }
+
+    //Splay the node at the end of m_path to the root. The pairs of rotations are counted
+    //from the root down, so a node at an odd depth first takes its single rotation at the
+    //bottom and the pairs follow bottom up, the order of a recursive top-down splay.
+    void splayPath(){
+        int position = (int)m_path.size() - 1;
+        Node* node = *m_path[position];
+        if (node == nullptr) {
+            return;
+        }
+        m_storage.count(TREESPLAYS);
+        m_storage.count(TREESPLAYDEPTH, position);
+        if (position % 2 == 1) {
+            rotateUp(m_path[position - 1], node);
+            position--;
+        }
+        while (position >= 2) {
+            Node* parent = *m_path[position - 1];
+            Node* grandparent = *m_path[position - 2];
+            if ((parent->m_left == node) == (grandparent->m_left == parent)) {
+                //zig-zig, the parent goes up first
+                rotateUp(m_path[position - 2], parent);
+                rotateUp(m_path[position - 2], node);
+            }else {
+                //zig-zag
+                rotateUp(m_path[position - 1], node);
+                rotateUp(m_path[position - 2], node);
+            }
+            position = position - 2;
+        }
+    }
+};
+#endif
@@ -0,0 +1,1023 @@
+// UMBC - CMSC 341 - Fall 2024 - Proj2
+#include "swarm.h"
+#include "basicswarm.h"
+#include "swarmservice.h"
+#include "random.h"
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+using namespace std;
+
+const int BENCHSIZE = 90000;   // robots in the large benchmark swarms
+const int SUITEOPS = 100000;   // timed operations per workload run of the suite
+const int MAXDEGENERATE = 10000; // largest size a BST is run with on sorted input
+
+//Heap usage of the whole program, the global operator new below keeps it up to date
+//(gcc flags the malloc/free pair inside the replaced operators as mismatched)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+atomic<size_t> heapBytes(0);
+atomic<size_t> peakHeapBytes(0);
+
+void* operator new(size_t size){
+    //the size is stored in front of the block so that delete can subtract it
+    char* block = (char*)malloc(size + 16);
+    if (block == nullptr) throw bad_alloc();
+    *(size_t*)block = size;
+    size_t bytes = heapBytes += size;
+    if (bytes > peakHeapBytes) peakHeapBytes = bytes;
+    return block + 16;
+}
+void operator delete(void* pointer) noexcept{
+    if (pointer == nullptr) return;
+    char* block = (char*)pointer - 16;
+    heapBytes -= *(size_t*)block;
+    free(block);
+}
+void operator delete(void* pointer, size_t) noexcept{
+    operator delete(pointer);
+}
+
+//Seconds elapsed since start
+double secondsSince(chrono::steady_clock::time_point start){
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+//Builds a swarm of size robots with unique random ids and random types and states
+void buildRandomSwarm(Swarm & team, int size, TREETYPE type){
+    Random idGen(MINID, MINID + size - 1, SHUFFLE);
+    Random typeGen(0,4);
+    Random stateGen(0,1);
+    vector<int> ids;
+    idGen.getShuffle(ids);
+    vector<Robot> robots;
+    for (int id : ids){
+        robots.push_back(Robot(id, static_cast<ROBOTTYPE>(typeGen.getRandNum()),
+                               static_cast<STATE>(stateGen.getRandNum())));
+    }
+    team.buildFrom(robots, type);
+}
+
+//Aggregates collected by a nightly health report
+struct HealthReport{
+    int typeCount[QUADRUPED + 1] = {0};
+    int alive = 0;
+    int dead = 0;
+    int idHistogram[10] = {0};   // robots per tenth of the id range
+};
+
+//Aggregate a 90k-robot AVL swarm with parallelReduce on 1, 2, 4, ... threads up to all cores
+void benchParallelReduce(){
+    Swarm team;
+    buildRandomSwarm(team, BENCHSIZE, AVL);
+    auto fold = [](HealthReport & report, const Robot & robot){
+        report.typeCount[robot.getType()]++;
+        if (robot.getState() == ALIVE) report.alive++;
+        else report.dead++;
+        report.idHistogram[(robot.getID() - MINID) * 10 / (MAXID - MINID + 1)]++;
+    };
+    auto combine = [](HealthReport & report, const HealthReport & other){
+        for (int i = 0; i <= QUADRUPED; i++) report.typeCount[i] += other.typeCount[i];
+        report.alive += other.alive;
+        report.dead += other.dead;
+        for (int i = 0; i < 10; i++) report.idHistogram[i] += other.idHistogram[i];
+    };
+    const int rounds = 20;
+    unsigned int cores = max(1u, thread::hardware_concurrency());
+    double baseline = 0;
+    cout << "\nparallelReduce health report over " << BENCHSIZE << " robots (AVL):\n";
+    vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < cores; threads = threads * 2){
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(cores);
+    for (unsigned int threads : threadCounts){
+        HealthReport report;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++){
+            report = team.parallelReduce(HealthReport(), fold, combine, threads);
+        }
+        double seconds = secondsSince(start) / rounds;
+        if (threads == 1) baseline = seconds;
+        cout << "\tthreads: " << threads << "\tms/report: " << seconds * 1000
+             << "\tspeedup: " << baseline / seconds
+             << "\talive: " << report.alive << "\tdead: " << report.dead << endl;
+    }
+}
+
+//Compare random lookups in a pointer-based AVL tree with the same swarm frozen
+void benchFrozenLookup(){
+    //insert in random order so that nodes are scattered like after real provisioning
+    Random idGen(MINID, MINID + BENCHSIZE - 1, SHUFFLE);
+    vector<int> ids;
+    idGen.getShuffle(ids);
+    Swarm team(AVL);
+    for (int id : ids){
+        team.insert(Robot(id));
+    }
+    const int lookups = 2000000;
+    Random lookupGen(MINID, MINID + BENCHSIZE - 1);
+    vector<int> queries;
+    for (int i = 0; i < lookups; i++){
+        queries.push_back(lookupGen.getRandNum());
+    }
+    cout << "\nRandom lookups in a " << BENCHSIZE << "-robot AVL swarm:\n";
+    string names[] = {"pointer AVL       ", "frozen (Eytzinger)", "frozen (B+ tree)  "};
+    for (int mode = 0; mode < 3; mode++){
+        if (mode == 1) team.freeze(EYTZINGER);
+        if (mode == 2) team.freeze(BTREE);
+        long long found = 0;
+        auto start = chrono::steady_clock::now();
+        for (int id : queries){
+            found += (team.find(id) != nullptr);
+        }
+        double seconds = secondsSince(start);
+        cout << "\t" << names[mode] << "\tns/lookup: " << seconds * 1e9 / lookups
+             << "\tfound: " << found << endl;
+    }
+
+    //range scans of 100 ids, the B+ tree layout scans its sorted leaves
+    const int scans = 100000;
+    cout << "\nRange scans of 100 ids in a " << BENCHSIZE << "-robot AVL swarm:\n";
+    for (int mode = 0; mode < 2; mode++){
+        if (mode == 0) team.thaw();
+        else team.freeze(BTREE);
+        long long found = 0;
+        vector<Robot*> robots;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < scans; i++){
+            robots.clear();
+            team.findRange(queries[i], queries[i] + 99, robots);
+            found += robots.size();
+        }
+        double seconds = secondsSince(start);
+        cout << "\t" << names[mode * 2] << "\tns/scan: " << seconds * 1e9 / scans
+             << "\tfound: " << found << endl;
+    }
+}
+
+//Compare findBatch with a loop of find on BST, AVL and the frozen layouts
+void benchFindBatch(){
+    Random idGen(MINID, MINID + BENCHSIZE - 1, SHUFFLE);
+    vector<int> ids;
+    idGen.getShuffle(ids);
+    const int lookups = 2000000;
+    Random lookupGen(MINID, MINID + BENCHSIZE - 1);
+    vector<int> queries;
+    for (int i = 0; i < lookups; i++){
+        queries.push_back(lookupGen.getRandNum());
+    }
+    vector<Robot*> results(lookups);
+    cout << "\nfindBatch vs a loop of find, " << lookups << " random lookups in " << BENCHSIZE << " robots:\n";
+    string names[] = {"BST               ", "AVL               ", "frozen (Eytzinger)", "frozen (B+ tree)  "};
+    for (int mode = 0; mode < 4; mode++){
+        Swarm team(mode == 0 ? BST : AVL);
+        for (int id : ids){
+            team.insert(Robot(id));
+        }
+        if (mode == 2) team.freeze(EYTZINGER);
+        if (mode == 3) team.freeze(BTREE);
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < lookups; i++){
+            results[i] = team.find(queries[i]);
+        }
+        double single = secondsSince(start);
+        start = chrono::steady_clock::now();
+        team.findBatch(queries.data(), queries.size(), results.data());
+        double batch = secondsSince(start);
+        cout << "\t" << names[mode] << "\tns/lookup single: " << single * 1e9 / lookups
+             << "\tbatch: " << batch * 1e9 / lookups << "\tspeedup: " << single / batch << endl;
+    }
+}
+
+//Compare a warm restart from a saved image with rebuilding the swarm by insertions
+void benchSaveLoad(){
+    Random idGen(MINID, MINID + BENCHSIZE - 1, SHUFFLE);
+    vector<int> ids;
+    idGen.getShuffle(ids);
+    auto start = chrono::steady_clock::now();
+    Swarm team(AVL);
+    for (int id : ids){
+        team.insert(Robot(id));
+    }
+    double rebuild = secondsSince(start);
+    start = chrono::steady_clock::now();
+    team.save("bench_swarm.bin");
+    double save = secondsSince(start);
+    Swarm restored;
+    start = chrono::steady_clock::now();
+    bool loaded = restored.load("bench_swarm.bin");
+    double load = secondsSince(start);
+    remove("bench_swarm.bin");
+    cout << "\nRestart of a " << BENCHSIZE << "-robot AVL swarm:\n";
+    cout << "\trebuild by inserts ms: " << rebuild * 1000 << "\tsave ms: " << save * 1000
+         << "\tload ms: " << load * 1000 << (loaded ? "" : " (load failed)") << endl;
+}
+
+void benchLog(){
+    Random idGen(MINID, MINID + BENCHSIZE - 1, SHUFFLE);
+    vector<int> ids;
+    idGen.getShuffle(ids);
+    cout << "\nWrite-ahead log of " << BENCHSIZE << " AVL inserts:\n";
+    int groups[] = {0, 1, 64, 1024};
+    for (int group : groups){
+        remove("bench_swarm.log");
+        Swarm team(AVL);
+        if (group > 0){
+            team.openLog("bench_swarm.log", group);
+        }
+        auto start = chrono::steady_clock::now();
+        for (int id : ids){
+            team.insert(Robot(id));
+        }
+        team.closeLog();
+        double seconds = secondsSince(start);
+        cout << "\t" << (group == 0 ? string("no log") : "group " + to_string(group))
+             << "\tinserts/s: " << (long long)(BENCHSIZE / seconds) << endl;
+    }
+    Swarm restored(AVL);
+    auto start = chrono::steady_clock::now();
+    restored.replay("bench_swarm.log");
+    double replay = secondsSince(start);
+    restored.openLog("bench_swarm.log");
+    start = chrono::steady_clock::now();
+    restored.compactLog("bench_swarm.bin");
+    double compact = secondsSince(start);
+    restored.closeLog();
+    double total = secondsSince(start);
+    cout << "\treplay ms: " << replay * 1000 << "\tcompaction foreground ms: " << compact * 1000
+         << "\tbackground done ms: " << total * 1000 << endl;
+    remove("bench_swarm.log");
+    remove("bench_swarm.bin");
+}
+
+//Insert ids into tree and then look every one of them up, the seconds of both phases go to times
+template <class Tree>
+void timeInsertFind(Tree& tree, const vector<int>& ids, const vector<int>& lookups, double times[2]){
+    auto start = chrono::steady_clock::now();
+    for (int id : ids){
+        tree.insert(Robot(id));
+    }
+    times[0] = secondsSince(start);
+    start = chrono::steady_clock::now();
+    long long found = 0;
+    for (int id : lookups){
+        found += (tree.find(id) != nullptr);
+    }
+    times[1] = secondsSince(start);
+    if (found != (long long)lookups.size()){
+        cout << "\tlookups missed robots" << endl;
+    }
+}
+
+void benchBasicSwarm(){
+    Random idGen(MINID, MINID + BENCHSIZE - 1, SHUFFLE);
+    vector<int> ids;
+    vector<int> lookups;
+    idGen.getShuffle(ids);
+    idGen.getShuffle(lookups);
+    double times[6][2];
+    Swarm bst(BST);
+    Swarm avl(AVL);
+    Swarm splay(SPLAY);
+    BasicSwarm<BSTPolicy> basicBST;
+    BasicSwarm<AVLPolicy, HeightLayout> basicAVL;
+    BasicSwarm<SplayPolicy> basicSplay;
+    timeInsertFind(bst, ids, lookups, times[0]);
+    timeInsertFind(basicBST, ids, lookups, times[1]);
+    timeInsertFind(avl, ids, lookups, times[2]);
+    timeInsertFind(basicAVL, ids, lookups, times[3]);
+    timeInsertFind(splay, ids, lookups, times[4]);
+    timeInsertFind(basicSplay, ids, lookups, times[5]);
+    const char* names[] = {"Swarm BST", "BasicSwarm BST", "Swarm AVL", "BasicSwarm AVL",
+                           "Swarm SPLAY", "BasicSwarm SPLAY"};
+    cout << "\nRuntime vs compile-time tree type, " << BENCHSIZE << " random inserts then finds"
+         << " (node bytes: Robot " << sizeof(Robot) << ", BasicSwarm plain "
+         << sizeof(BasicSwarm<SplayPolicy>::Node) << ", height " << sizeof(BasicSwarm<AVLPolicy, HeightLayout>::Node) << "):\n";
+    for (int i = 0; i < 6; i++){
+        cout << "\t" << left << setw(18) << names[i] << right << "inserts/s: " << (long long)(BENCHSIZE / times[i][0])
+             << "\tfinds/s: " << (long long)(BENCHSIZE / times[i][1]) << endl;
+    }
+}
+
+void benchEmplace(){
+    //every id arrives four times in random order, three of them are duplicates
+    Random idGen(MINID, MINID + BENCHSIZE - 1, SHUFFLE);
+    vector<int> ids;
+    for (int copy = 0; copy < 4; copy++){
+        vector<int> shuffled;
+        idGen.getShuffle(shuffled);
+        ids.insert(ids.end(), shuffled.begin(), shuffled.end());
+    }
+    shuffle(ids.begin(), ids.end(), mt19937(10));
+    cout << "\nDuplicate-heavy ingest, " << ids.size() << " inserts of " << BENCHSIZE << " ids:\n";
+    TREETYPE types[] = {BST, AVL, SPLAY};
+    const char* names[] = {"", "BST", "AVL", "SPLAY"};
+    for (TREETYPE type : types){
+        for (int way = 0; way < 2; way++){
+            size_t heapBefore = heapBytes;
+            Swarm team(type);
+            auto start = chrono::steady_clock::now();
+            for (int id : ids){
+                if (way == 0){
+                    team.insert(Robot(id));
+                }else{
+                    team.emplace(id);
+                }
+            }
+            double seconds = secondsSince(start);
+            cout << "\t" << names[type] << (way == 0 ? "\tinsert " : "\templace") << "\tinserts/s: "
+                 << (long long)(ids.size() / seconds) << "\theap KB: " << (heapBytes - heapBefore) / 1024 << endl;
+        }
+    }
+}
+
+void benchWAVL(){
+    //write-heavy churn: fill the swarm, then remove a random id and insert another one
+    const int size = BENCHSIZE;
+    Random idGen(MINID, MAXID);
+    vector<int> ids;
+    for (int i = 0; i < 4 * size; i++){
+        ids.push_back(idGen.getRandNum());
+    }
+    cout << "\nWrite-heavy churn, " << size << " inserts then " << 3 * size << " remove/insert pairs:\n";
+    TREETYPE types[] = {AVL, WAVL};
+    const char* names[] = {"AVL", "WAVL"};
+    for (int t = 0; t < 2; t++){
+        Swarm team(types[t]);
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < size; i++){
+            team.insert(Robot(ids[i]));
+        }
+        for (int i = size; i < 4 * size; i++){
+            team.remove(ids[i - size]);
+            team.insert(Robot(ids[i]));
+        }
+        double seconds = secondsSince(start);
+        SwarmStats stats = team.stats();
+        cout << "\t" << names[t] << "\tops/s: " << (long long)(7 * size / seconds)
+             << "\theight: " << stats.height << "\tavg depth: " << stats.averageDepth;
+#ifdef SWARM_STATS
+        cout << "\trotations: " << stats.leftRotations + stats.rightRotations;
+#endif
+        cout << endl;
+    }
+}
+
+void benchAVLRemoveStress(){
+    //millions of mixed inserts and removes, in runs that grow and shrink the swarm
+    const int rounds = 4;
+    const int roundSize = 1000000;
+    Random idGen(MINID, MAXID);
+    Swarm team(AVL);
+    cout << "\nAVL stress, " << rounds << " x " << roundSize << " mixed inserts and removes:\n";
+    for (int round = 0; round < rounds; round++){
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < roundSize; i++){
+            //insert twice as often in even runs of 100k operations, remove twice as often in odd ones
+            bool grow = ((i / 100000) % 2 == 0);
+            if ((i % 3 == 0) == grow){
+                team.remove(idGen.getRandNum());
+            }else{
+                team.insert(Robot(idGen.getRandNum()));
+            }
+        }
+        double seconds = secondsSince(start);
+        SwarmStats stats = team.stats();
+        cout << "\tround " << round + 1 << "\tops/s: " << (long long)(roundSize / seconds)
+             << "\trobots: " << stats.nodeCount << "\theight: " << stats.height
+             << "\tAVL bound: " << (int)(1.44 * log2(stats.nodeCount + 2)) << endl;
+    }
+}
+
+void benchLazyDelete(){
+    //bursts that decommission a tenth of the swarm at once, each followed by lookups and refills
+    const int size = BENCHSIZE;
+    const int bursts = 10;
+    const int burstSize = size / 10;
+    Random idGen(MINID, MAXID);
+    vector<int> ids;
+    for (int i = 0; i < size + bursts * burstSize; i++){
+        ids.push_back(idGen.getRandNum());
+    }
+    cout << "\nBursty decommissioning, " << bursts << " bursts of " << burstSize << " removes, lookups and inserts:\n";
+    for (int lazy = 0; lazy < 2; lazy++){
+        Swarm team(AVL);
+        for (int i = 0; i < size; i++){
+            team.insert(Robot(ids[i]));
+        }
+        team.setLazyDelete(lazy == 1);
+        double removeSeconds = 0;
+        double otherSeconds = 0;
+        long long found = 0;
+        for (int burst = 0; burst < bursts; burst++){
+            int first = burst * burstSize;
+            auto start = chrono::steady_clock::now();
+            for (int i = first; i < first + burstSize; i++){
+                team.remove(ids[i]);
+            }
+            removeSeconds += secondsSince(start);
+            start = chrono::steady_clock::now();
+            for (int i = first; i < first + size; i++){
+                found += (team.find(ids[i]) != nullptr);
+            }
+            for (int i = first + size; i < first + size + burstSize; i++){
+                team.insert(Robot(ids[i]));
+            }
+            otherSeconds += secondsSince(start);
+        }
+        cout << "\t" << (lazy == 1 ? "lazy " : "eager") << "\tremoves/s: " << (long long)(bursts * burstSize / removeSeconds)
+             << "\tlookups+inserts/s: " << (long long)(bursts * (size + burstSize) / otherSeconds)
+             << "\ttotal s: " << removeSeconds + otherSeconds << "\tfound: " << found << endl;
+    }
+}
+
+void benchIncrementalConvert(){
+    //pause of a BST to AVL conversion, at once and spread over the following finds
+    const int size = BENCHSIZE;
+    Random idGen(MINID, MAXID);
+    vector<int> ids;
+    for (int i = 0; i < size; i++){
+        ids.push_back(idGen.getRandNum());
+    }
+    cout << "\nBST to AVL conversion of " << size << " robots, longest pause of one call:\n";
+    int budgets[] = {0, 100, 20};
+    for (int budget : budgets){
+        Swarm team(BST);
+        for (int id : ids){
+            team.insert(Robot(id));
+        }
+        team.setConversionBudget(budget);
+        auto start = chrono::steady_clock::now();
+        team.setType(AVL);
+        double longest = secondsSince(start);
+        double total = longest;
+        int calls = 0;
+        while (team.isConverting()){
+            auto callStart = chrono::steady_clock::now();
+            team.find(ids[calls % size]);
+            double seconds = secondsSince(callStart);
+            longest = max(longest, seconds);
+            total += seconds;
+            calls++;
+        }
+        cout << "\tbudget us: " << budget << "\tlongest pause us: " << (long long)(longest * 1e6)
+             << "\tfinds until done: " << calls << "\ttotal ms: " << total * 1e3 << endl;
+    }
+}
+
+void benchCompact(){
+    //lookups and a full range scan after heavy churn, before and after compact()
+    const int size = BENCHSIZE;
+    Random idGen(MINID, MAXID);
+    Swarm team(AVL);
+    vector<int> ids;
+    for (int i = 0; i < size; i++){
+        ids.push_back(idGen.getRandNum());
+        team.insert(Robot(ids.back()));
+    }
+    //every removed node is reused by a later insert, so the nodes end up scattered
+    for (int i = 0; i < 4 * size; i++){
+        int slot = i % size;
+        team.remove(ids[slot]);
+        ids[slot] = idGen.getRandNum();
+        team.insert(Robot(ids[slot]));
+    }
+    for (int i = 0; i < size / 2; i++){
+        team.remove(ids[i]);
+    }
+    cout << "\nCompaction after " << 4 * size << " remove/insert pairs and " << size / 2 << " removes:\n";
+    for (int round = 0; round < 2; round++){
+        if (round == 1) team.compact();
+        MemoryUsage usage = team.memoryUsage();
+        auto start = chrono::steady_clock::now();
+        long long found = 0;
+        for (int repeat = 0; repeat < 10; repeat++){
+            for (int id : ids) found += (team.find(id) != nullptr);
+        }
+        double findSeconds = secondsSince(start);
+        start = chrono::steady_clock::now();
+        vector<Robot*> robots;
+        for (int repeat = 0; repeat < 10; repeat++){
+            robots.clear();
+            team.findRange(MINID, MAXID, robots);
+        }
+        double scanSeconds = secondsSince(start);
+        cout << "\t" << (round == 0 ? "churned  " : "compacted") << "\tfinds/s: " << (long long)(10 * size / findSeconds)
+             << "\tscan ms: " << scanSeconds * 100 << "\tpool KB: " << usage.poolBytes / 1024
+             << "\toverhead KB: " << usage.overheadBytes / 1024 << "\tblocks: " << usage.blocks
+             << "\tfragmentation: " << usage.fragmentation << "\tfound: " << found << endl;
+    }
+}
+
+void benchDump(){
+    Swarm team;
+    buildRandomSwarm(team, BENCHSIZE, AVL);
+    const char* names[] = {"text", "json", "dot"};
+    cout << "\nDump of a " << BENCHSIZE << "-robot AVL swarm to a file:\n";
+    for (int format = DUMPTEXT; format <= DUMPDOT; format++){
+        ofstream out("bench_dump.txt");
+        auto start = chrono::steady_clock::now();
+        team.dumpTree(out, static_cast<DUMPFORMAT>(format));
+        double seconds = secondsSince(start);
+        double megabytes = out.tellp() / 1e6;
+        cout << "\t" << names[format] << " ms: " << seconds * 1000 << "\tMB/s: " << megabytes / seconds << endl;
+    }
+    remove("bench_dump.txt");
+}
+
+//Generates zipf distributed ranks in [0, size): rank r is drawn with weight 1/(r+1)^skew
+class Zipf{
+public:
+    Zipf(int size, double skew, int seed) : m_generator(seed){
+        double sum = 0;
+        for (int rank = 0; rank < size; rank++){
+            sum += 1.0 / pow(rank + 1, skew);
+            m_cumulative.push_back(sum);
+        }
+        m_uniform = uniform_real_distribution<double>(0, sum);
+    }
+    int getRank(){
+        double value = m_uniform(m_generator);
+        return (int)(lower_bound(m_cumulative.begin(), m_cumulative.end(), value) - m_cumulative.begin());
+    }
+private:
+    mt19937 m_generator;
+    uniform_real_distribution<double> m_uniform;
+    vector<double> m_cumulative;
+};
+
+enum WORKLOAD {SEQUENTIAL, UNIFORM, NORMALSKEW, ZIPFSKEW, MIXED};
+const string WORKLOADNAMES[] = {"sequential", "uniform", "normal", "zipf", "mixed"};
+const string TREENAMES[] = {"NONE", "BST", "AVL", "SPLAY", "WAVL", "BPTREE"};
+enum OPKIND {FIND, INSERT, REMOVE};
+struct Operation{
+    OPKIND kind;
+    int id;
+};
+
+//One row of the suite report
+struct SuiteResult{
+    TREETYPE tree;
+    WORKLOAD workload;
+    int size;
+    double insertsPerSec;   // building the swarm of size robots
+    double opsPerSec;       // the timed operation phase
+    double p50;             // latency percentiles of the operation phase in ns
+    double p99;
+    size_t peakBytes;       // peak heap growth while the swarm existed
+    double averageDepth;    // average node depth after the operation phase
+};
+
+/*
+Creates the insertion order and the timed operations of a workload on size robots.
+SEQUENTIAL inserts ids in increasing order, the other workloads in random order.
+The operations are lookups of uniform, normal or zipf distributed ids (the hottest
+zipf ids are scattered over the id range), except for MIXED which is 50% lookups,
+25% inserts of new ids and 25% removals, all on uniform ids.
+*/
+void makeWorkload(WORKLOAD workload, int size, vector<int> & inserts, vector<Operation> & ops){
+    Random shuffler(MINID, MINID + size - 1, SHUFFLE);
+    shuffler.setSeed(size);
+    inserts.clear();
+    shuffler.getShuffle(inserts);
+    vector<int> hotOrder = inserts;
+    if (workload == SEQUENTIAL) sort(inserts.begin(), inserts.end());
+    ops.clear();
+    Random uniformGen(MINID, MINID + size - 1);
+    Random normalGen(MINID, MINID + size - 1, NORMAL, MINID + size / 2, max(1, size / 10));
+    normalGen.setSeed(size);
+    Zipf zipfGen(size, 0.99, size);
+    Random kindGen(0, 3);
+    //new ids of MIXED come after the initial ids but are inserted in random order
+    Random newIDGen(MINID + size, MINID + size + SUITEOPS - 1, SHUFFLE);
+    newIDGen.setSeed(size);
+    vector<int> newIDs;
+    newIDGen.getShuffle(newIDs);
+    int nextNewID = 0;
+    for (int i = 0; i < SUITEOPS; i++){
+        Operation op = {FIND, 0};
+        if (workload == NORMALSKEW) op.id = normalGen.getRandNum();
+        else if (workload == ZIPFSKEW) op.id = hotOrder[zipfGen.getRank()];
+        else op.id = uniformGen.getRandNum();
+        if (workload == MIXED){
+            int kind = kindGen.getRandNum();
+            if (kind == 2){
+                op.kind = INSERT;
+                op.id = newIDs[nextNewID++];
+            }else if (kind == 3){
+                op.kind = REMOVE;
+            }
+        }
+        ops.push_back(op);
+    }
+}
+
+//Runs one workload on one tree type and measures it
+SuiteResult runWorkload(TREETYPE tree, WORKLOAD workload, int size){
+    SuiteResult result = {tree, workload, size, 0, 0, 0, 0, 0, 0};
+    vector<int> inserts;
+    vector<Operation> ops;
+    makeWorkload(workload, size, inserts, ops);
+    vector<double> latencies(ops.size());
+    size_t heapBefore = heapBytes;
+    peakHeapBytes = heapBytes.load();
+    {
+        Swarm team(tree);
+        auto start = chrono::steady_clock::now();
+        for (int id : inserts){
+            team.insert(Robot(id));
+        }
+        result.insertsPerSec = inserts.size() / secondsSince(start);
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < ops.size(); i++){
+            auto opStart = chrono::steady_clock::now();
+            if (ops[i].kind == FIND) team.find(ops[i].id);
+            else if (ops[i].kind == INSERT) team.insert(Robot(ops[i].id));
+            else team.remove(ops[i].id);
+            latencies[i] = chrono::duration<double, nano>(chrono::steady_clock::now() - opStart).count();
+        }
+        result.opsPerSec = ops.size() / secondsSince(start);
+        result.averageDepth = team.stats().averageDepth;
+    }
+    result.peakBytes = peakHeapBytes - heapBefore;
+    sort(latencies.begin(), latencies.end());
+    result.p50 = latencies[latencies.size() / 2];
+    result.p99 = latencies[latencies.size() * 99 / 100];
+    return result;
+}
+
+/*
+Runs a workload that changes character, zipf lookups, then the MIXED operations
+with removes, then zipf lookups again, on fixed AVL and SPLAY trees and on an
+adaptive tree that starts as a BST built from sorted ids.
+*/
+void benchAdaptive(){
+    const int size = 20000;
+    vector<int> inserts;
+    vector<Operation> zipfOps;
+    vector<Operation> mixedOps;
+    makeWorkload(ZIPFSKEW, size, inserts, zipfOps);
+    makeWorkload(MIXED, size, inserts, mixedOps);
+    sort(inserts.begin(), inserts.end());
+    vector<Operation>* phases[] = {&zipfOps, &mixedOps, &zipfOps};
+    cout << "\nAdaptive type selection, " << size << " robots, phases zipf, mixed, zipf of "
+         << SUITEOPS << " operations:\n";
+    TREETYPE types[] = {AVL, SPLAY, BST};
+    const char* names[] = {"AVL     ", "SPLAY   ", "adaptive"};
+    for (int t = 0; t < 3; t++){
+        Swarm team(types[t]);
+        team.setAdaptive(types[t] == BST);
+        for (int id : inserts){
+            team.insert(Robot(id));
+        }
+        cout << "\t" << names[t];
+        for (vector<Operation>* ops : phases){
+            auto start = chrono::steady_clock::now();
+            for (const Operation& op : *ops){
+                if (op.kind == FIND) team.find(op.id);
+                else if (op.kind == INSERT) team.insert(Robot(op.id));
+                else team.remove(op.id);
+            }
+            cout << "\tops/s: " << (long long)(ops->size() / secondsSince(start));
+        }
+        cout << "\tswitches:";
+        for (const AdaptDecision& decision : team.getAdaptLog()){
+            cout << " " << TREENAMES[decision.from] << "->" << TREENAMES[decision.to];
+        }
+        cout << endl;
+    }
+}
+
+void benchCache(){
+    vector<int> inserts;
+    vector<Operation> ops;
+    makeWorkload(ZIPFSKEW, BENCHSIZE, inserts, ops);
+    cout << "\nHot-id cache, " << ops.size() << " zipf lookups in " << BENCHSIZE << " robots:\n";
+    TREETYPE types[] = {AVL, AVL, AVL, SPLAY};
+    int slots[] = {0, 256, CACHESLOTS, 0};
+    const char* names[] = {"AVL             ", "AVL, 256 slots  ", "AVL, 1024 slots ", "SPLAY           "};
+    for (int t = 0; t < 4; t++){
+        Swarm team(types[t]);
+        for (int id : inserts){
+            team.insert(Robot(id));
+        }
+        team.setCache(slots[t]);
+        auto start = chrono::steady_clock::now();
+        for (const Operation& op : ops){
+            team.find(op.id);
+        }
+        double seconds = secondsSince(start);
+        cout << "\t" << names[t] << "\tns/lookup: " << seconds * 1e9 / ops.size()
+             << "\thit rate: " << team.cacheStats().hitRate << endl;
+    }
+}
+
+void benchWeighted(){
+    //zipf lookups counted on one pass, then timed on a second pass of the same stream
+    vector<int> inserts;
+    vector<Operation> ops;
+    makeWorkload(ZIPFSKEW, BENCHSIZE, inserts, ops);
+    cout << "\nFrequency-weighted rebuild, " << ops.size() << " zipf lookups in " << BENCHSIZE << " robots:\n";
+    TREETYPE types[] = {AVL, SPLAY, AVL};
+    const char* names[] = {"AVL     ", "SPLAY   ", "weighted"};
+    for (int t = 0; t < 3; t++){
+        Swarm team(types[t]);
+        for (int id : inserts){
+            team.insert(Robot(id));
+        }
+        team.setAccessCounting(true);
+        for (const Operation& op : ops){
+            team.find(op.id);
+        }
+        if (t == 2){
+            team.rebuildWeighted();
+        }
+        team.resetAccessCounts();
+        auto start = chrono::steady_clock::now();
+        for (const Operation& op : ops){
+            team.find(op.id);
+        }
+        double seconds = secondsSince(start);
+        SwarmStats stats = team.stats();
+        cout << "\t" << names[t] << "\tns/lookup: " << seconds * 1e9 / ops.size()
+             << "\tdepth per lookup: " << stats.accessDepth << "\tmax depth: " << stats.maxDepth << endl;
+    }
+}
+
+//Compare producer threads that share one Swarm behind a mutex with the same
+//threads queueing their mutations on a SwarmService, one future per command
+//and one future per SERVICECHUNK commands
+const int SERVICECHUNK = 1024;
+void benchSwarmService(){
+    //thread t inserts the ids of its own shuffled slice and removes every other one
+    const int producerCounts[] = {1, 2, 4};
+    Random idGen(MINID, MINID + BENCHSIZE - 1, SHUFFLE);
+    vector<int> ids;
+    idGen.getShuffle(ids);
+    cout << "\nMutation throughput, " << BENCHSIZE << " inserts and " << BENCHSIZE / 2 << " removes (AVL), Mops/s:\n";
+    for (int producers : producerCounts){
+        int slice = BENCHSIZE / producers;
+        double rates[3];
+        double perBatch = 0;
+        for (int mode = 0; mode < 3; mode++){
+            Swarm team(AVL);
+            mutex teamLock;
+            SwarmService* service = (mode > 0) ? new SwarmService(AVL) : nullptr;
+            vector<thread> threads;
+            auto start = chrono::steady_clock::now();
+            for (int t = 0; t < producers; t++){
+                threads.push_back(thread([&, t](){
+                    int first = t * slice;
+                    int last = (t == producers - 1) ? BENCHSIZE : first + slice;
+                    if (mode == 0){
+                        for (int i = first; i < last; i++){
+                            lock_guard<mutex> lock(teamLock);
+                            team.insert(Robot(ids[i]));
+                        }
+                        for (int i = first; i < last; i = i + 2){
+                            lock_guard<mutex> lock(teamLock);
+                            team.remove(ids[i]);
+                        }
+                    }else if (mode == 1){
+                        vector<future<bool> > done;
+                        for (int i = first; i < last; i++){
+                            done.push_back(service->insert(Robot(ids[i])));
+                        }
+                        for (int i = first; i < last; i = i + 2){
+                            done.push_back(service->remove(ids[i]));
+                        }
+                        for (future<bool>& result : done){
+                            result.wait();
+                        }
+                    }else {
+                        vector<future<vector<bool> > > done;
+                        vector<Robot> robots;
+                        vector<int> removes;
+                        for (int i = first; i < last; i++){
+                            robots.push_back(Robot(ids[i]));
+                            if ((int)robots.size() == SERVICECHUNK or i == last - 1){
+                                done.push_back(service->insertAll(robots));
+                                robots.clear();
+                            }
+                        }
+                        for (int i = first; i < last; i = i + 2){
+                            removes.push_back(ids[i]);
+                            if ((int)removes.size() == SERVICECHUNK or i + 2 >= last){
+                                done.push_back(service->removeAll(removes));
+                                removes.clear();
+                            }
+                        }
+                        for (future<vector<bool> >& result : done){
+                            result.wait();
+                        }
+                    }
+                }));
+            }
+            for (thread& producer : threads){
+                producer.join();
+            }
+            rates[mode] = BENCHSIZE * 1.5 / secondsSince(start) / 1e6;
+            if (service != nullptr){
+                perBatch = (double)service->getApplied() / service->getBatches();
+                delete service;
+            }
+        }
+        cout << "\tproducers: " << producers << "\tlocked: " << rates[0] << "\tservice: " << rates[1]
+             << "\tservice, chunks of " << SERVICECHUNK << ": " << rates[2]
+             << "\tcommands per batch: " << perBatch << endl;
+    }
+}
+
+//Build a 90k-robot swarm with positions in a square and in a cube, time the
+//index upkeep of inserts and moves and the filtered k-nearest and radius queries,
+//and compare the nearest queries with a scan of every position
+void benchSpatial(){
+    const int queries = 100000;
+    const int scans = 200;
+    const int k = 8;
+    mt19937 generator(5);
+    cout << "\nSpatial index, " << BENCHSIZE << " robots about " << SPATIALCELL << " apart, " << k << " nearest:\n";
+    for (int dimensions = 2; dimensions <= 3; dimensions++){
+        float side = SPATIALCELL * (float)pow(BENCHSIZE, 1.0 / dimensions);
+        uniform_real_distribution<float> coordinate(0, side);
+        vector<Position> positions;
+        for (int i = 0; i < BENCHSIZE; i++){
+            positions.push_back(Position{coordinate(generator), coordinate(generator),
+                                         dimensions == 3 ? coordinate(generator) : 0});
+        }
+        Swarm plain(AVL);
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < BENCHSIZE; i++){
+            plain.insert(Robot(MINID + i, static_cast<ROBOTTYPE>(i % 5), static_cast<STATE>(i % 3 == 0)));
+        }
+        double plainInsert = secondsSince(start);
+        Swarm team(AVL);
+        team.setSpatialIndex(true);
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < BENCHSIZE; i++){
+            team.insert(Robot(MINID + i, static_cast<ROBOTTYPE>(i % 5), static_cast<STATE>(i % 3 == 0)), positions[i]);
+        }
+        double spatialInsert = secondsSince(start);
+        vector<Position> centers;
+        for (int i = 0; i < queries; i++){
+            centers.push_back(Position{coordinate(generator), coordinate(generator),
+                                       dimensions == 3 ? coordinate(generator) : 0});
+        }
+        //any robot, alive drones only, and a radius of 2.5 cells around each center
+        vector<Robot*> robots;
+        double seconds[3];
+        long long found[3] = {0, 0, 0};
+        for (int mode = 0; mode < 3; mode++){
+            start = chrono::steady_clock::now();
+            for (const Position& center : centers){
+                if (mode == 0) team.findNearest(center, k, robots);
+                if (mode == 1) team.findNearest(center, k, robots, 1 << DRONE, 1 << ALIVE);
+                if (mode == 2) team.findRadius(center, 2.5 * SPATIALCELL, robots, 1 << DRONE, 1 << ALIVE);
+                found[mode] += robots.size();
+            }
+            seconds[mode] = secondsSince(start);
+        }
+        //the scan a separate system joined by id would do, every position per query
+        start = chrono::steady_clock::now();
+        vector<pair<float, int>> distances(BENCHSIZE);
+        for (int q = 0; q < scans; q++){
+            for (int i = 0; i < BENCHSIZE; i++){
+                float dx = positions[i].x - centers[q].x;
+                float dy = positions[i].y - centers[q].y;
+                float dz = positions[i].z - centers[q].z;
+                distances[i] = make_pair(dx * dx + dy * dy + dz * dz, i);
+            }
+            partial_sort(distances.begin(), distances.begin() + k, distances.end());
+        }
+        double scan = secondsSince(start) / scans;
+        //every robot moves a little
+        uniform_real_distribution<float> jitter(-SPATIALCELL / 2, SPATIALCELL / 2);
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < BENCHSIZE; i++){
+            positions[i].x += jitter(generator);
+            positions[i].y += jitter(generator);
+            team.setPosition(MINID + i, positions[i]);
+        }
+        double moves = secondsSince(start);
+        cout << "\t" << dimensions << "D\tinsert ns: " << plainInsert * 1e9 / BENCHSIZE << " -> "
+             << spatialInsert * 1e9 / BENCHSIZE << "\tmove ns: " << moves * 1e9 / BENCHSIZE
+             << "\tnearest us: " << seconds[0] * 1e6 / queries
+             << "\tnearest alive drones us: " << seconds[1] * 1e6 / queries
+             << "\tradius us: " << seconds[2] * 1e6 / queries << " (" << (double)found[2] / queries << " found)"
+             << "\tscan us: " << scan * 1e6 << " (" << scan / (seconds[0] / queries) << "x)"
+             << "\tindex KB: " << (team.memoryUsage().totalBytes - plain.memoryUsage().totalBytes) / 1024 << endl;
+    }
+}
+
+void writeCSV(const vector<SuiteResult> & results, ostream & out){
+    out << "tree,workload,size,inserts_per_sec,ops_per_sec,p50_ns,p99_ns,peak_bytes,avg_depth\n";
+    for (const SuiteResult & r : results){
+        out << TREENAMES[r.tree] << "," << WORKLOADNAMES[r.workload] << "," << r.size << ","
+            << r.insertsPerSec << "," << r.opsPerSec << "," << r.p50 << "," << r.p99 << ","
+            << r.peakBytes << "," << r.averageDepth << "\n";
+    }
+}
+
+void writeJSON(const vector<SuiteResult> & results, ostream & out){
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); i++){
+        const SuiteResult & r = results[i];
+        out << "  {\"tree\": \"" << TREENAMES[r.tree] << "\", \"workload\": \"" << WORKLOADNAMES[r.workload]
+            << "\", \"size\": " << r.size << ", \"inserts_per_sec\": " << r.insertsPerSec
+            << ", \"ops_per_sec\": " << r.opsPerSec << ", \"p50_ns\": " << r.p50
+            << ", \"p99_ns\": " << r.p99 << ", \"peak_bytes\": " << r.peakBytes
+            << ", \"avg_depth\": " << r.averageDepth << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]\n";
+}
+
+/*
+Runs every workload on BST, AVL, SPLAY, WAVL and BPTREE at 1k, 10k and 90k robots, prints a table
+and writes the results to csvPath and jsonPath when they are not empty.
+The BST is only run on sorted input up to MAXDEGENERATE robots, above that it
+degenerates into a list and a single run takes minutes.
+*/
+void benchSuite(const string & csvPath, const string & jsonPath){
+    vector<SuiteResult> results;
+    int sizes[] = {1000, 10000, BENCHSIZE};
+    TREETYPE trees[] = {BST, AVL, SPLAY, WAVL, BPTREE};
+    cout << "\nWorkload suite, " << SUITEOPS << " timed operations per run:\n";
+    cout << "\ttree\tworkload\tsize\tinserts/s\tops/s\tp50 ns\tp99 ns\tpeak KB\tavg depth\n";
+    for (int size : sizes){
+        for (int workload = SEQUENTIAL; workload <= MIXED; workload++){
+            for (TREETYPE tree : trees){
+                if (tree == BST and workload == SEQUENTIAL and size > MAXDEGENERATE) continue;
+                SuiteResult r = runWorkload(tree, static_cast<WORKLOAD>(workload), size);
+                results.push_back(r);
+                cout << "\t" << TREENAMES[r.tree] << "\t" << WORKLOADNAMES[r.workload]
+                     << (WORKLOADNAMES[r.workload].size() < 8 ? "\t\t" : "\t") << r.size
+                     << "\t" << (long long)r.insertsPerSec << "\t" << (long long)r.opsPerSec
+                     << "\t" << (long long)r.p50 << "\t" << (long long)r.p99
+                     << "\t" << r.peakBytes / 1024 << "\t" << r.averageDepth << endl;
+            }
+        }
+    }
+    if (!csvPath.empty()){
+        ofstream out(csvPath);
+        out << fixed << setprecision(2);
+        writeCSV(results, out);
+    }
+    if (!jsonPath.empty()){
+        ofstream out(jsonPath);
+        out << fixed << setprecision(2);
+        writeJSON(results, out);
+    }
+}
+
+/*
+Usage: ./bench [micro | suite] [--csv path] [--json path]
+Without micro or suite both the micro benchmarks and the workload suite are run.
+*/
+int main(int argc, char* argv[]){
+    bool micro = true;
+    bool suite = true;
+    string csvPath = "";
+    string jsonPath = "";
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "micro") == 0) suite = false;
+        else if (strcmp(argv[i], "suite") == 0) micro = false;
+        else if (strcmp(argv[i], "--csv") == 0 and i + 1 < argc) csvPath = argv[++i];
+        else if (strcmp(argv[i], "--json") == 0 and i + 1 < argc) jsonPath = argv[++i];
+        else{
+            cout << "Usage: " << argv[0] << " [micro | suite] [--csv path] [--json path]" << endl;
+            return 1;
+        }
+    }
+    if (micro){
+        benchParallelReduce();
+        benchFrozenLookup();
+        benchFindBatch();
+        benchSaveLoad();
+        benchDump();
+        benchLog();
+        benchBasicSwarm();
+        benchEmplace();
+        benchWAVL();
+        benchAVLRemoveStress();
+        benchLazyDelete();
+        benchIncrementalConvert();
+        benchCompact();
+        benchAdaptive();
+        benchCache();
+        benchWeighted();
+        benchSwarmService();
+        benchSpatial();
+    }
+    if (suite){
+        benchSuite(csvPath, jsonPath);
+    }
+    return 0;
+}
@@ -0,0 +1,477 @@
+// UMBC - CMSC 341 - Fall 2024 - Proj2
+#include "swarm.h"
+#include "random.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <map>
+#include <random>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+using namespace std;
+
+const int FUZZROUNDS = 100;     // default rounds, every round runs one operation stream on every tree type
+const int FUZZOPS = 4000;       // operations per round
+const int FUZZCHECK = 61;       // operations between two full checks of the structure
+const int SPEEDOPS = 2000000;   // operations of the throughput comparison
+const int SPEEDKEYS = 90000;    // distinct ids of the throughput comparison
+const string TYPENAMES[] = {"NONE", "BST", "AVL", "SPLAY", "WAVL", "BPTREE"};
+
+enum FUZZOP {FUZZINSERT, FUZZREMOVE, FUZZFIND, FUZZSETSTATE, FUZZSETTYPE, FUZZASSIGN, FUZZCOMPACT, FUZZWEIGHTED};
+//One operation of a stream, argument is the type and state of an insert (type | state << 3),
+//the state of a setState, the type of a setType, and 1 for a self-assignment
+struct FuzzOperation{
+    FUZZOP op;
+    int id;
+    int argument;
+};
+//Options of a round, the same for every tree type
+struct FuzzOptions{
+    int cacheSlots = 0;
+    bool lazyDelete = false;
+    double tombstoneRatio = TOMBSTONERATIO;
+    int conversionBudget = 0;
+    bool accessCounting = false;
+};
+//The reference, the type and state of every robot by id
+typedef map<int, pair<ROBOTTYPE, STATE>> Model;
+
+/*
+Drives every tree type of Swarm and a std::map with the same random operation
+streams and stops at the first difference. Every FUZZCHECK operations, and at
+the end of a stream, the structure is checked without recursion: BST order,
+heights (ranks for WAVL), the AVL balance and the rank rule of WAVL, the node
+fill, separators, leaf depth and leaf chain of BPTREE, and the contents in id
+order against the map. A round also picks a random cache size,
+lazy deletion, conversion budget and access counting, so that the lookups of
+those modes are checked too. Failures print the seed, round and operation to rerun them.
+*/
+class Fuzzer{
+public:
+    Fuzzer(unsigned int seed) : m_seed(seed), m_generator(seed), m_operations(0){}
+    bool run(int rounds);
+    void compareSpeed();
+private:
+    bool runStream(const vector<FuzzOperation>& stream, const FuzzOptions& options, TREETYPE type, int round);
+    bool apply(Swarm& team, Model& model, const FuzzOperation& operation, string& error);
+    bool check(Swarm& team, const Model& model, string& error);
+    bool checkTree(Robot* root, TREETYPE type, bool heights, string& error);
+    bool checkBPlus(const BPlusTree& tree, int count, string& error);
+    static string describe(const FuzzOperation& operation);
+    unsigned int m_seed;
+    mt19937 m_generator;
+    long long m_operations;
+};
+
+//Run rounds of random streams, returns false at the first mismatch
+bool Fuzzer::run(int rounds){
+    for (int round = 0; round < rounds; round++){
+        //small id ranges collide often, large ones grow deep trees
+        int ranges[] = {16, 256, 4096};
+        int range = ranges[m_generator() % 3];
+        FuzzOptions options;
+        if (m_generator() % 3 == 0) options.cacheSlots = 1 << (m_generator() % 8);
+        if (m_generator() % 3 == 0){
+            double ratios[] = {0.1, 0.25, 0.5};
+            options.lazyDelete = true;
+            options.tombstoneRatio = ratios[m_generator() % 3];
+        }
+        if (m_generator() % 3 == 0) options.conversionBudget = 1 + m_generator() % 20;
+        options.accessCounting = (m_generator() % 2 == 0);
+        vector<FuzzOperation> stream;
+        for (int i = 0; i < FUZZOPS; i++){
+            FuzzOperation operation;
+            int kind = m_generator() % 100;
+            operation.id = MINID + m_generator() % range;
+            operation.argument = 0;
+            if (kind < 40){
+                operation.op = FUZZINSERT;
+                operation.argument = (m_generator() % (QUADRUPED + 1)) | ((m_generator() % 2) << 3);
+            }else if (kind < 62){
+                operation.op = FUZZREMOVE;
+            }else if (kind < 88){
+                operation.op = FUZZFIND;
+            }else if (kind < 95){
+                operation.op = FUZZSETSTATE;
+                operation.argument = m_generator() % 2;
+            }else if (kind < 99){
+                operation.op = FUZZSETTYPE;
+                //NONE clears the swarm, so it is picked less often
+                operation.argument = (m_generator() % 10 == 0) ? static_cast<int>(NONE)
+                                                                 : static_cast<int>(BST + m_generator() % (BPTREE - BST + 1));
+            }else if (m_generator() % 2 == 0){
+                operation.op = FUZZASSIGN;
+                operation.argument = (m_generator() % 4 == 0);
+            }else{
+                operation.op = (m_generator() % 2 == 0) ? FUZZCOMPACT : FUZZWEIGHTED;
+            }
+            stream.push_back(operation);
+        }
+        TREETYPE types[] = {BST, AVL, SPLAY, WAVL, BPTREE};
+        for (TREETYPE type : types){
+            if (!runStream(stream, options, type, round)) return false;
+        }
+    }
+    cout << rounds << " rounds, " << m_operations << " operations checked against std::map, no mismatch" << endl;
+    return true;
+}
+
+//Apply a stream to a new swarm of type and to the reference
+bool Fuzzer::runStream(const vector<FuzzOperation>& stream, const FuzzOptions& options, TREETYPE type, int round){
+    Swarm team(type);
+    Model model;
+    team.setCache(options.cacheSlots);
+    team.setLazyDelete(options.lazyDelete, options.tombstoneRatio);
+    team.setConversionBudget(options.conversionBudget);
+    team.setAccessCounting(options.accessCounting);
+    string error;
+    for (int i = 0; i < (int)stream.size(); i++){
+        bool ok = apply(team, model, stream[i], error);
+        if (ok and (i % FUZZCHECK == 0 or i + 1 == (int)stream.size())) ok = check(team, model, error);
+        m_operations++;
+        if (!ok){
+            cout << "MISMATCH seed " << m_seed << " round " << round << " start type " << TYPENAMES[type]
+                 << " operation " << i << " (" << describe(stream[i]) << ") cache " << options.cacheSlots
+                 << " lazy " << options.lazyDelete << " budget " << options.conversionBudget << ": " << error << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+//Apply one operation to the swarm and the reference and compare the results
+bool Fuzzer::apply(Swarm& team, Model& model, const FuzzOperation& operation, string& error){
+    int id = operation.id;
+    auto entry = model.find(id);
+    bool present = (entry != model.end());
+    if (operation.op == FUZZINSERT){
+        ROBOTTYPE robotType = static_cast<ROBOTTYPE>(operation.argument & 7);
+        STATE state = static_cast<STATE>(operation.argument >> 3);
+        //a NONE swarm only takes a robot while it is empty
+        bool expected = !present and (team.getType() != NONE or model.empty());
+        pair<Robot*, bool> result = team.tryInsert(Robot(id, robotType, state));
+        if (result.second != expected){
+            error = "insert reported " + to_string(result.second);
+            return false;
+        }
+        if (expected){
+            model[id] = make_pair(robotType, state);
+        }
+        //a NONE swarm returns no node for a rejected robot, a duplicate included
+        if (expected or (present and team.getType() != NONE)){
+            if (result.first == nullptr or result.first->getID() != id
+                or result.first->getType() != model[id].first or result.first->getState() != model[id].second){
+                error = "insert returned the wrong node";
+                return false;
+            }
+        }
+    }else if (operation.op == FUZZREMOVE){
+        //remove only splays in a SPLAY tree
+        bool removes = (team.getType() != SPLAY);
+        team.remove(id);
+        if (removes and present) model.erase(entry);
+    }else if (operation.op == FUZZFIND){
+        Robot* robot = team.find(id);
+        if ((robot != nullptr) != present){
+            error = present ? "find missed the robot" : "find returned a robot that is not there";
+            return false;
+        }
+        if (present and (robot->getID() != id or robot->getType() != entry->second.first
+                         or robot->getState() != entry->second.second)){
+            error = "find returned the wrong robot";
+            return false;
+        }
+        if (present and team.getType() == SPLAY and team.m_root != robot){
+            error = "find did not splay the robot to the root";
+            return false;
+        }
+    }else if (operation.op == FUZZSETSTATE){
+        STATE state = static_cast<STATE>(operation.argument);
+        if (team.setState(id, state) != present){
+            error = "setState reported the wrong result";
+            return false;
+        }
+        if (present) entry->second.second = state;
+    }else if (operation.op == FUZZSETTYPE){
+        TREETYPE type = static_cast<TREETYPE>(operation.argument);
+        //a change to NONE clears the swarm, setting the type it already has does nothing
+        if (type == NONE and team.getType() != NONE) model.clear();
+        team.setType(type);
+        if (team.getType() != type){
+            error = "setType left the type at " + TYPENAMES[team.getType()];
+            return false;
+        }
+    }else if (operation.op == FUZZWEIGHTED){
+        //the weighted shape is only kept by a BST
+        bool none = (team.getType() == NONE);
+        team.rebuildWeighted();
+        if (team.getType() != (none ? NONE : BST)){
+            error = "rebuildWeighted left the type at " + TYPENAMES[team.getType()];
+            return false;
+        }
+    }else if (operation.op == FUZZCOMPACT){
+        team.compact();
+        MemoryUsage usage = team.memoryUsage();
+        if (usage.fragmentation != 0 or usage.blocks > 1){
+            error = "compact left free slots";
+            return false;
+        }
+    }else{
+        if (operation.argument == 1){
+            Swarm& self = team;
+            team = self;
+        }else{
+            Swarm copy(BST);
+            copy = team;
+            if (copy.getType() != team.getType() or !check(copy, model, error)){
+                error = "copy: " + error;
+                return false;
+            }
+            team = copy;
+        }
+    }
+    return true;
+}
+
+//Check the structure of the swarm and compare its robots with the reference
+bool Fuzzer::check(Swarm& team, const Model& model, string& error){
+    if (!checkTree(team.m_root, team.getType(), true, error)) return false;
+    if (team.getType() == BPTREE and (team.m_root != nullptr or !checkBPlus(team.m_bplus, team.m_count, error))) return false;
+    if (team.getType() != BPTREE and team.m_bplus.m_root != nullptr){
+        error = "B+ nodes left after a change of type";
+        return false;
+    }
+    //the tree an incremental setType migrates from only keeps the BST order
+    if (!checkTree(team.m_convertOld, BST, false, error)){
+        error = "unmigrated tree: " + error;
+        return false;
+    }
+    if (team.size() != (int)model.size()){
+        error = "size " + to_string(team.size()) + " expected " + to_string(model.size());
+        return false;
+    }
+    vector<Robot*> robots;
+    team.findRange(MINID, MAXID, robots);
+    if (robots.size() != model.size()){
+        error = "findRange returned " + to_string(robots.size()) + " robots";
+        return false;
+    }
+    int i = 0;
+    for (auto& entry : model){
+        Robot* robot = robots[i++];
+        if (robot->getID() != entry.first or robot->getType() != entry.second.first
+            or robot->getState() != entry.second.second){
+            error = "robot " + to_string(entry.first) + " differs";
+            return false;
+        }
+    }
+    return true;
+}
+
+//Check the BST order and, if heights is true, the heights, balance or ranks of every node
+bool Fuzzer::checkTree(Robot* root, TREETYPE type, bool heights, string& error){
+    //every node is checked against the id bounds its ancestors set
+    struct Frame{
+        Robot* robot;
+        long long low;
+        long long high;
+    };
+    vector<Frame> stack;
+    if (root != nullptr) stack.push_back({root, (long long)MINID - 1, (long long)MAXID + 1});
+    while (!stack.empty()){
+        Frame frame = stack.back();
+        stack.pop_back();
+        Robot* robot = frame.robot;
+        if (robot->getID() <= frame.low or robot->getID() >= frame.high){
+            error = "BST order broken at " + to_string(robot->getID());
+            return false;
+        }
+        if (heights){
+            int left = (robot->getLeft() == nullptr) ? -1 : robot->getLeft()->getHeight();
+            int right = (robot->getRight() == nullptr) ? -1 : robot->getRight()->getHeight();
+            int height = robot->getHeight();
+            if (type == WAVL){
+                //children are one or two ranks lower and a leaf has rank 0
+                if (height - left < 1 or height - left > 2 or height - right < 1 or height - right > 2
+                    or (left == -1 and right == -1 and height != 0)){
+                    error = "rank rule broken at " + to_string(robot->getID());
+                    return false;
+                }
+            }else if (height != 1 + max(left, right)){
+                error = "height of " + to_string(robot->getID()) + " is " + to_string(height)
+                        + " expected " + to_string(1 + max(left, right));
+                return false;
+            }else if (type == AVL and abs(left - right) > 1){
+                error = "AVL balance broken at " + to_string(robot->getID());
+                return false;
+            }
+        }
+        if (robot->getLeft() != nullptr) stack.push_back({robot->getLeft(), frame.low, robot->getID()});
+        if (robot->getRight() != nullptr) stack.push_back({robot->getRight(), robot->getID(), frame.high});
+    }
+    return true;
+}
+
+//Check a B+ tree: every node but the root half full, sorted ids, the id of a child
+//is its largest id, all leaves at the height and the leaf chain in id order
+bool Fuzzer::checkBPlus(const BPlusTree& tree, int count, string& error){
+    struct Frame{
+        const BPlusTree::Node* node;
+        int depth;
+    };
+    vector<Frame> stack;
+    vector<const BPlusTree::Node*> leaves;
+    if (tree.m_root != nullptr) stack.push_back({tree.m_root, 0});
+    else if (tree.m_height != -1 or count != 0){
+        error = "empty B+ tree with height " + to_string(tree.m_height) + " and " + to_string(count) + " robots";
+        return false;
+    }
+    while (!stack.empty()){
+        Frame frame = stack.back();
+        stack.pop_back();
+        const BPlusTree::Node* node = frame.node;
+        int minimum = (node == tree.m_root) ? (node->m_leaf ? 1 : 2) : BTREEKEYS / 2;
+        if (node->m_count < minimum or node->m_count > BTREEKEYS){
+            error = "B+ node with " + to_string(node->m_count) + " ids";
+            return false;
+        }
+        for (int i = 0; i < BTREEKEYS; i++){
+            if ((i > 0 and i < node->m_count and node->m_ids[i - 1] >= node->m_ids[i])
+                or (i >= node->m_count and node->m_ids[i] != INT_MAX)){
+                error = "B+ node ids out of order at " + to_string(node->m_ids[0]);
+                return false;
+            }
+        }
+        if (node->m_leaf){
+            if (frame.depth != tree.m_height){
+                error = "B+ leaf at depth " + to_string(frame.depth);
+                return false;
+            }
+            leaves.push_back(node);
+            continue;
+        }
+        //right first so that the leaves are reached in id order
+        for (int i = node->m_count - 1; i >= 0; i--){
+            const BPlusTree::Node* child = node->m_children[i];
+            if (child->m_count == 0 or child->m_ids[child->m_count - 1] != node->m_ids[i]){
+                error = "B+ separator " + to_string(node->m_ids[i]) + " is not the largest id of its child";
+                return false;
+            }
+            stack.push_back({child, frame.depth + 1});
+        }
+    }
+    int robots = 0;
+    for (size_t i = 0; i < leaves.size(); i++){
+        const BPlusTree::Node* next = (i + 1 < leaves.size()) ? leaves[i + 1] : nullptr;
+        if (leaves[i]->m_next != next or (next != nullptr and next->m_ids[0] <= leaves[i]->m_ids[leaves[i]->m_count - 1])){
+            error = "B+ leaf chain broken after " + to_string(leaves[i]->m_ids[0]);
+            return false;
+        }
+        for (int j = 0; j < leaves[i]->m_count; j++){
+            if (leaves[i]->m_robots[j]->getID() != leaves[i]->m_ids[j]){
+                error = "B+ leaf id " + to_string(leaves[i]->m_ids[j]) + " holds another robot";
+                return false;
+            }
+        }
+        robots += leaves[i]->m_count;
+    }
+    if (robots != count){
+        error = "B+ leaves hold " + to_string(robots) + " robots, the swarm has " + to_string(count);
+        return false;
+    }
+    return true;
+}
+
+//Text of an operation for a failure report
+string Fuzzer::describe(const FuzzOperation& operation){
+    const char* names[] = {"insert", "remove", "find", "setState", "setType", "assign", "compact", "rebuildWeighted"};
+    ostringstream text;
+    text << names[operation.op] << " " << operation.id;
+    if (operation.op == FUZZSETTYPE) text << " " << TYPENAMES[operation.argument];
+    else if (operation.op != FUZZREMOVE and operation.op != FUZZFIND and operation.op < FUZZCOMPACT) text << " " << operation.argument;
+    return text.str();
+}
+
+/*
+Times one stream of SPEEDOPS finds, inserts and removes (half, a quarter and a
+quarter) over SPEEDKEYS ids on every tree type and on std::map, starting from
+half of the ids. Remove only splays in a SPLAY tree, so that tree keeps growing.
+*/
+void Fuzzer::compareSpeed(){
+    vector<FuzzOperation> stream;
+    for (int i = 0; i < SPEEDOPS; i++){
+        int kind = m_generator() % 4;
+        FuzzOperation operation;
+        operation.op = (kind < 2) ? FUZZFIND : (kind == 2) ? FUZZINSERT : FUZZREMOVE;
+        operation.id = MINID + m_generator() % SPEEDKEYS;
+        operation.argument = 0;
+        stream.push_back(operation);
+    }
+    //every other id, in a random order that depends on the seed
+    Random idGen(0, SPEEDKEYS / 2 - 1, SHUFFLE);
+    idGen.setSeed(m_seed);
+    vector<int> initial;
+    idGen.getShuffle(initial);
+    for (int& id : initial) id = MINID + id * 2;
+
+    cout << "\nThroughput of " << SPEEDOPS << " mixed operations over " << SPEEDKEYS << " ids:\n";
+    Model reference;
+    for (int id : initial) reference[id] = make_pair(DRONE, ALIVE);
+    long long found = 0;
+    auto start = chrono::steady_clock::now();
+    for (const FuzzOperation& operation : stream){
+        if (operation.op == FUZZFIND) found += (reference.find(operation.id) != reference.end());
+        else if (operation.op == FUZZINSERT) reference.emplace(operation.id, make_pair(DRONE, ALIVE));
+        else reference.erase(operation.id);
+    }
+    double mapSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "\tstd::map\tops/s: " << (long long)(SPEEDOPS / mapSeconds) << "\tfound: " << found << endl;
+
+    TREETYPE types[] = {BST, AVL, SPLAY, WAVL, BPTREE};
+    for (TREETYPE type : types){
+        Swarm team(type);
+        for (int id : initial) team.insert(Robot(id));
+        found = 0;
+        start = chrono::steady_clock::now();
+        for (const FuzzOperation& operation : stream){
+            if (operation.op == FUZZFIND) found += (team.find(operation.id) != nullptr);
+            else if (operation.op == FUZZINSERT) team.emplace(operation.id);
+            else team.remove(operation.id);
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "\t" << TYPENAMES[type] << "\t\tops/s: " << (long long)(SPEEDOPS / seconds)
+             << "\tfound: " << found << "\tvs std::map: " << mapSeconds / seconds << "x" << endl;
+    }
+}
+
+/*
+Usage: ./fuzz [seed] [rounds] [--no-speed]
+Runs the differential fuzzer and then the throughput comparison. Exits with 1 at
+the first mismatch, which is reproduced by running again with the printed seed.
+*/
+int main(int argc, char* argv[]){
+    unsigned int seed = 1;
+    int rounds = FUZZROUNDS;
+    bool speed = true;
+    int position = 0;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--no-speed") == 0) speed = false;
+        else if (position == 0 and isdigit(argv[i][0])){
+            seed = strtoul(argv[i], nullptr, 10);
+            position++;
+        }else if (position == 1 and isdigit(argv[i][0])){
+            rounds = atoi(argv[i]);
+            position++;
+        }else{
+            cout << "Usage: " << argv[0] << " [seed] [rounds] [--no-speed]" << endl;
+            return 1;
+        }
+    }
+    Fuzzer fuzzer(seed);
+    if (!fuzzer.run(rounds)) return 1;
+    if (speed) fuzzer.compareSpeed();
+    return 0;
+}
@@ -1,137 +1,19 @@
 #include "swarm.h"
+#include "basicswarm.h"
+#include "swarmservice.h"
+#include "random.h"
 #include <math.h>
 #include <algorithm>
 #include <random>
 #include <vector>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <cstdio>
+#include <climits>
+#include <memory>
 using namespace std;
 
-enum RANDOM {UNIFORMINT, UNIFORMREAL, NORMAL, SHUFFLE};
-class Random {
-public:
-    Random(){}
-    Random(int min, int max, RANDOM type=UNIFORMINT, int mean=50, int stdev=20) : m_min(min), m_max(max), m_type(type)
-    {
-        if (type == NORMAL){
-            //the case of NORMAL to generate integer numbers with normal distribution
-            m_generator = std::mt19937(m_device());
-            //the data set will have the mean of 50 (default) and standard deviation of 20 (default)
-            //the mean and standard deviation can change by passing new values to constructor 
-            m_normdist = std::normal_distribution<>(mean,stdev);
-        }
-        else if (type == UNIFORMINT) {
-            //the case of UNIFORMINT to generate integer numbers
-            // Using a fixed seed value generates always the same sequence
-            // of pseudorandom numbers, e.g. reproducing scientific experiments
-            // here it helps us with testing since the same sequence repeats
-            m_generator = std::mt19937(10);// 10 is the fixed seed value
-            m_unidist = std::uniform_int_distribution<>(min,max);
-        }
-        else if (type == UNIFORMREAL) { //the case of UNIFORMREAL to generate real numbers
-            m_generator = std::mt19937(10);// 10 is the fixed seed value
-            m_uniReal = std::uniform_real_distribution<double>((double)min,(double)max);
-        }
-        else { //the case of SHUFFLE to generate every number only once
-            m_generator = std::mt19937(m_device());
-        }
-    }
-    void setSeed(int seedNum){
-        // we have set a default value for seed in constructor
-        // we can change the seed by calling this function after constructor call
-        // this gives us more randomness
-        m_generator = std::mt19937(seedNum);
-    }
-    void init(int min, int max){
-        m_min = min;
-        m_max = max;
-        m_type = UNIFORMINT;
-        m_generator = std::mt19937(10);// 10 is the fixed seed value
-        m_unidist = std::uniform_int_distribution<>(min,max);
-    }
-    void getShuffle(vector<int> & array){
-        // this function provides a list of all values between min and max
-        // in a random order, this function guarantees the uniqueness
-        // of every value in the list
-        // the user program creates the vector param and passes here
-        // here we populate the vector using m_min and m_max
-        for (int i = m_min; i<=m_max; i++){
-            array.push_back(i);
-        }
-        shuffle(array.begin(),array.end(),m_generator);
-    }
-
-    void getShuffle(int array[]){
-        // this function provides a list of all values between min and max
-        // in a random order, this function guarantees the uniqueness
-        // of every value in the list
-        // the param array must be of the size (m_max-m_min+1)
-        // the user program creates the array and pass it here
-        vector<int> temp;
-        for (int i = m_min; i<=m_max; i++){
-            temp.push_back(i);
-        }
-        std::shuffle(temp.begin(), temp.end(), m_generator);
-        vector<int>::iterator it;
-        int i = 0;
-        for (it=temp.begin(); it != temp.end(); it++){
-            array[i] = *it;
-            i++;
-        }
-    }
-
-    int getRandNum(){
-        // this function returns integer numbers
-        // the object must have been initialized to generate integers
-        int result = 0;
-        if(m_type == NORMAL){
-            //returns a random number in a set with normal distribution
-            //we limit random numbers by the min and max values
-            result = m_min - 1;
-            while(result < m_min || result > m_max)
-                result = m_normdist(m_generator);
-        }
-        else if (m_type == UNIFORMINT){
-            //this will generate a random number between min and max values
-            result = m_unidist(m_generator);
-        }
-        return result;
-    }
-
-    double getRealRandNum(){
-        // this function returns real numbers
-        // the object must have been initialized to generate real numbers
-        double result = m_uniReal(m_generator);
-        // a trick to return numbers only with two deciaml points
-        // for example if result is 15.0378, function returns 15.03
-        // to round up we can use ceil function instead of floor
-        result = std::floor(result*100.0)/100.0;
-        return result;
-    }
-
-    string getRandString(int size){
-        // the parameter size specifies the length of string we ask for
-        // to use ASCII char the number range in constructor must be set to 97 - 122
-        // and the Random type must be UNIFORMINT (it is default in constructor)
-        string output = "";
-        for (int i=0;i<size;i++){
-            output = output + (char)getRandNum();
-        }
-        return output;
-    }
-    
-    int getMin(){return m_min;}
-    int getMax(){return m_max;}
-    private:
-    int m_min;
-    int m_max;
-    RANDOM m_type;
-    std::random_device m_device;
-    std::mt19937 m_generator;
-    std::normal_distribution<> m_normdist;//normal distribution
-    std::uniform_int_distribution<> m_unidist;//integer uniform distribution
-    std::uniform_real_distribution<double> m_uniReal;//real uniform distribution
-
-};
-
 class Tester{
 public:
     bool testAVLAfterInsertionsNormalCase(); //Test whether the AVL tree is balanced after a decent number of insertions, e.g. 300 insertions. (Note: this requires visiting all nodes and checking the height values are correct.)
@@ -148,14 +30,51 @@ public:
     bool testRemoveFromBSTNormalCase(); //Test the remove function for a normal case in the BST tree. Trying to remove a node from a tree results in a tree without the node.
     bool testRemoveFromBSTEdgeCase(); //Test the remove function for an edge case in the BST tree. In this case the tree has only one node and we remove the node.   
     
-    bool testAssignOpNormalCase(); //Test the assignment operator for a normal case.
+    bool testAssignOpNormalCase(); //Test the assignment operator for a normal case, the copy also takes the settings of the rhs.
     bool testAssignOpErrorCase(); //Test the assignment operator for an error case, e.g. assigning an empty object to an empty object.       
+
+    bool testBuildFromNormalCase(); //Test bulk construction from an unsorted list with duplicate ids. The result must hold every id once, preserve the BST property and have the minimum possible height.
+    bool testParallelReduceNormalCase(); //Test that a parallel reduction visits every robot exactly once, e.g. the count and the sum of ids match a serial count, and a bool reduction over BPTREE leaves is race free.
+    bool testFreezeNormalCase(); //Test lookups in a frozen swarm find every id and no missing id, and that a modification thaws the swarm.
+    bool testFreezeBTreeNormalCase(); //Test lookups and range queries in a swarm frozen with the B+ tree layout against the same queries on the tree.
+    bool testFindBatchNormalCase(); //Test that a batched lookup returns the same robots as single lookups for every tree type and frozen layout, including missing ids.
+    bool testStatsNormalCase(); //Test the tree shape reported by stats(), and the rotation counters in a build with -DSWARM_STATS.
+    bool testTraceNormalCase(); //Test the trace export and latency histogram after multiple operations, events are only expected in a build with -DSWARM_TRACE.
+    bool testSaveLoadNormalCase(); //Test that loading a saved image restores the tree type, shape, heights and robot data for AVL and splay trees.
+    bool testSaveLoadErrorCase(); //Test loading a missing file and a truncated image, the swarm must be left empty.
+    bool testAVLRemoveStressNormalCase(); //Test that an AVL tree stays balanced, with correct heights and contents, after many random inserts and removes of nodes with two children.
+    bool testWAVLNormalCase(); //Test the rank rule and height bound of a WAVL tree after random inserts and removes, and conversions to and from AVL and BST.
+    bool testAdaptiveNormalCase(); //Test that the adaptive mode rebuilds a degenerate BST as AVL, keeps AVL for uniform lookups, moves a single hot robot into a SPLAY tree and goes back to AVL for a remove.
+    bool testCacheNormalCase(); //Test hits and misses of the hot-id cache and that remove, clear, setType(NONE) and the assignment operator leave no stale robot in it.
+    bool testLazyDeleteNormalCase(); //Test that tombstoned robots are skipped by every lookup, revived by an insert, kept by save and load and reclaimed once the threshold is crossed.
+    bool testIncrementalConvertNormalCase(); //Test that an incremental setType answers every operation from both trees, is saved as a converted tree and ends in a valid AVL and WAVL tree.
+    bool testMemoryNormalCase(); //Test the memory report after inserts and removes, that compact leaves one dense block in id order, and that inserts beyond the memory budget are rejected.
+    bool testWeightedRebuildNormalCase(); //Test that rebuildWeighted puts the most accessed robot at the root, keeps every robot and lowers the depth of the counted finds below the AVL tree.
+    bool testSwarmServiceNormalCase(); //Test that commands queued by several threads all complete with the results of direct calls, and that a snapshot holds every command queued before it and does not change afterwards.
+    bool testSpatialNormalCase(); //Test k-nearest and radius queries with type and state filters against a scan of all positions, after moves, removes, lazy removes, compact, a copy and a new cell size, and a position for an id outside MINID - MAXID.
+    bool testBPlusTreeNormalCase(); //Test a BPTREE against a list of the present ids after random inserts and removes, batches, conversions to and from AVL, a copy, save and load and the parallel walks.
+    bool testEmplaceNormalCase(); //Test that emplace and tryInsert report duplicates, keep the robot already stored and take no node from the pool for them.
+    bool testLogReplayNormalCase(); //Test that recovering from the log, and from an image and log after a compaction, restores the robots, their states and the tree type.
+    bool testLogReplayErrorCase(); //Test replaying a log with a torn last record, a corrupt record and a bad header.
+    bool testBasicSwarmNormalCase(); //Test inserts, removes and lookups of BasicSwarm for every policy against a list of the ids that should be present, and the layout fields.
+    bool testBasicTreeNormalCase(); //Test a BasicTree with string keys in descending order and a move-only payload built in place by emplace.
+    bool testDumpNormalCase(); //Test the dump formats, the depth limit and truncation of the buffer variant on a small known tree.
+    bool testSplayAfterFindNormalCase(); //Test that find in a splay tree brings the node to the root without losing nodes, e.g. finding ids in a zig-zag position.
+    bool testAVLRotationsNormalCase(); //Test the four AVL rotation cases (left-left, left-right, right-right and right-left) on three robots, each must end with the middle id at the root.
+    bool testSetTypeAVLNormalCase(); //Test that setType(AVL) inserts the nodes of a BST into the new tree in id order, e.g. the tree the driver prints after its conversion.
+    bool testSetTypeAVLEdgeCase(); //Test that a BST converted with setType(AVL) reports AVL and keeps balancing later inserts and removes, e.g. ascending ids that would make a BST a chain.
+    bool testSplayOrderNormalCase(); //Test the exact tree after splaying a node in a zig-zag, a zag-zig and a zig-zig-zig position, e.g. a node at depth 3 first rotates over its parent.
 private:
     bool isValidBalance(Swarm& swarm, Robot* node);
     bool isValidBST(Robot* robot, Robot* left, Robot* right);
     bool find(Robot* robot, int id);
+    bool isSameTree(Robot* first, Robot* second);
     bool isValidHeight(Robot * robot);
-    string dumpTreeIntoString(Robot* aBot) const;
+    bool isValidRank(Swarm& swarm, Robot* robot);
+    string dumpTreeIntoString(const Swarm& swarm) const;
+    string robotsIntoString(const Swarm& swarm) const;
+    template <class Tree>
+    bool isSameAsPresent(Tree& tree, Random& idGen, int operations);
 };
 
 int main(){
@@ -232,6 +151,195 @@ int main(){
     }else{
         cout << "\tCase failed" << endl;
     }
+
+    cout << "Testing bulk construction NORMAL case from an unsorted list:" << endl;
+    if (t.testBuildFromNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+
+    cout << "Testing parallel reduction NORMAL case using a BST tree:" << endl;
+    if (t.testParallelReduceNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+
+    cout << "Testing lookups NORMAL case in a frozen AVL tree:" << endl;
+    if (t.testFreezeNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing lookups and range queries NORMAL case in a B+ tree frozen swarm:" << endl;
+    if (t.testFreezeBTreeNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing batched lookups NORMAL case for all tree types and layouts:" << endl;
+    if (t.testFindBatchNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing statistics NORMAL case after multiple insertions:" << endl;
+    if (t.testStatsNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing tracing NORMAL case after multiple operations:" << endl;
+    if (t.testTraceNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing save and load NORMAL case for AVL and splay trees:" << endl;
+    if (t.testSaveLoadNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing save and load ERROR case with a missing and a truncated file:" << endl;
+    if (t.testSaveLoadErrorCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing AVL remove stress NORMAL case with random inserts and removes:" << endl;
+    if (t.testAVLRemoveStressNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing WAVL NORMAL case after random inserts, removes and type changes:" << endl;
+    if (t.testWAVLNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing adaptive mode NORMAL case with sequential inserts, uniform and hot lookups:" << endl;
+    if (t.testAdaptiveNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing hot-id cache NORMAL case with removes, clear and assignment:" << endl;
+    if (t.testCacheNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing lazy delete NORMAL case with tombstones and a compaction:" << endl;
+    if (t.testLazyDeleteNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing incremental setType NORMAL case with operations during the conversion:" << endl;
+    if (t.testIncrementalConvertNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing memory accounting NORMAL case with compact and a budget:" << endl;
+    if (t.testMemoryNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing weighted rebuild NORMAL case with skewed lookups:" << endl;
+    if (t.testWeightedRebuildNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing swarm service NORMAL case with four producer threads:" << endl;
+    if (t.testSwarmServiceNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing spatial index NORMAL case with filtered nearest and radius queries:" << endl;
+    if (t.testSpatialNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing B+ tree NORMAL case after random inserts, removes and conversions:" << endl;
+    if (t.testBPlusTreeNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing emplace NORMAL case with duplicate ids for every tree type:" << endl;
+    if (t.testEmplaceNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing log replay NORMAL case with a compaction:" << endl;
+    if (t.testLogReplayNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing log replay ERROR case with torn and corrupt records:" << endl;
+    if (t.testLogReplayErrorCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing BasicSwarm NORMAL case for the BST, AVL and splay policies:" << endl;
+    if (t.testBasicSwarmNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing BasicTree NORMAL case with string keys and a move-only payload:" << endl;
+    if (t.testBasicTreeNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing dump NORMAL case in text, JSON and DOT formats:" << endl;
+    if (t.testDumpNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing Splaying NORMAL case after multiple lookups:" << endl;
+    if (t.testSplayAfterFindNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing AVL rotations NORMAL case for the four imbalance cases:" << endl;
+    if (t.testAVLRotationsNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing Splaying NORMAL case for the zig-zag, zag-zig and zig-zig-zig orders:" << endl;
+    if (t.testSplayOrderNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing setType NORMAL case converting a BST to AVL:" << endl;
+    if (t.testSetTypeAVLNormalCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
+    cout << "Testing setType EDGE case inserting and removing after a conversion to AVL:" << endl;
+    if (t.testSetTypeAVLEdgeCase()){
+        cout << "\t- Case passed!" << endl;
+    }else{
+        cout << "\tCase failed" << endl;
+    }
 }
 
 //Test whether the AVL tree is balanced after a decent number of insertions, e.g. 300 insertions. (Note: this requires visiting all nodes and checking the height values are correct.)
@@ -417,12 +525,26 @@ bool Tester::testAssignOpNormalCase() {
     RHS.insert(robot);                  
     Swarm LHS(BST); // left hand side of assignment operator
     LHS = RHS;
-    string RHSDump = dumpTreeIntoString(RHS.m_root);
-    string LHSDump = dumpTreeIntoString(LHS.m_root);
-    if (RHSDump.compare(LHSDump) == 0) {
-        return true;
+    string RHSDump = dumpTreeIntoString(RHS);
+    string LHSDump = dumpTreeIntoString(LHS);
+    if (RHSDump.compare(LHSDump) != 0) {
+        return false;
     }
-    return false;
+    //the settings of the rhs come along, the spatial index of the old lhs does not
+    Swarm settings(AVL);
+    settings.setMemoryBudget(1 << 20);
+    settings.setCache(64);
+    settings.setLazyDelete(true, 0.9);
+    settings.setAdaptive(true);
+    settings.insert(Robot(MINID, BIRD));
+    settings.insert(Robot(MINID + 1, BIRD));
+    Swarm copy(BST);
+    copy.setSpatialIndex(true, 5);
+    copy = settings;
+    copy.remove(MINID);
+    return (copy.cacheStats().slots == 64 and copy.isAdaptive() and copy.m_memoryBudget == 1 << 20
+            and copy.size() == 1 and find(copy.m_root, MINID)
+            and !copy.setPosition(MINID + 1, Position()));
 }
 
 //Test the assignment operator for an error case, e.g. assigning an empty object to an empty object.    
@@ -430,8 +552,8 @@ bool Tester::testAssignOpErrorCase() {
     Swarm empty1;
     Swarm empty2;
     empty2 = empty1;
-    string empty1Dump = dumpTreeIntoString(empty1.m_root);
-    string empty2Dump = dumpTreeIntoString(empty2.m_root);
+    string empty1Dump = dumpTreeIntoString(empty1);
+    string empty2Dump = dumpTreeIntoString(empty2);
     if (empty1Dump.length() == 0 and empty2Dump.length() == 0) {
         return true;
     }
@@ -439,90 +561,1502 @@ bool Tester::testAssignOpErrorCase() {
     
 }
 
-//////*PRIVATE FUNCTIONS BELOW*//////
-
-//Test whether the tree is balanced
-bool Tester::isValidBalance(Swarm& swarm, Robot* node) {
-    if (node == nullptr) {
-        return true;
+//Test bulk construction from an unsorted list with duplicate ids. The result must hold every id once, preserve the BST property and have the minimum possible height.
+bool Tester::testBuildFromNormalCase() {
+    Random idGen(MINID, MINID + 9999, SHUFFLE);
+    vector<int> ids;
+    idGen.getShuffle(ids);
+    vector<Robot> robots;
+    for (int id : ids) {
+        robots.push_back(Robot(id, BIRD));
     }
-    int balance = swarm.getBalance(node);
-    if (balance < -1 and balance > 1) {
+    //duplicates must be dropped, the first robot with an id wins
+    robots.push_back(Robot(MINID, SUB));
+    Swarm team;
+    team.buildFrom(robots, AVL);
+    if (team.getType() != AVL or !isValidBST(team.m_root, nullptr, nullptr)) {
         return false;
     }
-    if (isValidBalance(swarm, node->getLeft())
-        and isValidBalance(swarm, node->getRight())) {
-        return true;
+    for (int id : ids) {
+        if (!find(team.m_root, id)) {
+            return false;
+        }
     }
-    return false;
+    //10000 nodes fit in a complete tree of height 13
+    if (team.m_root->getHeight() != 13 or !isValidBalance(team, team.m_root)) {
+        return false;
+    }
+    //inserting after the bulk build must still work
+    team.insert(Robot(MAXID, DRONE));
+    return find(team.m_root, MAXID);
 }
 
-bool Tester::isValidBST(Robot* robot, Robot* left, Robot* right) {
-    if (robot == nullptr) {
-        return true;
+//Test that a parallel reduction visits every robot exactly once, e.g. the count and the sum of ids match a serial count, and a bool reduction over BPTREE leaves is race free.
+bool Tester::testParallelReduceNormalCase() {
+    Random typeGen(0,4);
+    Swarm team(BST);
+    long long idSum = 0;
+    for (int i = 0; i < 300; i++) {
+        Robot robot((i * 7919) % 300, static_cast<ROBOTTYPE>(typeGen.getRandNum()));
+        team.insert(robot);
+        idSum += robot.getID();
     }
-    if (left != nullptr and robot->getID() <= left->getID()
-        and right != nullptr and robot->getID() >= right->getID()) 
-    {
+    //force forking on several levels even on a single core machine
+    int count = team.parallelReduce(0, [](int& result, const Robot&) { result++; },
+                                    [](int& result, const int& other) { result += other; }, 8);
+    long long sum = team.parallelReduce(0LL, [](long long& result, const Robot& robot) { result += robot.getID(); },
+                                        [](long long& result, const long long& other) { result += other; }, 8);
+    Swarm empty;
+    int emptyCount = empty.parallelReduce(0, [](int& result, const Robot&) { result++; },
+                                          [](int& result, const int& other) { result += other; });
+    //a BPTREE is split into runs whose bool results sit next to each other
+    Swarm leaves(BPTREE);
+    for (int i = 0; i < 2 * PARALLELCUTOFF; i++) {
+        leaves.insert(Robot(MINID + i, DRONE, (i == PARALLELCUTOFF + 1) ? DEAD : ALIVE));
+    }
+    auto allAlive = [&leaves]() {
+        return leaves.parallelReduce(true, [](bool& result, const Robot& robot) { result = result and robot.getState() == ALIVE; },
+                                     [](bool& result, const bool& other) { result = result and other; }, 8);
+    };
+    bool someDead = !allAlive();
+    leaves.setState(MINID + PARALLELCUTOFF + 1, ALIVE);
+    return (count == 300 and sum == idSum and emptyCount == 0 and someDead and allAlive());
+}
+
+//Test lookups in a frozen swarm find every id and no missing id, and that a modification thaws the swarm.
+bool Tester::testFreezeNormalCase() {
+    Random typeGen(0,4);
+    Swarm team(AVL);
+    for (int i = 0; i < 300; i++) {
+        //even ids only, so every odd id is a missing id
+        Robot robot(((i * 7919) % 300) * 2, static_cast<ROBOTTYPE>(typeGen.getRandNum()));
+        team.insert(robot);
+    }
+    team.freeze();
+    if (!team.isFrozen()) {
         return false;
     }
-    return (isValidBST(robot->getLeft(), left, right) 
-            and isValidBST(robot->getRight(), robot, right));
+    for (int i = -1; i <= 600; i++) {
+        Robot* robot = team.find(i);
+        if (i % 2 == 0 and i >= 0 and i < 600) {
+            if (robot == nullptr or robot->getID() != i) {
+                return false;
+            }
+        }else if (robot != nullptr) {
+            return false;
+        }
+    }
+    team.insert(Robot(601, BIRD));
+    return (!team.isFrozen() and team.find(601) != nullptr and team.find(598) != nullptr);
 }
 
-bool Tester::find(Robot* robot, int id) {
-    if (robot == nullptr) {
+//Test lookups and range queries in a swarm frozen with the B+ tree layout against the same queries on the tree.
+bool Tester::testFreezeBTreeNormalCase() {
+    //sizes around whole B+ tree nodes and levels
+    int sizes[] = {0, 1, 15, 16, 17, 256, 257, 1000};
+    for (int size : sizes) {
+        Swarm team(AVL);
+        for (int i = 0; i < size; i++) {
+            team.insert(Robot(((i * 7919) % size) * 2, BIRD));
+        }
+        vector<Robot*> expected;
+        team.findRange(100, 300, expected);
+        team.freeze(BTREE);
+        for (int i = -1; i <= 2 * size; i++) {
+            Robot* robot = team.find(i);
+            bool present = (i % 2 == 0 and i >= 0 and i < 2 * size);
+            if ((robot != nullptr) != present or (present and robot->getID() != i)) {
+                return false;
+            }
+        }
+        vector<Robot*> frozenRange;
+        team.findRange(100, 300, frozenRange);
+        if (frozenRange != expected) {
+            return false;
+        }
+        if (size > 200 and (int)expected.size() != 101) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Test that a batched lookup returns the same robots as single lookups for every tree type and frozen layout, including missing ids.
+bool Tester::testFindBatchNormalCase() {
+    TREETYPE types[] = {BST, AVL, SPLAY, AVL, AVL};
+    //37 ids, so the last group of the batch is not full
+    vector<int> ids;
+    for (int i = 0; i < 37; i++) {
+        ids.push_back((i * 53) % 700);
+    }
+    for (int mode = 0; mode < 5; mode++) {
+        Swarm team(types[mode]);
+        for (int i = 0; i < 300; i++) {
+            team.insert(Robot(((i * 7919) % 300) * 2, BIRD));
+        }
+        if (mode == 3) {
+            team.freeze(EYTZINGER);
+        }else if (mode == 4) {
+            team.freeze(BTREE);
+        }
+        vector<Robot*> batch(ids.size());
+        team.findBatch(ids.data(), ids.size(), batch.data());
+        for (size_t i = 0; i < ids.size(); i++) {
+            if (batch[i] != team.find(ids[i])) {
+                return false;
+            }
+            if ((batch[i] != nullptr) != (ids[i] % 2 == 0 and ids[i] < 600)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//Test the tree shape reported by stats(), and the rotation counters in a build with -DSWARM_STATS.
+bool Tester::testStatsNormalCase() {
+    Swarm empty(AVL);
+    SwarmStats emptyStats = empty.stats();
+    if (emptyStats.nodeCount != 0 or emptyStats.height != -1 or emptyStats.maxDepth != -1) {
         return false;
     }
-    if (robot->getID()== id) {
-        return true;
+    //ids 1 to 7 in increasing order give a perfect AVL tree of height 2 after 4 left rotations
+    Swarm team(AVL);
+    for (int i = 1; i <= 7; i++) {
+        team.insert(Robot(i, BIRD));
     }
-    if (robot->getID() < id) {
-        return find(robot->getRight(), id);
-    }else {
-        return find(robot->getLeft(), id);
+    SwarmStats stats = team.stats();
+    if (stats.nodeCount != 7 or stats.height != 2 or stats.maxDepth != 2) {
+        return false;
+    }
+    //depths 0 + 1 + 1 + 2 + 2 + 2 + 2
+    if (stats.averageDepth != 10.0 / 7) {
+        return false;
     }
+#ifdef SWARM_STATS
+    if (stats.leftRotations != 4 or stats.rightRotations != 0 or stats.rebalances != 4) {
+        return false;
+    }
+    team.resetStats();
+    if (team.stats().leftRotations != 0) {
+        return false;
+    }
+#endif
+    return true;
 }
 
-bool Tester::isValidHeight(Robot * robot) {
-    if (robot == nullptr) {
-        return true;
+//Test the trace export and latency histogram after multiple operations, events are only expected in a build with -DSWARM_TRACE.
+bool Tester::testTraceNormalCase() {
+    Swarm team(BST);
+    for (int i = 0; i < 10; i++) {
+        team.insert(Robot(i, BIRD));
     }
-    int leftHeight = 0;
-    Robot * left = robot->getLeft();
-    if (left != nullptr) {
-        leftHeight = left->getHeight();
+    team.remove(5);
+    team.setType(AVL);
+    ostringstream json;
+    team.writeTraceJSON(json);
+    long long inserts = 0;
+    for (long long count : team.latencyHistogram(TRACEINSERT)) {
+        inserts += count;
     }
-    int rightHeight = 0;
-    Robot * right = robot->getRight();
-    if (right != nullptr) {
-        rightHeight = right->getHeight();
+    long long removes = 0;
+    for (long long count : team.latencyHistogram(TRACEREMOVE)) {
+        removes += count;
     }
+#ifdef SWARM_TRACE
+    //the start times are written in full, they increase from one event to the next
+    vector<double> starts;
+    string text = json.str();
+    for (size_t at = text.find("\"ts\":"); at != string::npos; at = text.find("\"ts\":", at + 1)) {
+        size_t end = text.find(',', at);
+        string ts = text.substr(at + 5, end - at - 5);
+        if (ts.find('e') != string::npos or ts.find('.') == string::npos) {
+            return false;
+        }
+        starts.push_back(stod(ts));
+    }
+    if (starts.size() != 12 or starts.front() >= starts.back()) {
+        return false;
+    }
+    for (size_t i = 1; i < starts.size(); i++) {
+        if (starts[i] < starts[i - 1]) {
+            return false;
+        }
+    }
+    //the stream is left as it was
+    ostringstream plain;
+    team.writeTraceJSON(plain);
+    plain << 0.5;
+    //the last insert left a path of height 9
+    return (inserts == 10 and removes == 1 and plain.str().substr(plain.str().size() - 3) == "0.5"
+            and json.str().find("\"name\":\"setType\"") != string::npos
+            and json.str().find("\"id\":9,\"depth\":9") != string::npos);
+#else
+    return (inserts == 0 and removes == 0 and json.str() == "[\n]\n");
+#endif
+}
 
-    int height = 1;
-    if (leftHeight > rightHeight) {
-        height += leftHeight;
-    }else {
-        height += rightHeight;
+//Test that loading a saved image restores the tree type, shape, heights and robot data for AVL and splay trees.
+bool Tester::testSaveLoadNormalCase() {
+    Random typeGen(0,4);
+    TREETYPE types[] = {AVL, SPLAY};
+    for (TREETYPE type : types) {
+        Swarm team(type);
+        for (int i = 0; i < 300; i++) {
+            Robot robot((i * 7919) % 300, static_cast<ROBOTTYPE>(typeGen.getRandNum()),
+                        static_cast<STATE>(i % 2));
+            team.insert(robot);
+        }
+        Swarm copy(BST);
+        copy.insert(Robot(5000, BIRD));
+        if (!team.save("swarm_test.bin") or !copy.load("swarm_test.bin")) {
+            return false;
+        }
+        if (copy.getType() != type or !isSameTree(team.m_root, copy.m_root)) {
+            return false;
+        }
     }
+    Swarm empty(AVL);
+    Swarm copy(BST);
+    bool result = (empty.save("swarm_test.bin") and copy.load("swarm_test.bin")
+                   and copy.m_root == nullptr and copy.getType() == AVL);
+    remove("swarm_test.bin");
+    return result;
+}
 
-    if (robot->getHeight() == height) {
-        return true;
+//Test loading a missing file and a truncated image, the swarm must be left empty.
+bool Tester::testSaveLoadErrorCase() {
+    Swarm team(BST);
+    for (int i = 0; i < 10; i++) {
+        team.insert(Robot(i, BIRD));
     }
-    return false;
+    if (team.load("swarm_missing.bin") or team.m_root != nullptr) {
+        return false;
+    }
+    for (int i = 0; i < 10; i++) {
+        team.insert(Robot(i, BIRD));
+    }
+    team.save("swarm_test.bin");
+    //drop the last record
+    ifstream in("swarm_test.bin", ios::binary);
+    string image((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    in.close();
+    ofstream out("swarm_test.bin", ios::binary | ios::trunc);
+    out.write(image.data(), image.size() - 9);
+    out.close();
+    Swarm copy(BST);
+    bool result = (!copy.load("swarm_test.bin") and copy.m_root == nullptr);
+    remove("swarm_test.bin");
+    return result;
 }
 
-//dump tree contents to a string for easy comparison
-string Tester::dumpTreeIntoString(Robot* aBot) const{
-    string str;
-    if (aBot != nullptr){
-        str.append( "(" );
-        dumpTreeIntoString(aBot->m_left);//first visit the left child
-        str.append(to_string(aBot->m_id));
-        str.append(":");
-        str.append(to_string(aBot->m_height));//second visit the node itself
-        dumpTreeIntoString(aBot->m_right);//third visit the right child
-        str.append(")");
+//Test that an AVL tree stays balanced, with correct heights and contents, after many random inserts and removes of nodes with two children.
+bool Tester::testAVLRemoveStressNormalCase() {
+    Random idGen(MINID, MINID + 4999);
+    vector<bool> present(MINID + 5000, false);
+    int count = 0;
+    Swarm team(AVL);
+    for (int i = 0; i < 60000; i++) {
+        int id = idGen.getRandNum();
+        //removes and inserts alternate in long runs so the swarm shrinks and grows again
+        if ((i / 5000) % 2 == 1) {
+            team.remove(id);
+            count = count - present[id];
+            present[id] = false;
+        }else {
+            team.insert(Robot(id));
+            count = count + !present[id];
+            present[id] = true;
+        }
+        if (i % 2500 == 0 and !(isValidBalance(team, team.m_root) and isValidHeight(team.m_root))) {
+            return false;
+        }
     }
-    return str;
+    //the AVL bound on the height of n nodes
+    SwarmStats shape = team.stats();
+    if (shape.nodeCount != count or shape.height > 1.44 * log2(count + 2)
+        or !isValidBST(team.m_root, nullptr, nullptr)) {
+        return false;
+    }
+    for (int id = MINID; id < MINID + 5000; id++) {
+        if ((team.find(id) != nullptr) != present[id]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Test the rank rule and height bound of a WAVL tree after random inserts and removes, and conversions to and from AVL and BST.
+bool Tester::testWAVLNormalCase() {
+    Random idGen(MINID, MAXID);
+    vector<bool> present(MAXID + 1, false);
+    int count = 0;
+    Swarm team(WAVL);
+    for (int i = 0; i < 20000; i++) {
+        int id = idGen.getRandNum();
+        if (i % 3 == 2) {
+            team.remove(id);
+            count = count - present[id];
+            present[id] = false;
+        }else {
+            team.insert(Robot(id));
+            count = count + !present[id];
+            present[id] = true;
+        }
+        if (i % 1000 == 0 and !isValidRank(team, team.m_root)) {
+            return false;
+        }
+    }
+    //a WAVL tree is at most twice as high as a perfectly balanced tree
+    SwarmStats shape = team.stats();
+    if (!isValidRank(team, team.m_root) or !isValidBST(team.m_root, nullptr, nullptr)
+        or shape.nodeCount != count or shape.height > 2 * log2(count)) {
+        return false;
+    }
+    for (int id = MINID; id <= MAXID; id++) {
+        if ((team.find(id) != nullptr) != present[id]) {
+            return false;
+        }
+    }
+    //converting to AVL rebuilds the tree, converting back keeps it
+    team.setType(AVL);
+    if (team.getType() != AVL or !isValidBalance(team, team.m_root) or !isValidHeight(team.m_root)) {
+        return false;
+    }
+    Robot* root = team.m_root;
+    team.setType(WAVL);
+    if (team.getType() != WAVL or team.m_root != root or !isValidRank(team, team.m_root)) {
+        return false;
+    }
+    for (int i = 0; i < 3000; i++) {
+        team.remove(idGen.getRandNum());
+    }
+    //BST keeps the shape but needs the real heights back
+    team.setType(BST);
+    return (team.getType() == BST and isValidHeight(team.m_root) and isValidBST(team.m_root, nullptr, nullptr));
+}
+
+//Test that the adaptive mode rebuilds a degenerate BST as AVL, keeps AVL for uniform lookups, moves a single hot robot into a SPLAY tree and goes back to AVL for a remove.
+bool Tester::testAdaptiveNormalCase() {
+    Swarm team(BST);
+    team.setAdaptive(true, 1024);
+    for (int i = 0; i < 3000; i++) {
+        team.insert(Robot(MINID + i));
+    }
+    const vector<AdaptDecision>& decisions = team.getAdaptLog();
+    if (decisions.size() != 1 or decisions[0].from != BST or decisions[0].to != AVL
+        or decisions[0].currentCost <= decisions[0].projectedCost or team.getType() != AVL
+        or team.size() != 3000 or !isValidBalance(team, team.m_root)) {
+        return false;
+    }
+    Random idGen(MINID, MINID + 2999);
+    for (int i = 0; i < 20000; i++) {
+        team.find(idGen.getRandNum());
+    }
+    if (decisions.size() != 1) {
+        return false;
+    }
+    //the smallest id is a leaf of the AVL tree and the root of the SPLAY tree
+    for (int i = 0; i < 20000; i++) {
+        team.find(MINID);
+    }
+    if (decisions.size() != 2 or decisions[1].to != SPLAY or decisions[1].hotLocality < 0.9
+        or team.getType() != SPLAY or team.m_root->getID() != MINID) {
+        return false;
+    }
+    team.remove(MINID);
+    if (decisions.size() != 3 or team.getType() != AVL or team.find(MINID) != nullptr
+        or team.size() != 2999 or !isValidBalance(team, team.m_root) or !isValidHeight(team.m_root)) {
+        return false;
+    }
+    team.setAdaptive(false);
+    for (int i = 0; i < 20000; i++) {
+        team.find(MINID + 1);
+    }
+    Swarm copy;
+    copy = team;
+    return (!team.isAdaptive() and team.getAdaptLog().empty() and team.getType() == AVL and copy.size() == 2999);
+}
+
+//Test hits and misses of the hot-id cache and that remove, clear, setType(NONE) and the assignment operator leave no stale robot in it.
+bool Tester::testCacheNormalCase() {
+    Swarm team(AVL);
+    team.setCache(64);
+    for (int i = 0; i < 1000; i++) {
+        team.insert(Robot(MINID + i));
+    }
+    //the first find of each hot id misses, the other 99 hit
+    for (int round = 0; round < 100; round++) {
+        for (int i = 0; i < 8; i++) {
+            if (team.find(MINID + i * 100) == nullptr or team.find(MINID + i * 100)->getID() != MINID + i * 100) {
+                return false;
+            }
+        }
+    }
+    CacheStats counters = team.cacheStats();
+    if (counters.slots != 64 or counters.misses < 8 or counters.hits + counters.misses != 1600
+        or counters.hitRate < 0.9) {
+        return false;
+    }
+    //a removed robot must not be served from the cache, a new one with its id must
+    team.remove(MINID + 300);
+    if (team.find(MINID + 300) != nullptr) {
+        return false;
+    }
+    team.insert(Robot(MINID + 300, BIRD));
+    if (team.find(MINID + 300) == nullptr or team.find(MINID + 300)->getType() != BIRD) {
+        return false;
+    }
+    //a removed node with two children is replaced by its successor, which stays cached
+    Robot* root = team.m_root;
+    int rootID = root->getID();
+    team.find(rootID + 1);
+    team.remove(rootID);
+    if (team.find(rootID) != nullptr or team.find(rootID + 1) == nullptr
+        or !isValidBalance(team, team.m_root)) {
+        return false;
+    }
+    Swarm copy(BST);
+    copy.setCache(64);
+    copy.insert(Robot(MINID + 500, SUB));
+    copy.find(MINID + 500);
+    copy = team;
+    if (copy.find(MINID + 500) == nullptr or copy.find(MINID + 500)->getType() == SUB
+        or copy.find(MINID + 500) == team.find(MINID + 500)) {
+        return false;
+    }
+    //a SPLAY tree skips the cache
+    team.setType(SPLAY);
+    long long lookups = team.cacheStats().hits + team.cacheStats().misses;
+    if (team.find(MINID + 700) == nullptr or team.m_root->getID() != MINID + 700
+        or team.cacheStats().hits + team.cacheStats().misses != lookups) {
+        return false;
+    }
+    team.setType(AVL);
+    team.find(MINID + 700);
+    team.clear();
+    if (team.find(MINID + 700) != nullptr) {
+        return false;
+    }
+    copy.setType(NONE);
+    copy.setType(AVL);
+    if (copy.find(MINID + 500) != nullptr) {
+        return false;
+    }
+    team.setCache(0);
+    return (team.cacheStats().slots == 0 and team.find(MINID) == nullptr);
+}
+
+//Test that tombstoned robots are skipped by every lookup, revived by an insert, kept by save and load and reclaimed once the threshold is crossed.
+bool Tester::testLazyDeleteNormalCase() {
+    Swarm team(AVL);
+    team.setCache(64);
+    for (int i = 0; i < 1000; i++) {
+        team.insert(Robot(MINID + i));
+    }
+    team.find(MINID + 10);
+    team.setLazyDelete(true, 0.5);
+    //removing every other id of the first 800 leaves the shape alone
+    Robot* root = team.m_root;
+    for (int i = 0; i < 800; i = i + 2) {
+        team.remove(MINID + i);
+    }
+    vector<Robot*> range;
+    team.findRange(MINID, MINID + 99, range);
+    Robot* batch[2];
+    int batchIDs[2] = {MINID + 10, MINID + 11};
+    team.findBatch(batchIDs, 2, batch);
+    int visited = team.parallelReduce(0, [](int& count, const Robot&) { count++; },
+                                      [](int& count, const int& other) { count = count + other; });
+    if (team.m_root != root or team.size() != 600 or team.stats().nodeCount != 1000
+        or team.stats().tombstones != 400 or team.find(MINID + 10) != nullptr
+        or team.find(MINID + 11) == nullptr or team.setState(MINID + 20, DEAD)
+        or range.size() != 50 or batch[0] != nullptr or batch[1] == nullptr or visited != 600) {
+        return false;
+    }
+    //an insert revives the tombstone in place
+    Robot* node = team.getRobotAtThisID(MINID + 20);
+    if (!team.tryInsert(Robot(MINID + 20, BIRD)).second or team.find(MINID + 20) != node
+        or node->getType() != BIRD or team.size() != 601 or team.tryInsert(Robot(MINID + 20)).second) {
+        return false;
+    }
+    //tombstones survive an image
+    Swarm copy(BST);
+    bool loaded = team.save("swarm_test.bin") and copy.load("swarm_test.bin");
+    remove("swarm_test.bin");
+    if (!loaded or copy.size() != 601 or copy.stats().tombstones != 399 or copy.find(MINID + 30) != nullptr) {
+        return false;
+    }
+    //the 501st tombstone is more than half of the nodes and compacts the tree
+    for (int i = 1; i < 205; i = i + 2) {
+        team.remove(MINID + i);
+    }
+    if (team.stats().tombstones != 0 or team.size() != 499 or team.stats().nodeCount != 499
+        or !isValidBalance(team, team.m_root) or !isValidHeight(team.m_root)
+        or !isValidBST(team.m_root, nullptr, nullptr) or team.find(MINID + 20) == nullptr) {
+        return false;
+    }
+    //turning it off reclaims what is left and removes eagerly again
+    copy.setLazyDelete(false);
+    copy.remove(MINID + 21);
+    return (copy.stats().tombstones == 0 and copy.stats().nodeCount == 600 and copy.size() == 600
+            and isValidBST(copy.m_root, nullptr, nullptr));
+}
+
+//Test that an incremental setType answers every operation from both trees, is saved as a converted tree and ends in a valid AVL and WAVL tree.
+bool Tester::testIncrementalConvertNormalCase() {
+    TREETYPE types[] = {AVL, WAVL};
+    for (TREETYPE type : types) {
+        //a degenerate BST, its rebuild would be one long pause
+        Swarm team(BST);
+        for (int i = 0; i < 3000; i++) {
+            team.insert(Robot(MINID + i));
+        }
+        Robot* node = team.find(MINID + 1500);
+        team.setConversionBudget(1);
+        team.setType(type);
+        if (!team.isConverting() or team.getType() != type or team.size() != 3000) {
+            return false;
+        }
+        //both trees answer while the nodes move, the nodes keep their addresses
+        for (int i = 0; i < 3000; i = i + 100) {
+            if (team.find(MINID + i) == nullptr or team.find(MINID + i)->getID() != MINID + i) {
+                return false;
+            }
+        }
+        //a save in the middle of the conversion is loaded fully converted
+        Swarm saved;
+        if (!team.isConverting() or !team.save("swarm_test.bin") or !saved.load("swarm_test.bin")
+            or saved.getType() != type or saved.size() != 3000 or !isValidBST(saved.m_root, nullptr, nullptr)
+            or (type == AVL and !isValidBalance(saved, saved.m_root)) or (type == WAVL and !isValidRank(saved, saved.m_root))) {
+            return false;
+        }
+        team.remove(MINID + 2999);
+        team.remove(MINID + 10);
+        vector<Robot*> range;
+        team.findRange(MINID + 2990, MINID + 3010, range);
+        if (team.find(MINID + 1500) != node or team.tryInsert(Robot(MINID + 2998)).second
+            or !team.tryInsert(Robot(MINID + 5000)).second or !team.setState(MINID + 2997, DEAD)
+            or team.find(MINID + 2999) != nullptr or team.find(MINID + 10) != nullptr or team.size() != 2999
+            or range.size() != 9 or range[0]->getID() != MINID + 2990 or range[8]->getID() != MINID + 2998
+            or !team.isConverting()) {
+            return false;
+        }
+        while (!team.step(1000)) {
+        }
+        SwarmStats stats = team.stats();
+        if (team.isConverting() or stats.nodeCount != 2999 or stats.tombstones != 0 or team.size() != 2999
+            or team.find(MINID + 2997)->getState() != DEAD or !isValidBST(team.m_root, nullptr, nullptr)) {
+            return false;
+        }
+        if (type == AVL and !(isValidBalance(team, team.m_root) and isValidHeight(team.m_root))) {
+            return false;
+        }
+        if (type == WAVL and !isValidRank(team, team.m_root)) {
+            return false;
+        }
+    }
+    //without a budget the rebuild happens at once
+    Swarm team(SPLAY);
+    for (int i = 0; i < 100; i++) {
+        team.insert(Robot(MINID + i));
+    }
+    team.setType(AVL);
+    return (!team.isConverting() and team.step() and isValidBalance(team, team.m_root));
+}
+
+//Test the memory report after inserts and removes, that compact leaves one dense block in id order, and that inserts beyond the memory budget are rejected.
+bool Tester::testMemoryNormalCase() {
+    Swarm team(AVL);
+    MemoryUsage usage = team.memoryUsage();
+    if (usage.nodes != 0 or usage.poolBytes != 0 or usage.fragmentation != 0) {
+        return false;
+    }
+    for (int i = 0; i < 1000; i++) {
+        team.insert(Robot(MINID + (i * 7919) % 1000, BIRD));
+    }
+    usage = team.memoryUsage();
+    if (usage.nodes != 1000 or usage.nodeBytes != 1000 * (long long)sizeof(Robot) or usage.poolBytes < usage.nodeBytes
+        or usage.totalBytes < usage.nodeBytes + usage.overheadBytes or usage.blocks < 2) {
+        return false;
+    }
+    //removes leave free slots behind, compact returns them
+    for (int i = 0; i < 1000; i = i + 3) {
+        team.remove(MINID + i);
+    }
+    team.setLazyDelete(true);
+    team.remove(MINID + 1);
+    if (team.memoryUsage().fragmentation < 0.3) {
+        return false;
+    }
+    team.compact();
+    usage = team.memoryUsage();
+    vector<Robot*> robots;
+    team.findRange(MINID, MAXID, robots);
+    if (usage.nodes != 665 or usage.blocks != 1 or usage.poolBytes != usage.nodeBytes or usage.fragmentation != 0
+        or robots.size() != 665 or !isValidBalance(team, team.m_root) or !isValidBST(team.m_root, nullptr, nullptr)) {
+        return false;
+    }
+    for (int i = 0; i + 1 < (int)robots.size(); i++) {
+        if (robots[i + 1] != robots[i] + 1 or robots[i]->getType() != BIRD) {
+            return false;
+        }
+    }
+    //the budget holds 100 nodes, a removed node is reused
+    Swarm small(BST);
+    small.setMemoryBudget(100 * sizeof(Robot));
+    for (int i = 0; i < 150; i++) {
+        small.insert(Robot(MINID + i));
+    }
+    Robot* existing = small.tryInsert(Robot(MINID + 5)).first;
+    if (small.size() != 100 or small.memoryUsage().poolBytes > 100 * (long long)sizeof(Robot)
+        or small.tryInsert(Robot(MINID + 120)).first != nullptr or existing == nullptr or existing->getID() != MINID + 5) {
+        return false;
+    }
+    small.remove(MINID + 5);
+    return (small.tryInsert(Robot(MINID + 120)).second and small.size() == 100 and small.find(MINID + 120) != nullptr);
+}
+
+//Test that rebuildWeighted puts the most accessed robot at the root, keeps every robot and lowers the depth of the counted finds below the AVL tree.
+bool Tester::testWeightedRebuildNormalCase() {
+    Swarm team(AVL);
+    for (int i = 0; i < 1000; i++) {
+        team.insert(Robot(MINID + i));
+    }
+    //id 999 is found 3000 times, more than all other robots weigh, the ids 0, 10, ..., 90
+    //100 times each and nothing else
+    team.setAccessCounting(true);
+    for (int i = 0; i < 3000; i++) {
+        team.find(MINID + 999);
+        if (i < 100) {
+            for (int hot = 0; hot < 100; hot = hot + 10) {
+                team.find(MINID + hot);
+            }
+        }
+    }
+    team.find(MINID + 5000);
+    double avlDepth = team.stats().accessDepth;
+    Robot* node = team.find(MINID + 999);
+    team.rebuildWeighted();
+    SwarmStats stats = team.stats();
+    if (team.getType() != BST or team.m_root != node or node->getAccesses() != 3001 or stats.nodeCount != 1000
+        or !isValidBST(team.m_root, nullptr, nullptr) or !isValidHeight(team.m_root)
+        or stats.accessDepth >= avlDepth / 2) {
+        return false;
+    }
+    //without counts the rebuild is a balanced tree
+    team.resetAccessCounts();
+    team.setAccessCounting(false);
+    team.find(MINID + 999);
+    team.rebuildWeighted();
+    return (team.getType() == BST and team.stats().accessDepth == 0 and team.stats().maxDepth == 9
+            and node->getAccesses() == 0 and isValidBST(team.m_root, nullptr, nullptr));
+}
+
+//Test that commands queued by several threads all complete with the results of direct calls, and that a snapshot holds every command queued before it and does not change afterwards.
+bool Tester::testSwarmServiceNormalCase() {
+    SwarmService service(AVL);
+    //thread t inserts the ids t, t + 4, t + 8, ..., twice each, then removes the ones below 400
+    //and sets the state of the others to DEAD
+    vector<int> failures(4, 0);
+    vector<thread> producers;
+    for (int t = 0; t < 4; t++) {
+        producers.push_back(thread([&service, &failures, t]() {
+            vector<future<bool> > added, duplicates, changes;
+            for (int i = t; i < 1000; i = i + 4) {
+                added.push_back(service.insert(Robot(MINID + i, BIRD, ALIVE)));
+                duplicates.push_back(service.insert(Robot(MINID + i, SUB, DEAD)));
+            }
+            for (int i = t; i < 1000; i = i + 4) {
+                changes.push_back(i < 400 ? service.remove(MINID + i) : service.setState(MINID + i, DEAD));
+            }
+            for (size_t i = 0; i < added.size(); i++) {
+                if (!added[i].get() or duplicates[i].get() or !changes[i].get()) {
+                    failures[t]++;
+                }
+            }
+        }));
+    }
+    for (thread& producer : producers) {
+        producer.join();
+    }
+    if (failures != vector<int>(4, 0)) {
+        return false;
+    }
+    shared_ptr<const SwarmSnapshot> before = service.snapshot();
+    if (before->size() != 600 or before->getVersion() != service.getApplied() or service.getApplied() != 3000
+        or before->find(MINID + 399) != nullptr or before->find(MINID + 400) == nullptr
+        or before->find(MINID + 400)->getState() != DEAD or before->find(MINID + 400)->getType() != BIRD) {
+        return false;
+    }
+    //no mutation in between, the same copy is handed out again
+    if (service.snapshot() != before) {
+        return false;
+    }
+    //missing robots fail without changing the swarm
+    if (service.remove(MINID + 5).get()
+        or service.setState(MINID + 5, ALIVE).get()) {
+        return false;
+    }
+    service.insert(Robot(MINID + 5));
+    service.remove(MINID + 999);
+    shared_ptr<const SwarmSnapshot> after = service.snapshot();
+    //a vector command reports every element like the single commands would
+    vector<Robot> batch = {Robot(MINID + 2000), Robot(MINID + 5), Robot(MINID + 2001), Robot(MINID + 2000)};
+    future<vector<bool> > batchAdded = service.insertAll(batch);
+    future<vector<bool> > batchRemoved = service.removeAll({MINID + 2001, MINID + 6, MINID + 2001});
+    if (batchAdded.get() != vector<bool>({true, false, true, false})
+        or batchRemoved.get() != vector<bool>({true, false, false}) or service.snapshot()->size() != 601) {
+        return false;
+    }
+    //a large batch is merged with the tree, the first robot of a repeated id is kept
+    Swarm team(AVL);
+    for (int i = 0; i < 100; i++) {
+        team.insert(Robot(MINID + i * 2));
+    }
+    vector<Robot> inserts;
+    for (int i = 0; i < 2000; i++) {
+        inserts.push_back(Robot(MINID + (i % 1000), i < 1000 ? BIRD : SUB));
+    }
+    vector<bool> added;
+    if (team.insertBatch(inserts, added) != 900 or team.size() != 1000 or added[0] or !added[1]
+        or added[1001] or team.find(MINID + 1)->getType() != BIRD
+        or !isValidBST(team.m_root, nullptr, nullptr) or !isValidBalance(team, team.m_root)) {
+        return false;
+    }
+    vector<int> removes;
+    for (int i = 0; i < 1500; i++) {
+        removes.push_back(MINID + 1999 - i * 2);
+    }
+    removes.push_back(MINID + 1);
+    vector<bool> removed;
+    if (team.removeBatch(removes, removed) != 500 or team.size() != 500 or removed[0] or !removed[500]
+        or removed[1500] or team.find(MINID + 1) != nullptr or team.find(MINID) == nullptr
+        or !isValidBST(team.m_root, nullptr, nullptr) or !isValidBalance(team, team.m_root)) {
+        return false;
+    }
+    vector<Robot*> robots;
+    after->getSwarm().findRange(MINID, MAXID, robots);
+    return (before->size() == 600 and before->find(MINID + 5) == nullptr and before->find(MINID + 999) != nullptr
+            and after->size() == 600 and after->find(MINID + 5) != nullptr and after->find(MINID + 999) == nullptr
+            and robots.size() == 600 and after->getVersion() > before->getVersion());
+}
+
+//Test k-nearest and radius queries with type and state filters against a scan of all positions, after moves, removes, lazy removes, compact, a copy and a new cell size, and a position for an id outside MINID - MAXID.
+bool Tester::testSpatialNormalCase() {
+    Swarm team(AVL);
+    team.setSpatialIndex(true, 5);
+    //positions[i] is the position of MINID + i, robots 2000 and up have none
+    mt19937 generator(7);
+    uniform_real_distribution<float> coordinate(0, 100);
+    vector<Position> positions(2000);
+    vector<bool> present(2000, true);
+    for (int i = 0; i < 2000; i++) {
+        positions[i] = Position{coordinate(generator), coordinate(generator), coordinate(generator)};
+        team.insert(Robot(MINID + i, static_cast<ROBOTTYPE>(i % 5), static_cast<STATE>(i % 2)), positions[i]);
+    }
+    for (int i = 2000; i < 2100; i++) {
+        team.insert(Robot(MINID + i));
+    }
+    //every query of a few centers, inside and far outside the robots, against a scan
+    auto matchesScan = [&](Swarm& swarm) {
+        Position centers[] = {{50, 50, 50}, {3, 97, 10}, {-400, 20, 900}};
+        int typeMasks[] = {ALLTYPES, 1 << DRONE, (1 << BIRD) | (1 << SUB)};
+        for (const Position& center : centers) {
+            for (int typeMask : typeMasks) {
+                int stateMask = (typeMask == ALLTYPES) ? ALLSTATES : 1 << ALIVE;
+                vector<pair<float, int>> expected;
+                for (int i = 0; i < 2000; i++) {
+                    if (present[i] and ((typeMask >> (i % 5)) & 1) and ((stateMask >> (i % 2)) & 1)) {
+                        float dx = positions[i].x - center.x;
+                        float dy = positions[i].y - center.y;
+                        float dz = positions[i].z - center.z;
+                        expected.push_back(make_pair(dx * dx + dy * dy + dz * dz, MINID + i));
+                    }
+                }
+                sort(expected.begin(), expected.end());
+                vector<Robot*> robots;
+                swarm.findNearest(center, 10, robots, typeMask, stateMask);
+                if (robots.size() != min((size_t)10, expected.size())) {
+                    return false;
+                }
+                for (size_t i = 0; i < robots.size(); i++) {
+                    if (robots[i]->getID() != expected[i].second) {
+                        return false;
+                    }
+                }
+                swarm.findRadius(center, 20, robots, typeMask, stateMask);
+                vector<int> found;
+                for (Robot* robot : robots) {
+                    found.push_back(robot->getID());
+                }
+                vector<int> within;
+                for (const pair<float, int>& match : expected) {
+                    if (match.first <= 400) {
+                        within.push_back(match.second);
+                    }
+                }
+                sort(found.begin(), found.end());
+                sort(within.begin(), within.end());
+                if (found != within) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+    if (!matchesScan(team)) {
+        return false;
+    }
+    //moves, removes and lazy removes
+    for (int i = 0; i < 2000; i = i + 10) {
+        positions[i] = Position{coordinate(generator), coordinate(generator), 0};
+        if (!team.setPosition(MINID + i, positions[i])) {
+            return false;
+        }
+    }
+    for (int i = 1; i < 2000; i = i + 7) {
+        team.remove(MINID + i);
+        present[i] = false;
+    }
+    team.setLazyDelete(true, 0.9);
+    for (int i = 3; i < 2000; i = i + 11) {
+        team.remove(MINID + i);
+        present[i] = false;
+    }
+    Position position;
+    if (!matchesScan(team) or team.setPosition(MINID + 3, Position()) or team.getPosition(MINID + 1, position)
+        or team.getPosition(MINID + 2050, position) or !team.getPosition(MINID + 10, position)
+        or position.x != positions[10].x or position.z != 0) {
+        return false;
+    }
+    //compact moves the nodes and a copy has nodes of its own
+    team.compact();
+    Swarm copy;
+    copy = team;
+    team.clear();
+    team.setSpatialIndex(true, 30);
+    vector<Robot*> robots;
+    team.findNearest(Position{50, 50, 50}, 5, robots);
+    if (!robots.empty() or !matchesScan(copy)) {
+        return false;
+    }
+    copy.setSpatialIndex(true, 30);
+    if (!matchesScan(copy)) {
+        return false;
+    }
+    //the swarm takes ids outside MINID - MAXID and so does the index
+    copy.insert(Robot(MAXID + 1, DRONE, ALIVE));
+    Position far{1000, 0, 0};
+    return copy.setPosition(MAXID + 1, far) and copy.getPosition(MAXID + 1, position) and position.x == far.x;
+}
+
+//Test a BPTREE against a list of the present ids after random inserts and removes, batches, conversions to and from AVL, a copy, save and load and the parallel walks.
+bool Tester::testBPlusTreeNormalCase() {
+    Swarm team(BPTREE);
+    mt19937 generator(11);
+    vector<bool> present(20000, false);
+    //every robot, the range queries and the batched lookups against the list
+    auto matches = [&](Swarm& swarm) {
+        vector<int> expected;
+        for (int i = 0; i < 20000; i++) {
+            if (present[i]) {
+                expected.push_back(MINID + i);
+            }
+        }
+        vector<Robot*> robots;
+        swarm.findRange(MINID, MAXID, robots);
+        if (swarm.getType() != BPTREE or swarm.m_root != nullptr or swarm.size() != (int)expected.size()
+            or robots.size() != expected.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < robots.size(); i++) {
+            if (robots[i]->getID() != expected[i] or swarm.find(expected[i]) != robots[i]) {
+                return false;
+            }
+        }
+        robots.clear();
+        swarm.findRange(MINID + 5000, MINID + 5999, robots);
+        if ((int)robots.size() != (int)count(present.begin() + 5000, present.begin() + 6000, true)) {
+            return false;
+        }
+        vector<int> ids(2000);
+        vector<Robot*> found(ids.size());
+        for (size_t i = 0; i < ids.size(); i++) {
+            ids[i] = MINID + (int)(generator() % 20000);
+        }
+        swarm.findBatch(ids.data(), ids.size(), found.data());
+        for (size_t i = 0; i < ids.size(); i++) {
+            if (found[i] != swarm.find(ids[i])) {
+                return false;
+            }
+        }
+        //a node holds at least BTREEKEYS / 2 ids, so the tree is no higher than log base 8
+        int height = swarm.stats().height;
+        return expected.empty() ? height == -1 : height <= (int)ceil(log((double)expected.size()) / log(8.0));
+    };
+    for (int i = 0; i < 30000; i++) {
+        int index = generator() % 20000;
+        if (generator() % 3 == 0) {
+            team.remove(MINID + index);
+            present[index] = false;
+        }else {
+            pair<Robot*, bool> added = team.emplace(MINID + index);
+            if (added.second == present[index] or added.first == nullptr or added.first->getID() != MINID + index) {
+                return false;
+            }
+            present[index] = true;
+        }
+    }
+    if (!matches(team)) {
+        return false;
+    }
+    //batches large enough to be merged in one pass
+    vector<Robot> robots;
+    vector<int> ids;
+    for (int i = 0; i < 20000; i = i + 2) {
+        robots.push_back(Robot(MINID + i));
+        ids.push_back(MINID + i + 1);
+    }
+    vector<bool> done;
+    int expected = 0;
+    for (int i = 0; i < 20000; i = i + 2) {
+        expected += !present[i];
+        present[i] = true;
+    }
+    if (team.insertBatch(robots, done) != expected) {
+        return false;
+    }
+    expected = 0;
+    for (int i = 1; i < 20000; i = i + 2) {
+        expected += present[i];
+        present[i] = false;
+    }
+    if (team.removeBatch(ids, done) != expected or !matches(team)) {
+        return false;
+    }
+    //to AVL and back, the nodes move and nothing is allocated
+    Robot* robot = team.find(MINID + 100);
+    team.setType(AVL);
+    if (team.m_bplus.height() != -1 or !isValidBalance(team, team.m_root) or team.find(MINID + 100) != robot) {
+        return false;
+    }
+    team.setType(BPTREE);
+    if (team.find(MINID + 100) != robot or !matches(team)) {
+        return false;
+    }
+    //remove everything but a few robots, the tree shrinks back to one leaf
+    for (int i = 0; i < 20000; i++) {
+        if (i % 2000 != 0) {
+            team.remove(MINID + i);
+            present[i] = false;
+        }
+    }
+    if (!matches(team) or team.stats().height != 0) {
+        return false;
+    }
+    for (int i = 0; i < 20000; i = i + 3) {
+        team.insert(Robot(MINID + i, SUB, DEAD));
+        present[i] = true;
+    }
+    //copies, images and the parallel walks
+    Swarm copy;
+    copy = team;
+    const char* path = "bplus_test.img";
+    bool saved = copy.save(path);
+    Swarm loaded;
+    bool restored = loaded.load(path);
+    remove(path);
+    long long sum = 0;
+    for (int i = 0; i < 20000; i++) {
+        sum += present[i] ? MINID + i : 0;
+    }
+    long long total = team.parallelReduce(0LL, [](long long& result, const Robot& robot) {
+        result += robot.getID();
+    }, [](long long& result, const long long& other) {
+        result += other;
+    }, 4);
+    team.clear();
+    return saved and restored and total == sum and matches(copy) and matches(loaded)
+           and loaded.find(MINID + 3)->getType() == SUB and loaded.find(MINID + 3)->getState() == DEAD;
+}
+
+//Test that emplace and tryInsert report duplicates, keep the robot already stored and take no node from the pool for them.
+bool Tester::testEmplaceNormalCase() {
+    TREETYPE types[] = {BST, AVL, SPLAY, BPTREE};
+    for (TREETYPE type : types) {
+        Swarm team(type);
+        for (int i = 0; i < 500; i++) {
+            pair<Robot*, bool> added = team.emplace(MINID + i * 7, BIRD, ALIVE);
+            if (!added.second or added.first == nullptr or added.first->getID() != MINID + i * 7) {
+                return false;
+            }
+        }
+        //count the free nodes, duplicates must not use any of them
+        int freeNodes = 0;
+        for (Robot* node = team.m_freeList; node != nullptr; node = node->getLeft()) {
+            freeNodes++;
+        }
+        size_t blocks = team.m_blocks.size();
+        for (int i = 0; i < 2000; i++) {
+            int id = MINID + (i % 500) * 7;
+            pair<Robot*, bool> duplicate = (i % 2 == 0) ? team.emplace(id, SUB, DEAD)
+                                                        : team.tryInsert(Robot(id, SUB, DEAD));
+            if (duplicate.second or duplicate.first == nullptr or duplicate.first->getID() != id
+                or duplicate.first->getType() != BIRD or duplicate.first->getState() != ALIVE) {
+                return false;
+            }
+        }
+        int freeAfter = 0;
+        for (Robot* node = team.m_freeList; node != nullptr; node = node->getLeft()) {
+            freeAfter++;
+        }
+        if (freeAfter != freeNodes or team.m_blocks.size() != blocks or team.stats().nodeCount != 500) {
+            return false;
+        }
+        if (type == AVL and !isValidBalance(team, team.m_root)) {
+            return false;
+        }
+    }
+    Swarm none;
+    return none.emplace(MINID).second and !none.emplace(MINID + 1).second
+           and none.emplace(MINID + 1).first == nullptr;
+}
+
+//Test that recovering from the log, and from an image and log after a compaction, restores the robots, their states and the tree type.
+bool Tester::testLogReplayNormalCase() {
+    remove("swarm_test.log");
+    remove("swarm_test.bin");
+    Random idGen(MINID, MAXID);
+    Random typeGen(0,4);
+    Swarm team(AVL);
+    if (!team.openLog("swarm_test.log", 16)) {
+        return false;
+    }
+    //enough inserts in a row for replay to merge them in bulk
+    for (int i = 0; i < 3000; i++) {
+        team.insert(Robot(idGen.getRandNum(), static_cast<ROBOTTYPE>(typeGen.getRandNum())));
+    }
+    for (int i = 0; i < 3000; i += 7) {
+        team.setState(team.m_root->getID() + i, DEAD);
+    }
+    team.syncLog();
+    Swarm restored(AVL);
+    bool result = (restored.recover("swarm_test.bin", "swarm_test.log")
+                   and robotsIntoString(restored) == robotsIntoString(team)
+                   and isValidBalance(restored, restored.m_root));
+
+    //after a compaction the image holds the tree and the log only the later operations
+    result = result and team.compactLog("swarm_test.bin");
+    for (int i = 0; i < 50; i++) {
+        team.insert(Robot(idGen.getRandNum(), BIRD));
+        team.remove(idGen.getRandNum());
+    }
+    team.setState(team.m_root->getID(), DEAD);
+    team.setType(SPLAY);
+    team.insert(Robot(MINID, SUB));
+    team.closeLog();
+    Swarm recovered(BST);
+    result = result and recovered.recover("swarm_test.bin", "swarm_test.log")
+             and recovered.getType() == SPLAY
+             and robotsIntoString(recovered) == robotsIntoString(team)
+             and !ifstream("swarm_test.log.compacting");
+    remove("swarm_test.log");
+    remove("swarm_test.bin");
+    return result;
+}
+
+//Test replaying a log with a torn last record, a corrupt record and a bad header.
+bool Tester::testLogReplayErrorCase() {
+    remove("swarm_test.log");
+    Swarm team(BST);
+    team.openLog("swarm_test.log", 1);
+    for (int i = 0; i < 20; i++) {
+        team.insert(Robot(MINID + i * 3, REPTILE));
+    }
+    team.closeLog();
+    //half a record written when the program crashed is ignored
+    ofstream torn("swarm_test.log", ios::binary | ios::app);
+    torn.write("\x07\x07\x07", 3);
+    torn.close();
+    Swarm restored(BST);
+    bool result = (restored.replay("swarm_test.log") and robotsIntoString(restored) == robotsIntoString(team));
+
+    //a corrupt record stops the replay, the records before it are applied
+    fstream log("swarm_test.log", ios::binary | ios::in | ios::out);
+    log.seekp(8 + 10 * 8 + 1);
+    log.put('\x55');
+    log.close();
+    Swarm corrupt(BST);
+    result = result and !corrupt.replay("swarm_test.log") and corrupt.find(MINID + 9 * 3) != nullptr
+             and corrupt.find(MINID + 10 * 3) == nullptr;
+
+    ofstream header("swarm_test.log", ios::binary | ios::trunc);
+    header.write("SWRM\x01\x00\x00\x00", 8);
+    header.close();
+    Swarm wrong(BST);
+    result = result and !wrong.replay("swarm_test.log") and wrong.m_root == nullptr
+             and !wrong.replay("swarm_missing.log");
+
+    //a file that is not a log is not appended to, a torn record is cut off first
+    result = result and !wrong.openLog("swarm_test.log") and filesystem::file_size("swarm_test.log") == 8;
+    ofstream other("swarm_test.log", ios::binary | ios::trunc);
+    other.write("SW", 2);
+    other.close();
+    result = result and wrong.openLog("swarm_test.log");
+    wrong.insert(Robot(MINID));
+    wrong.closeLog();
+    torn.open("swarm_test.log", ios::binary | ios::app);
+    torn.write("\x07\x07\x07", 3);
+    torn.close();
+    result = result and wrong.openLog("swarm_test.log");
+    wrong.insert(Robot(MINID + 1));
+    wrong.closeLog();
+    Swarm appended(BST);
+    result = result and filesystem::file_size("swarm_test.log") == 8 + 2 * 8
+             and appended.replay("swarm_test.log") and appended.size() == 2;
+    remove("swarm_test.log");
+    return result;
+}
+
+//Test inserts, removes and lookups of BasicSwarm for every policy against a list of the ids that should be present, and the layout fields.
+bool Tester::testBasicSwarmNormalCase() {
+    Random idGen(0, 999);
+    BasicSwarm<BSTPolicy> bst;
+    BasicSwarm<AVLPolicy, NodeLayout<HeightField, SizeField, AliveField>> avl;
+    BasicSwarm<SplayPolicy> splay;
+    bool result = (isSameAsPresent(bst, idGen, 20000) and isSameAsPresent(avl, idGen, 20000)
+                   and isSameAsPresent(splay, idGen, 20000));
+
+    //the AVL height bound, select by rank and the count of ALIVE robots
+    result = result and avl.height() <= 1.44 * log2(avl.size() + 2);
+    int previous = -1;
+    for (int k = 0; k < avl.size() and result; k++) {
+        result = (avl.select(k) != nullptr and avl.select(k)->getKey() > previous);
+        previous = avl.select(k)->getKey();
+    }
+    avl.setState(avl.select(0)->getKey(), DEAD);
+    result = result and avl.countAlive() == avl.size() - 1 and avl.select(avl.size()) == nullptr;
+
+    return result;
+}
+
+//Test a BasicTree with string keys in descending order and a move-only payload built in place by emplace.
+bool Tester::testBasicTreeNormalCase() {
+    BasicTree<string, unique_ptr<int>, greater<string>, SplayPolicy, NodeLayout<SizeField>> stations;
+    string names[] = {"north", "east", "south", "west", "center"};
+    for (int i = 0; i < 5; i++) {
+        if (!stations.emplace(names[i], new int(i)).second) {
+            return false;
+        }
+    }
+    //a duplicate key must not take ownership of anything
+    int* spare = new int(99);
+    bool result = (!stations.emplace("east", spare).second and *stations.find("east")->getPayload() == 1);
+    delete spare;
+
+    string order;
+    stations.forEach([&order](const decltype(stations)::Node& station) {
+        order.append(station.getKey() + " ");
+    });
+    result = result and order == "west south north east center " and stations.size() == 5;
+    result = result and stations.select(0)->getKey() == "west" and stations.getRoot()->getKey() == "east";
+    result = result and stations.remove("north") and !stations.remove("north")
+             and stations.find("north") == nullptr and stations.size() == 4;
+    result = result and stations.modify("south", [](unique_ptr<int>& count) { *count = 7; })
+             and *stations.find("south")->getPayload() == 7;
+    return result;
+}
+
+//Test the dump formats, the depth limit and truncation of the buffer variant on a small known tree.
+bool Tester::testDumpNormalCase() {
+    Swarm team(BST);
+    int ids[] = {50000, 30000, 70000, 20000};
+    for (int id : ids) {
+        team.insert(Robot(id, DRONE));
+    }
+    bool result = (dumpTreeIntoString(team) == "(((20000:0)30000:1)50000:2(70000:0))");
+
+    ostringstream limited;
+    team.dumpTree(limited, DUMPTEXT, 1);
+    result = result and limited.str() == "(((...)30000:1)50000:2(70000:0))";
+
+    ostringstream json;
+    team.dumpTree(json, DUMPJSON);
+    result = result and json.str().find("{\"id\":50000,\"height\":2,\"type\":\"DRONE\"") == 0;
+    result = result and json.str().find("{\"id\":20000,\"height\":0,\"type\":\"DRONE\",\"state\":\"ALIVE\",\"left\":null,\"right\":null}") != string::npos;
+
+    ostringstream dot;
+    team.dumpTree(dot, DUMPDOT);
+    result = result and dot.str().find("digraph swarm {") == 0;
+    result = result and dot.str().find("n50000 -> n30000;") != string::npos;
+    result = result and dot.str().find("n30000 -> n20000;") != string::npos;
+
+    //the buffer variant reports the full length and keeps a terminated prefix
+    char buffer[10];
+    int length = team.dumpTree(buffer, sizeof(buffer));
+    result = result and length == (int)dumpTreeIntoString(team).size() and string(buffer) == "(((20000:";
+
+    Swarm empty(AVL);
+    result = result and dumpTreeIntoString(empty) == "";
+    ostringstream emptyJSON;
+    empty.dumpTree(emptyJSON, DUMPJSON);
+    result = result and emptyJSON.str() == "null";
+    return result;
+}
+
+//Test that find in a splay tree brings the node to the root without losing nodes, e.g. finding ids in a zig-zag position.
+bool Tester::testSplayAfterFindNormalCase() {
+    Random typeGen(0,4);
+    Swarm team(SPLAY);
+    for (int i = 0; i < 300; i++) {
+        Robot robot((i * 7919) % 300, static_cast<ROBOTTYPE>(typeGen.getRandNum()));
+        team.insert(robot);
+    }
+    for (int i = 0; i < 300; i++) {
+        int id = (i * 31) % 300;
+        Robot* robot = team.find(id);
+        if (robot == nullptr or team.m_root != robot or !isValidBST(team.m_root, nullptr, nullptr)) {
+            return false;
+        }
+    }
+    for (int i = 0; i < 300; i++) {
+        if (!find(team.m_root, i)) {
+            return false;
+        }
+    }
+    return (team.find(300) == nullptr);
+}
+
+//Test that setType(AVL) inserts the nodes of a BST into the new tree in id order, e.g. the tree the driver prints after its conversion.
+bool Tester::testSetTypeAVLNormalCase() {
+    //the BST of the driver after its remove, inserted in pre-order
+    Swarm team(BST);
+    int ids[] = {79418, 36888, 11867, 54513, 67028, 54865, 62498, 77392, 84872};
+    for (int id : ids) {
+        team.insert(Robot(id, DRONE));
+    }
+    if (dumpTreeIntoString(team) != "(((11867:0)36888:4(54513:3((54865:1(62498:0))67028:2(77392:0))))79418:5(84872:0))") {
+        return false;
+    }
+    Robot* root = team.find(54865);
+    team.setType(AVL);
+    //the nodes are moved, not copied
+    return (team.getType() == AVL and team.m_root == root and team.size() == 9
+            and dumpTreeIntoString(team) == "(((11867:0)36888:1(54513:0))54865:3((62498:0)67028:2((77392:0)79418:1(84872:0))))");
+}
+
+//Test the four AVL rotation cases (left-left, left-right, right-right and right-left) on three robots, each must end with the middle id at the root.
+bool Tester::testAVLRotationsNormalCase() {
+    int orders[4][3] = {{30000, 20000, 10000}, {30000, 10000, 20000},
+                        {10000, 20000, 30000}, {10000, 30000, 20000}};
+    for (int i = 0; i < 4; i++) {
+        Swarm team(AVL);
+        for (int id : orders[i]) {
+            team.insert(Robot(id, DRONE));
+        }
+        if (dumpTreeIntoString(team) != "((10000:0)20000:1(30000:0))" or team.size() != 3) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Test that a BST converted with setType(AVL) reports AVL and keeps balancing later inserts and removes, e.g. ascending ids that would make a BST a chain.
+bool Tester::testSetTypeAVLEdgeCase() {
+    Swarm team(BST);
+    for (int i = 0; i < 10; i++) {
+        team.insert(Robot(MINID + i, DRONE));
+    }
+    team.setType(AVL);
+    if (team.getType() != AVL or !isValidBalance(team, team.m_root)) {
+        return false;
+    }
+    for (int i = 10; i < 1000; i++) {
+        team.insert(Robot(MINID + i, DRONE));
+    }
+    for (int i = 0; i < 500; i++) {
+        team.remove(MINID + i);
+    }
+    //500 robots fit in an AVL tree of height 10, a BST of ascending ids is a chain
+    return (team.size() == 500 and team.m_root->getHeight() <= 10 and isValidBalance(team, team.m_root)
+            and isValidHeight(team.m_root) and isValidBST(team.m_root, nullptr, nullptr));
+}
+
+//Test the exact tree after splaying a node in a zig-zag, a zag-zig and a zig-zig-zig position, e.g. a node at depth 3 first rotates over its parent.
+bool Tester::testSplayOrderNormalCase() {
+    //each BST is turned into a SPLAY tree without restructuring and then one id is found
+    int trees[3][4] = {{30000, 10000, 20000, 0}, {10000, 30000, 20000, 0}, {40000, 30000, 20000, 10000}};
+    int ids[3] = {20000, 20000, 10000};
+    //the pairs of rotations start at the root, so an odd depth leaves a single rotation at the bottom
+    string expected[3] = {"((10000:0)20000:1(30000:0))", "((10000:0)20000:1(30000:0))",
+                          "(10000:2((20000:0)30000:1(40000:0)))"};
+    for (int i = 0; i < 3; i++) {
+        Swarm team(BST);
+        for (int id : trees[i]) {
+            if (id != 0) {
+                team.insert(Robot(id, DRONE));
+            }
+        }
+        team.setType(SPLAY);
+        if (team.find(ids[i]) != team.m_root or dumpTreeIntoString(team) != expected[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//////*PRIVATE FUNCTIONS BELOW*//////
+
+//Test whether the tree is balanced
+bool Tester::isValidBalance(Swarm& swarm, Robot* node) {
+    if (node == nullptr) {
+        return true;
+    }
+    int balance = swarm.getBalance(node);
+    if (balance < -1 or balance > 1) {
+        return false;
+    }
+    if (isValidBalance(swarm, node->getLeft())
+        and isValidBalance(swarm, node->getRight())) {
+        return true;
+    }
+    return false;
+}
+
+bool Tester::isValidBST(Robot* robot, Robot* left, Robot* right) {
+    if (robot == nullptr) {
+        return true;
+    }
+    if (left != nullptr and robot->getID() <= left->getID()
+        and right != nullptr and robot->getID() >= right->getID()) 
+    {
+        return false;
+    }
+    return (isValidBST(robot->getLeft(), left, right) 
+            and isValidBST(robot->getRight(), robot, right));
+}
+
+//Check that two trees have the same shape, heights and robot data
+bool Tester::isSameTree(Robot* first, Robot* second) {
+    if (first == nullptr or second == nullptr) {
+        return (first == second);
+    }
+    if (first->getID() != second->getID() or first->getHeight() != second->getHeight()
+        or first->getType() != second->getType() or first->getState() != second->getState()) {
+        return false;
+    }
+    return (isSameTree(first->getLeft(), second->getLeft())
+            and isSameTree(first->getRight(), second->getRight()));
+}
+
+bool Tester::find(Robot* robot, int id) {
+    if (robot == nullptr) {
+        return false;
+    }
+    if (robot->getID()== id) {
+        return true;
+    }
+    if (robot->getID() < id) {
+        return find(robot->getRight(), id);
+    }else {
+        return find(robot->getLeft(), id);
+    }
+}
+
+//Test the WAVL rank rule: children are 1 or 2 ranks below their parent and leaves have rank 0
+bool Tester::isValidRank(Swarm& swarm, Robot* robot) {
+    if (robot == nullptr) {
+        return true;
+    }
+    int leftGap = robot->getHeight() - swarm.getNodeHeight(robot->getLeft());
+    int rightGap = robot->getHeight() - swarm.getNodeHeight(robot->getRight());
+    if (leftGap < 1 or leftGap > 2 or rightGap < 1 or rightGap > 2) {
+        return false;
+    }
+    if (robot->getLeft() == nullptr and robot->getRight() == nullptr and robot->getHeight() != 0) {
+        return false;
+    }
+    return (isValidRank(swarm, robot->getLeft()) and isValidRank(swarm, robot->getRight()));
+}
+
+bool Tester::isValidHeight(Robot * robot) {
+    if (robot == nullptr) {
+        return true;
+    }
+    int leftHeight = -1;
+    Robot * left = robot->getLeft();
+    if (left != nullptr) {
+        leftHeight = left->getHeight();
+    }
+    int rightHeight = -1;
+    Robot * right = robot->getRight();
+    if (right != nullptr) {
+        rightHeight = right->getHeight();
+    }
+
+    int height = 1;
+    if (leftHeight > rightHeight) {
+        height += leftHeight;
+    }else {
+        height += rightHeight;
+    }
+
+    if (robot->getHeight() == height) {
+        return (isValidHeight(left) and isValidHeight(right));
+    }
+    return false;
+}
+
+//run random inserts, removes and lookups on tree and check each result and the final
+//id order against a list of the ids that should be present
+template <class Tree>
+bool Tester::isSameAsPresent(Tree& tree, Random& idGen, int operations) {
+    vector<bool> present(1000, false);
+    int count = 0;
+    for (int i = 0; i < operations; i++) {
+        int id = idGen.getRandNum();
+        bool found = (tree.find(id) != nullptr);
+        if (found != present[id]) {
+            return false;
+        }
+        if (i % 3 == 0) {
+            if (tree.remove(id) != present[id]) {
+                return false;
+            }
+            count = count - present[id];
+            present[id] = false;
+        }else {
+            if (tree.insert(Robot(id, SUB)) == present[id]) {
+                return false;
+            }
+            count = count + !present[id];
+            present[id] = true;
+        }
+    }
+    int previous = -1;
+    bool sorted = true;
+    tree.forEach([&](const typename Tree::Node& robot) {
+        sorted = sorted and robot.getKey() > previous and present[robot.getKey()];
+        previous = robot.getKey();
+    });
+    return sorted and tree.size() == count;
+}
+
+//list the id, type and state of every robot in id order for easy comparison
+string Tester::robotsIntoString(const Swarm& swarm) const{
+    vector<Robot*> robots;
+    swarm.findRange(INT_MIN, INT_MAX, robots);
+    string str;
+    for (Robot* robot : robots) {
+        str.append(to_string(robot->getID()) + robot->getTypeStr() + robot->getStateStr() + " ");
+    }
+    return str;
+}
+
+//dump tree contents to a string for easy comparison
+string Tester::dumpTreeIntoString(const Swarm& swarm) const{
+    ostringstream out;
+    swarm.dumpTree(out);
+    return out.str();
 }
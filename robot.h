@@ -0,0 +1,90 @@
+// UMBC - CMSC 341 - Fall 2024 - Proj2
+#ifndef ROBOT_H
+#define ROBOT_H
+#include <string>
+#include "basictree.h"
+using namespace std;
+class Grader;
+class Tester;
+class Swarm;
+enum STATE {ALIVE, DEAD};   // possible states for a robot
+enum ROBOTTYPE {BIRD, DRONE, REPTILE, SUB, QUADRUPED};
+#define DEFAULT_HEIGHT 0
+#define DEFAULT_ID 0
+#define DEFAULT_TYPE DRONE
+#define DEFAULT_STATE ALIVE
+
+class Robot{
+    public:
+    friend class Swarm;
+    friend class Grader;
+    friend class Tester;
+    template <class Key, class Payload, class Compare, class BalancePolicy, class Layout, class Storage>
+    friend class BasicTree;
+    friend struct HeightField;
+    Robot(int id, ROBOTTYPE type = DEFAULT_TYPE, STATE state = DEFAULT_STATE)
+        :m_id(id),m_type(type), m_state(state), m_tombstone(false) {
+            m_left = nullptr;
+            m_right = nullptr;
+            m_height = DEFAULT_HEIGHT;
+            m_accesses = 0;
+        }
+    Robot(){
+        m_id = DEFAULT_ID;
+        m_type = DEFAULT_TYPE;
+        m_state = DEFAULT_STATE;
+        m_tombstone = false;
+        m_left = nullptr;
+        m_right = nullptr;
+        m_height = DEFAULT_HEIGHT;
+        m_accesses = 0;
+    }
+    int getID() const {return m_id;}
+    STATE getState() const {return m_state;}
+    string getStateStr() const {
+        string text = "";
+        switch (m_state)
+        {
+        case DEAD:text = "DEAD";break;
+        case ALIVE:text = "ALIVE";break;
+        default:text = "UNKOWN";break;
+        }
+        return text;
+    }
+    ROBOTTYPE getType() const {return m_type;}
+    string getTypeStr() const {
+        string text = "";
+        switch (m_type)
+        {
+        case BIRD:text = "BIRD";break;
+        case DRONE:text = "DRONE";break;
+        case REPTILE:text = "REPTILE";break;
+        case SUB:text = "SUB";break;
+        case QUADRUPED:text = "QUADRUPED";break;
+        default:text = "UNKNOWN";break;
+        }
+        return text
+        ;
+    }
+    int getHeight() const {return m_height;}
+    bool isTombstone() const {return m_tombstone;}
+    int getAccesses() const {return m_accesses;}
+    Robot* getLeft() const {return m_left;}
+    Robot* getRight() const {return m_right;}
+    void setID(const int id){m_id=id;}
+    void setState(STATE state){m_state=state;}
+    void setType(ROBOTTYPE type){m_type=type;}
+    void setHeight(int height){m_height=height;}
+    void setLeft(Robot* left){m_left=left;}
+    void setRight(Robot* right){m_right=right;}
+    private:
+    int m_id;
+    ROBOTTYPE m_type;
+    STATE m_state;
+    bool m_tombstone;   //true once the robot is removed lazily, until the next compaction
+    Robot* m_left;  //the pointer to the left child in the BST
+    Robot* m_right; //the pointer to the right child in the BST
+    int m_height;   //the height of this node in the BST 
+    int m_accesses; //finds of this robot while access counting is on
+};
+#endif
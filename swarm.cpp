@@ -1,5 +1,18 @@
 // UMBC - CMSC 341 - Fall 2024 - Proj2
 #include "swarm.h"
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
@@ -8,7 +21,16 @@ The default constructor performs the required initializations.
 It creates an empty object. 
 It also sets the type of the tree to NONE.
 */
-Swarm::Swarm(): m_root(nullptr), m_type(NONE){}
+Swarm::Swarm(): m_root(nullptr), m_type(NONE), m_tree(in_place_type<RobotTree<BSTPolicy>>, this), m_count(0), m_freeList(nullptr),
+    m_nextBlockSize(POOLBLOCKSIZE), m_poolSlots(0), m_memoryBudget(0), m_counting(false), m_frozen(false), m_frozenLayout(EYTZINGER),
+    m_logging(false), m_logGroupSize(LOGGROUPSIZE), m_adaptive(false), m_adaptTotal(0),
+    m_cacheShift(32), m_cacheHits(0), m_cacheMisses(0), m_lazyDelete(false),
+    m_tombstoneRatio(TOMBSTONERATIO), m_tombstones(0), m_convertOld(nullptr), m_convertBudget(0),
+    m_spatial(nullptr){
+#ifdef SWARM_TRACE
+    m_traceNext = 0;
+#endif
+}
 
 
 /*
@@ -19,7 +41,17 @@ It also specifies the type of the tree.
     - It can be an AVL tree which re-balances the tree after every insertion or removal. 
     - The third type is a Splay tree which splays the accessed node to the tree root.
 */
-Swarm::Swarm(TREETYPE type): m_root(nullptr), m_type(type){}
+Swarm::Swarm(TREETYPE type): m_root(nullptr), m_type(type), m_tree(in_place_type<RobotTree<BSTPolicy>>, this), m_count(0), m_freeList(nullptr),
+    m_nextBlockSize(POOLBLOCKSIZE), m_poolSlots(0), m_memoryBudget(0), m_counting(false), m_frozen(false), m_frozenLayout(EYTZINGER),
+    m_logging(false), m_logGroupSize(LOGGROUPSIZE), m_adaptive(false), m_adaptTotal(0),
+    m_cacheShift(32), m_cacheHits(0), m_cacheMisses(0), m_lazyDelete(false),
+    m_tombstoneRatio(TOMBSTONERATIO), m_tombstones(0), m_convertOld(nullptr), m_convertBudget(0),
+    m_spatial(nullptr){
+#ifdef SWARM_TRACE
+    m_traceNext = 0;
+#endif
+    useType(type);
+}
 
 
 /*
@@ -27,29 +59,101 @@ The destructor performs the required cleanup including
 memory deallocations and re-initializing.
 */
 Swarm::~Swarm(){
+    closeLog();
     clear();
+    delete m_spatial;
 }
 
 
 /*
 The clear function deallocates all memory in the tree and makes it an empty tree.
+Every node lives in one of the pool blocks, so releasing the blocks releases the tree.
 */
 void Swarm::clear(){
-    recursiveClear(m_root); 
+    thaw();
+    for (Robot* block : m_blocks) {
+        delete [] block;
+    }
+    m_blocks.clear();
+    fill(m_cache.begin(), m_cache.end(), nullptr);
+    m_root = nullptr;
+    m_bplus.clear();
+    m_convertOld = nullptr;
+    m_convertPath.clear();
+    m_count = 0;
+    m_tombstones = 0;
+    m_freeList = nullptr;
+    m_nextBlockSize = POOLBLOCKSIZE;
+    m_poolSlots = 0;
+    if (m_spatial != nullptr) {
+        m_spatial->clear();
+    }
 }
 
 
-/*
-Recursively delete left and right children
-*/
-void Swarm::recursiveClear(Robot* robot) {
-      if (robot == nullptr) {
-        return;
-      }
-      recursiveClear(robot->getLeft());
-      recursiveClear(robot->getRight());
-      delete robot;
-      robot = nullptr;
+//Take a node from the pool and initialize it in place with id, type and state
+Robot* Swarm::allocateNode(int id, ROBOTTYPE type, STATE state) {
+    if (m_freeList == nullptr) {
+        //pool is empty, add a block and chain its nodes into the free list,
+        //a smaller block fills the rest of a memory budget
+        int size = (int)max(1LL, min((long long)m_nextBlockSize, budgetSlots()));
+        Robot* block = allocateBlock(size);
+        for (int i = 0; i < size; i++) {
+            block[i].setLeft(m_freeList);
+            m_freeList = &block[i];
+        }
+        if (m_nextBlockSize < MAXPOOLBLOCKSIZE) {
+            m_nextBlockSize = m_nextBlockSize * 2;
+        }
+    }
+    Robot* node = m_freeList;
+    m_freeList = node->getLeft();
+    node->m_id = id;
+    node->m_type = type;
+    node->m_state = state;
+    node->m_tombstone = false;
+    node->m_left = nullptr;
+    node->m_right = nullptr;
+    node->m_height = DEFAULT_HEIGHT;
+    node->m_accesses = 0;
+    m_count++;
+    return node;
+}
+
+
+//Return a node to the pool so a later insertion can reuse it
+void Swarm::releaseNode(Robot* robot) {
+    m_count--;
+    if (robot->m_tombstone) {
+        m_tombstones--;
+    }
+    if (!m_cache.empty() and m_cache[cacheSlot(robot->getID())] == robot) {
+        m_cache[cacheSlot(robot->getID())] = nullptr;
+    }
+    if (m_spatial != nullptr) {
+        m_spatial->erase(robot);
+    }
+    robot->setRight(nullptr);
+    robot->setLeft(m_freeList);
+    m_freeList = robot;
+}
+
+
+//Allocate a contiguous block of count nodes owned by this swarm
+Robot* Swarm::allocateBlock(int count) {
+    Robot* block = new Robot[count];
+    m_blocks.push_back(block);
+    m_poolSlots = m_poolSlots + count;
+    return block;
+}
+
+
+//Nodes the pool may still add under the memory budget, LLONG_MAX without a budget
+long long Swarm::budgetSlots() const{
+    if (m_memoryBudget == 0) {
+        return LLONG_MAX;
+    }
+    return max(0LL, (m_memoryBudget - m_poolSlots * (long long)sizeof(Robot)) / (long long)sizeof(Robot));
 }
 
 
@@ -80,240 +184,188 @@ Note:
     updating the node heights.
 */
 void Swarm::insert(const Robot& robot){
-    Robot * newRobot = new Robot(robot);
-    if (m_root == nullptr) {
-        //set new node to root
-        m_root = newRobot;
-        return;
-    }
-    if (m_type == BST) {
-        m_root = insertBST(m_root, newRobot);
-    }else if (m_type == AVL) {
-        m_root = insertAVL(m_root, newRobot);
-    }else if (m_type == SPLAY) {
-        m_root = insertSplay(m_root, newRobot);
-    }
+    emplace(robot.getID(), robot.getType(), robot.getState());
 }
 
 
-//insert a binary search
-Robot* Swarm::insertBST(Robot *root, Robot *robot) {
-    if (root == nullptr) {
-        return robot;
-    }else if (robot->getID() < root->getID()) {
-        root->setLeft(insertBST(root->getLeft(), robot));
-    }else if (robot->getID() > root->getID()) {
-        root->setRight(insertBST(root->getRight(), robot));
-    }else {
-        return root;
-    }
-    //recalculate height
-    int height = recalculateHeight(root);
-    root->setHeight(height);
-    return root;
-
+/*
+Inserts a copy of robot like insert and returns the node of its id together with
+whether the robot was added. For a duplicate id the node already in the tree is
+returned and nothing is allocated.
+*/
+pair<Robot*, bool> Swarm::tryInsert(const Robot& robot){
+    return emplace(robot.getID(), robot.getType(), robot.getState());
 }
 
 
-//insert a AVL
-Robot* Swarm::insertAVL(Robot *root, Robot *robot) {
-    if (root == nullptr) {
-        return robot;
-    }else if (robot->getID() < root->getID()) {
-        root->setLeft(insertAVL(root->getLeft(), robot));
-    }else if (robot->getID() > root->getID()) {
-        root->setRight(insertAVL(root->getRight(), robot));
-    }else {
-        return root;
+/*
+Inserts robots as if insert was called for each of them in order and returns how
+many were added, added[i] is set to whether robots[i] was. A batch of at least
+LOGBULKRUN robots that is not small next to the tree is merged with the tree in
+one O(n + m log m) pass and the tree is relinked balanced, like replay does;
+smaller batches, a NONE tree and a swarm with a memory budget insert one by one.
+*/
+int Swarm::insertBatch(const vector<Robot>& robots, vector<bool>& added){
+    int size = (int)robots.size();
+    added.assign(size, false);
+    int count = 0;
+    if (m_type == NONE or m_memoryBudget > 0 or size < LOGBULKRUN
+        or (long long)size * BATCHMERGERATIO < m_count) {
+        for (int i = 0; i < size; i++) {
+            added[i] = emplace(robots[i].getID(), robots[i].getType(), robots[i].getState()).second;
+            count += added[i];
+        }
+        return count;
     }
-
-    //recalculate height
-    int height = recalculateHeight(root);
-    root->setHeight(height);
-
-    //Get balance and if outside of range of -1,0,1, rebalance the tree
-    root = rebalance(root);
-    return root;
-}
-
-
-//insert a splay
-Robot* Swarm::insertSplay(Robot *root, Robot *robot) {
-    if (root == nullptr) {
-        return robot;
-    }else {
-        //Splay the root
-        root = splay(root, robot->getID());
-        //check id 
-        if (root->getID() == robot->getID()) {
-            delete robot;
-            return root;
-        }
-        //fix the root
-        if (root->getID() < robot->getID()) {
-            //left child is now the root
-            robot->setLeft(root);
-            //right child is now the root's right child
-            robot->setRight(root->getRight());
-            //right child is now null
-            root->setRight(nullptr);
-
-        }else if (root->getID() > robot->getID()) {
-            //right child is now the root
-            robot->setRight(root);
-            //left child is now the root's left child
-            robot->setLeft(root->getLeft());
-            //left child is now null
-            root->setLeft(nullptr);
-        }
-        //recalculate height
-        int height = recalculateHeight(robot);
-        robot->setHeight(height);
+    thaw();
+    finishConversion();
+    if (m_logging) {
+        for (const Robot& robot : robots) {
+            appendLog(LOGINSERT, robot.getID(), robot.getType() | (robot.getState() << 3));
+        }
     }
-    return robot;
-}
-
-
-//Maintain's AVL tree balance after insert/delete action
-Robot * Swarm::rebalance(Robot * robot) {
-    if (robot == nullptr) {
-        return robot;
+    //walk the batch in id order next to the tree, the first robot of an id that
+    //is not in the tree (or only as a tombstone) is the one that is added
+    vector<int> order(size);
+    for (int i = 0; i < size; i++) {
+        order[i] = i;
     }
-
-    Robot * left = robot->getLeft();
-    Robot * right = robot->getRight();
-    int balance = getBalance(robot);
-
-    if (balance > 1) {
-        int leftBalance = getBalance(left);
-        if (leftBalance > 0) {
-            robot->setLeft(leftRotate(left));
-            return rightRotate(robot);
-        }else {
-            return rightRotate(robot);
+    stable_sort(order.begin(), order.end(), [&robots](int a, int b) {
+        return robots[a].getID() < robots[b].getID();
+    });
+    vector<Robot*> nodes;
+    collectTree(nodes);
+    vector<Robot> inserts;
+    size_t next = 0;
+    for (int k = 0; k < size; k++) {
+        int id = robots[order[k]].getID();
+        if (k > 0 and robots[order[k - 1]].getID() == id) {
+            continue;
         }
-    }else if (balance < -1) {
-        int rightBalance = getBalance(right);
-        if (rightBalance > 0) {
-            robot->setRight(rightRotate(right));
-            return leftRotate(robot);
-        }else {
-            return leftRotate(robot);
+        while (next < nodes.size() and nodes[next]->getID() < id) {
+            next++;
         }
+        if (next < nodes.size() and nodes[next]->getID() == id and !nodes[next]->m_tombstone) {
+            continue;
+        }
+        added[order[k]] = true;
+        inserts.push_back(robots[order[k]]);
+        count++;
     }
-    return robot;
+    if (!inserts.empty()) {
+        mergeInserts(inserts);
+    }
+    return count;
 }
 
 
-//Reorganize tree to bring key node to the root
-Robot* Swarm::splay(Robot * robot, int id) {
-    if (robot == nullptr or robot->getID() == id) {
-        //root is already splayed
-        return robot;
+/*
+Removes the robots of ids as if remove was called for each of them in order and
+returns how many were removed, removed[i] is set to whether ids[i] was. Like
+insertBatch a large batch is applied in one pass over the nodes in id order and
+the tree is relinked balanced. SPLAY and NONE trees, the lazy delete mode and
+small batches remove one by one.
+*/
+int Swarm::removeBatch(const vector<int>& ids, vector<bool>& removed){
+    int size = (int)ids.size();
+    removed.assign(size, false);
+    int count = 0;
+    if (m_type == NONE or m_type == SPLAY or m_lazyDelete or size < LOGBULKRUN
+        or (long long)size * BATCHMERGERATIO < m_count) {
+        for (int i = 0; i < size; i++) {
+            int before = this->size();
+            remove(ids[i]);
+            removed[i] = this->size() < before;
+            count += removed[i];
+        }
+        return count;
     }
-    //key is in left tree
-    if (id < robot->getID()) {
-        Robot * left = robot->getLeft();
-        if (left == nullptr) {
-            //id not in tree
-            return robot;
-        }
-        if (left->getID() > id) {
-            //Zig-Zig (Left-Left rotation, splay node that is left child of its parent) 
-            left->setLeft(splay(left->getLeft(), id));
-            robot = rightRotate(robot);
-        }else if (left->getID() < id) {
-            //Zig-Zag (Left-Right rotation, splay node is right child of its parent)
-            left->setRight(splay(left->getRight(), id));
-            if (left->getRight() != nullptr) {
-                left = leftRotate(left);
-            }
-        }
-        if (left == nullptr) {
-            return robot;
-        }else {
-            return rightRotate(robot);
-        }
-    }else if (id > robot->getID()){
-        //key is in right tree
-        Robot * right = robot->getRight();
-        if (right == nullptr) {
-            return robot;
-        }
-        //Zag-Zig (Right-Right rotation, splay node is right child of its parent)
-        if (right->getID() > id) {
-            right->setLeft(splay(right->getLeft(), id));
-            if (right->getLeft() != nullptr) {
-                right = rightRotate(right);
-            }
-        }else if (right->getID() < id) {
-            //Zag-Zig (Right-Left rotation, splay node is left child of its parent)
-            right->setRight(splay(right->getRight(), id));
-            if (right->getRight() != nullptr) {
-                robot = leftRotate(robot);
-            }            
-        }
-        if (right == nullptr) {
-            return robot;
-        }else {
-            return leftRotate(robot);
-        }        
+    thaw();
+    finishConversion();
+    if (m_logging) {
+        for (int id : ids) {
+            appendLog(LOGREMOVE, id, 0);
+        }
     }
-    return nullptr;
-}
-
-
-//Right rotation needed when the left subtree is taller than right subtree and is out of balance
-Robot * Swarm::rightRotate(Robot* robot) {
-    Robot * left = robot->getLeft();
-    if (left != nullptr) {
-        Robot * leftToRight = left->getRight();
-        left->setRight(robot);
-        robot->setLeft(leftToRight);
-        //recalculate height
-        int leftHeight = getNodeHeight(robot->getLeft());
-        int rightHeight = getNodeHeight(robot->getRight());
-        if (leftHeight <= rightHeight) {
-            robot->setHeight(rightHeight + 1);
-        }else {
-            robot->setHeight(leftHeight + 1);
+    vector<int> order(size);
+    for (int i = 0; i < size; i++) {
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&ids](int a, int b) {
+        return ids[a] < ids[b];
+    });
+    //the first of repeated ids removes the node, a tombstone is released uncounted
+    vector<Robot*> nodes;
+    collectTree(nodes);
+    vector<Robot*> kept;
+    kept.reserve(nodes.size());
+    int next = 0;
+    for (Robot* node : nodes) {
+        while (next < size and ids[order[next]] < node->getID()) {
+            next++;
         }
-        leftHeight = getNodeHeight(left->getLeft());
-        rightHeight = getNodeHeight(left->getRight());
-        if (leftHeight <= rightHeight) {
-            left->setHeight(rightHeight + 1);
+        if (next < size and ids[order[next]] == node->getID()) {
+            removed[order[next]] = !node->m_tombstone;
+            count += removed[order[next]];
+            releaseNode(node);
         }else {
-            left->setHeight(leftHeight + 1);
+            kept.push_back(node);
         }
     }
-    return left;
+    linkTree(kept, forkDepth(0));
+    return count;
 }
 
 
-//Left rotation needed when the right subtree is taller than left subtree and is out of balance
-Robot * Swarm::leftRotate(Robot* robot) {
-    Robot * right = robot->getRight();
-    if (right != nullptr) {
-        Robot * rightToLeft = right->getLeft();
-        right->setLeft(robot);
-        robot->setRight(rightToLeft);
-        //recalculate height
-        int leftHeight = getNodeHeight(robot->getLeft());
-        int rightHeight = getNodeHeight(robot->getRight());
-        if (leftHeight <= rightHeight) {
-            robot->setHeight(rightHeight + 1);
-        }else {
-            robot->setHeight(leftHeight + 1);
-        }
-        leftHeight = getNodeHeight(right->getLeft());
-        rightHeight = getNodeHeight(right->getRight());
-        if (leftHeight <= rightHeight) {
-            right->setHeight(rightHeight + 1);
-        }else {
-            right->setHeight(leftHeight + 1);
+/*
+Inserts a robot with id, type and state, initializing the node taken from the
+pool in place instead of copying a caller's Robot. The node is only taken at the
+empty link the search ends on, so
+a duplicate id costs no allocation; the node already holding the id is returned
+with false. In a SPLAY tree the node of the id is splayed to the root either way.
+A tree of type NONE only accepts a robot while it is empty, otherwise nullptr and
+false are returned. A tombstoned node of the id (setLazyDelete) is revived with
+type and state, which counts as adding the robot. Once the pool has no free node
+and the memory budget (setMemoryBudget) is used up, a new id is rejected with
+nullptr and false.
+*/
+pair<Robot*, bool> Swarm::emplace(int id, ROBOTTYPE type, STATE state){
+    SWARM_TRACE_SCOPE(TRACEINSERT, id);
+    if (m_adaptive) {
+        noteAccess(id, true, false);
+    }
+    thaw();
+    if (m_freeList == nullptr and budgetSlots() == 0 and getRobotAtThisID(id) == nullptr) {
+        return make_pair(nullptr, false);
+    }
+    if (m_logging) {
+        appendLog(LOGINSERT, id, type | (state << 3));
+    }
+    pair<Robot*, bool> result(nullptr, false);
+    if (m_convertOld != nullptr) {
+        step(m_convertBudget);
+        result.first = findOld(id);
+    }
+    if (result.first != nullptr) {
+        //the id is in the tree an incremental setType has not migrated yet
+    }else if (m_type == BPTREE) {
+        SWARM_ADD(comparisons, m_bplus.height() + 1);
+        Robot** slot = m_bplus.insert(id, result.second);
+        if (result.second) {
+            *slot = allocateNode(id, type, state);
         }
+        result.first = *slot;
+    }else if (m_type != NONE or m_root == nullptr) {
+        result = visit([&](auto& tree) { return tree.emplace(id, type, state); }, m_tree);
     }
-    return right;
+    if (!result.second and result.first != nullptr and result.first->m_tombstone) {
+        result.first->m_tombstone = false;
+        result.first->setType(type);
+        result.first->setState(state);
+        m_tombstones--;
+        result.second = true;
+    }
+    return result;
 }
 
 
@@ -321,67 +373,112 @@ Robot * Swarm::leftRotate(Robot* robot) {
 Traverses the tree to find a node with the id and removes it from the tree. 
 If the tree type is SPLAY, the remove function does not remove the node. 
 In the case of BST or AVL tree the remove function should also update the heights for all nodes in the removal path.
+With lazy deletion on (setLazyDelete) a BST, AVL or WAVL tree only marks the node as
+a tombstone, the shape and a frozen layout are kept until the next compaction.
+During an incremental setType a robot that is not migrated yet is tombstoned too.
 */
 void Swarm::remove(int id){
-    if (m_root != nullptr) {
-        if (m_type == SPLAY) {
-            //splay it
-            m_root = splay(m_root, id);
-            //do not remove the node
-        }else {
-            //for BST and AVL remove 
-            m_root = removeRobotNode(m_root, id);
-            if (m_type == AVL) {
-                m_root = rebalance(m_root);
-            }        
+    SWARM_TRACE_SCOPE(TRACEREMOVE, id);
+    if (m_adaptive) {
+        noteAccess(id, true, true);
+    }
+    if (m_convertOld != nullptr) {
+        step(m_convertBudget);
+    }
+    //a node that is not migrated yet is released when it is migrated
+    if ((m_lazyDelete and (m_type == BST or m_type == AVL or m_type == WAVL))
+        or (m_convertOld != nullptr and findOld(id) != nullptr)) {
+        if (m_logging) {
+            appendLog(LOGREMOVE, id, 0);
+        }
+        markTombstone(id);
+        return;
+    }
+    thaw();
+    if (m_logging) {
+        appendLog(LOGREMOVE, id, 0);
+    }
+    if (m_type == BPTREE) {
+        SWARM_ADD(comparisons, m_bplus.height() + 1);
+        Robot* robot = m_bplus.erase(id);
+        if (robot != nullptr) {
+            releaseNode(robot);
         }
+    }else if (m_type == SPLAY) {
+        //splay it, do not remove the node
+        get<RobotTree<SplayPolicy>>(m_tree).find(id);
+    }else {
+        //for BST, AVL and WAVL remove, a node with two children is replaced by its successor
+        visit([id](auto& tree) { tree.remove(id); }, m_tree);
     }
 }
 
 
-//Remove a node by its id
-Robot* Swarm::removeRobotNode(Robot * robot, int id) {
-    if (robot == nullptr) {
-        return nullptr;
+/*
+Sets the state of the robot with the id and returns true, or returns false if there
+is no such robot. The tree is searched without splaying since the shape and the
+frozen layout do not depend on the state.
+*/
+bool Swarm::setState(int id, STATE state){
+    if (m_convertOld != nullptr) {
+        step(m_convertBudget);
     }
-    
-    //Traverse and find the id to remove
-    if (id < robot->getID()) {
-        robot->setLeft(removeRobotNode(robot->getLeft(), id));
-    }else if (id > robot->getID()) {
-        robot->setRight(removeRobotNode(robot->getRight(), id));
-    }else{
-        //found id
-        if (robot->getLeft() == nullptr) {
-            Robot* next = robot->getRight();
-            delete robot;
-            return next;
-        }else if (robot->getRight() == nullptr) {
-            Robot* next = robot->getLeft();
-            delete robot;
-            return next;
-        }
-    }
-    //recalculate height
-    int height = recalculateHeight(robot);
-    robot->setHeight(height);
-    return robot;
+    Robot* robot = getRobotAtThisID(id);
+    if (robot == nullptr or robot->m_tombstone) {
+        return false;
+    }
+    if (m_logging) {
+        appendLog(LOGSETSTATE, id, state);
+    }
+    robot->setState(state);
+    return true;
 }
 
 
 //Overloads the assignment operator for the class Swarm. 
-//It creates an exact deep copy of the rhs.
+//It creates an exact deep copy of the rhs, together with its settings: the memory
+//budget, the cache size, lazy deletion, the adaptive mode, the conversion budget,
+//access counting and the spatial index. The log and the statistics are not copied.
 const Swarm & Swarm::operator=(const Swarm & rhs){
     if (this == &rhs) {
         return *this;
     }
     clear();
-    m_type = rhs.m_type;
+    useType(rhs.m_type);
+    m_memoryBudget = rhs.m_memoryBudget;
+    m_counting = rhs.m_counting;
+    m_lazyDelete = rhs.m_lazyDelete;
+    m_tombstoneRatio = rhs.m_tombstoneRatio;
+    m_convertBudget = rhs.m_convertBudget;
+    setCache((int)rhs.m_cache.size());
+    setAdaptive(rhs.m_adaptive, (int)rhs.m_adaptWindow.size() * ADAPTSAMPLE);
     if (rhs.m_root != nullptr) {
         m_root = deepCopy(rhs.m_root);
     }else {
         m_root = nullptr;
     }
+    if (rhs.m_type == BPTREE) {
+        //copy the robots in id order and load them into a new B+ tree
+        vector<Robot*> nodes;
+        rhs.m_bplus.collect(nodes);
+        for (Robot*& robot : nodes) {
+            Robot* copy = allocateNode(robot->getID(), robot->getType(), robot->getState());
+            copy->m_accesses = robot->m_accesses;
+            robot = copy;
+        }
+        m_bplus.build(nodes);
+    }
+    //an unfinished incremental setType goes on in the copy, its path is found again from the root
+    m_convertOld = deepCopy(rhs.m_convertOld);
+    //the positions are copied too, every entry is pointed at the copy of its robot
+    delete m_spatial;
+    m_spatial = nullptr;
+    if (rhs.m_spatial != nullptr) {
+        m_spatial = new SpatialIndex(*rhs.m_spatial);
+        m_spatial->remap([this](Robot* robot) {
+            return getRobotAtThisID(robot->getID());
+        });
+    }
     return *this;
 }
 
@@ -392,7 +489,7 @@ Robot* Swarm::deepCopy(Robot* robot) {
         return nullptr;
     }
     //Copy current 
-    Robot * newRobot = new Robot(robot->getType());
+    Robot * newRobot = allocateNode(robot->getID(), robot->getType(), robot->getState());
     Robot * left = robot->getLeft();
     newRobot->setLeft(deepCopy(left));
     Robot * right = robot->getRight();
@@ -401,6 +498,12 @@ Robot* Swarm::deepCopy(Robot* robot) {
     newRobot->setID(robot->getID());
     newRobot->setType(robot->getType());
     newRobot->setState(robot->getState());
+    newRobot->setHeight(robot->getHeight());
+    newRobot->m_accesses = robot->m_accesses;
+    if (robot->m_tombstone) {
+        newRobot->m_tombstone = true;
+        m_tombstones++;
+    }
 
     return newRobot;
 }
@@ -432,23 +535,71 @@ Once the type is changed, the function should re-structure the tree according to
 4.
     Any changes to NONE will clear the tree and removes all 
     the nodes.
+5.
+    Changing from BST or SPLAY to WAVL reconstructs the tree 
+    like a change to AVL, an AVL tree is already a WAVL tree. 
+    Changing from WAVL to BST or SPLAY recomputes the heights 
+    from the ranks without moving any node.
+6.
+    With a conversion budget (setConversionBudget) a 
+    reconstruction is incremental, see step. A conversion 
+    still in progress is finished first.
+7.
+    Changing to or from BPTREE moves the nodes between the 
+    B+ tree and a balanced binary tree at once, which is a 
+    valid tree of every other type. Tombstones are released.
 */
 void Swarm::setType(TREETYPE type){
+ SWARM_TRACE_SCOPE(TRACESETTYPE, type);
+ finishConversion();
+ thaw();
+ if (m_logging) {
+    appendLog(LOGSETTYPE, 0, type);
+ }
  if (type == m_type) {
     //no change
     return;
  }
  if (type == NONE) {
     clear();
-    m_type = NONE;
+    useType(NONE);
  }
- if (type == AVL) {
-    //reconstruct tree as AVL
+ if (type == BPTREE or m_type == BPTREE) {
+    vector<Robot*> nodes;
+    collectTree(nodes);
+    dropTombstones(nodes);
+    useType(type);
+    linkTree(nodes, 0);
+ }else if ((type == AVL or (type == WAVL and m_type != AVL)) and m_convertBudget > 0 and m_root != nullptr) {
+    //the nodes move to the new tree a few at a time, starting from an empty one
+    m_convertOld = m_root;
+    m_root = nullptr;
+ }else if (type == AVL or (type == WAVL and m_type != AVL)) {
+    //reconstruct tree as AVL, an AVL tree is also a WAVL tree whose ranks are its heights
+    useType(AVL);
     reconstructAVL();
- }else {
-    //changing from AVL to BST or SPLAY, no need to reconstruct
+ }else if (m_type == WAVL) {
+    //ranks of a WAVL tree can exceed the heights, BST and SPLAY keep real heights
+    recalculateHeight(m_root);
+ }
+ //changing from AVL to BST, SPLAY or WAVL needs no reconstruction, and a
+ //reconstructed tree takes the new type here as well
+ useType(type);
+}
+
+
+//Set the type and the tree that runs its operations, NONE and BPTREE keep the BST one
+void Swarm::useType(TREETYPE type){
     m_type = type;
- } 
+    if (type == AVL) {
+        m_tree.emplace<RobotTree<AVLPolicy>>(this);
+    }else if (type == SPLAY) {
+        m_tree.emplace<RobotTree<SplayPolicy>>(this);
+    }else if (type == WAVL) {
+        m_tree.emplace<RobotTree<WAVLPolicy>>(this);
+    }else {
+        m_tree.emplace<RobotTree<BSTPolicy>>(this);
+    }
 }
 
 // Function to get the height of a node
@@ -475,6 +626,7 @@ int Swarm::recalculateHeight(Robot* robot) {
     if (robot == nullptr) {
         return -1;
     }
+    SWARM_COUNT(heightUpdates);
 
     int leftHeight = recalculateHeight(robot->getLeft());
     int rightHeight = recalculateHeight(robot->getRight());
@@ -489,40 +641,2919 @@ int Swarm::recalculateHeight(Robot* robot) {
     return height;
 }
 
-//Get nodes fom tree in order
+//Set the height of a node from the cached heights of its children
+void Swarm::updateHeight(Robot* robot) {
+    SWARM_COUNT(heightUpdates);
+    int leftHeight = getNodeHeight(robot->getLeft());
+    int rightHeight = getNodeHeight(robot->getRight());
+    if (leftHeight > rightHeight) {
+        robot->setHeight(leftHeight + 1);
+    }else {
+        robot->setHeight(rightHeight + 1);
+    }
+}
+
+//Get nodes fom tree in order and insert them into a new AVL tree one by one
+//The nodes are transferred, there is no reallocation of memory
 void Swarm::reconstructAVL() {
-    Robot *newRoot = nullptr;
-    transferNodes(m_root, newRoot);
-    m_root = newRoot;
+    vector<Robot*> nodes;
+    collectNodes(m_root, nodes);
+    dropTombstones(nodes);
+    m_root = nullptr;
+    for (Robot* robot : nodes) {
+        attachNode(robot);
+    }
+}
+
+//Append the nodes of the tree to nodes in order
+void Swarm::collectNodes(Robot* robot, vector<Robot*>& nodes) {
+    if (robot == nullptr) {
+        return;
+    }
+    collectNodes(robot->getLeft(), nodes);
+    nodes.push_back(robot);
+    collectNodes(robot->getRight(), nodes);
+}
+
+//Append the nodes of the B+ tree or of the binary tree to nodes in order
+void Swarm::collectTree(vector<Robot*>& nodes) {
+    if (m_type == BPTREE) {
+        m_bplus.collect(nodes);
+    }else {
+        collectNodes(m_root, nodes);
+    }
+}
+
+//Link the sorted nodes into a B+ tree for BPTREE, a balanced binary tree otherwise
+void Swarm::linkTree(vector<Robot*>& nodes, int depth) {
+    if (m_type == BPTREE) {
+        //the leaves hold the nodes, their links are not used
+        for (Robot* robot : nodes) {
+            robot->setLeft(nullptr);
+            robot->setRight(nullptr);
+            robot->setHeight(DEFAULT_HEIGHT);
+        }
+        m_root = nullptr;
+        m_bplus.build(nodes);
+    }else {
+        m_bplus.clear();
+        m_root = linkBalanced(nodes, 0, (int)nodes.size() - 1, depth);
+    }
+}
+
+/*
+Links nodes[low..high], which are sorted by id, into a balanced tree and returns its root.
+The middle node becomes the root, so the heights of two sibling subtrees differ by
+at most one and the result satisfies the AVL property.
+While depth is positive the left subtree is built on a new thread and the right one on
+the current thread. The two halves touch disjoint nodes so no locking is needed.
+*/
+Robot* Swarm::linkBalanced(vector<Robot*>& nodes, int low, int high, int depth) {
+    if (low > high) {
+        return nullptr;
+    }
+    int mid = low + (high - low) / 2;
+    Robot* root = nodes[mid];
+    Robot* left = nullptr;
+    Robot* right = nullptr;
+    if (depth > 0 and high - low + 1 >= PARALLELCUTOFF) {
+        thread worker([&]() {
+            left = linkBalanced(nodes, low, mid - 1, depth - 1);
+        });
+        right = linkBalanced(nodes, mid + 1, high, depth - 1);
+        worker.join();
+    }else {
+        left = linkBalanced(nodes, low, mid - 1, 0);
+        right = linkBalanced(nodes, mid + 1, high, 0);
+    }
+    root->setLeft(left);
+    root->setRight(right);
+    updateHeight(root);
+    return root;
+}
+
+//Sort robots by id. Chunks are sorted on separate threads and then merged pairwise.
+//The sort is stable, so among robots sharing an id the first one stays first.
+void Swarm::parallelSort(vector<Robot>& robots) {
+    auto byID = [](const Robot& a, const Robot& b) {
+        return a.getID() < b.getID();
+    };
+    int size = (int)robots.size();
+    int chunks = (int)thread::hardware_concurrency();
+    if (chunks < 2 or size < PARALLELCUTOFF) {
+        stable_sort(robots.begin(), robots.end(), byID);
+        return;
+    }
+    //chunk boundaries, chunk i is [bounds[i], bounds[i+1])
+    vector<int> bounds;
+    for (int i = 0; i <= chunks; i++) {
+        bounds.push_back((int)((long long)size * i / chunks));
+    }
+    vector<thread> workers;
+    for (int i = 0; i < chunks; i++) {
+        workers.push_back(thread([&robots, &bounds, byID, i]() {
+            stable_sort(robots.begin() + bounds[i], robots.begin() + bounds[i + 1], byID);
+        }));
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    //merge neighbouring sorted runs until one run is left, each round on all cores
+    for (int width = 1; width < chunks; width = width * 2) {
+        workers.clear();
+        for (int i = 0; i + width < chunks; i = i + 2 * width) {
+            int first = bounds[i];
+            int middle = bounds[i + width];
+            int last = bounds[min(i + 2 * width, chunks)];
+            workers.push_back(thread([&robots, byID, first, middle, last]() {
+                inplace_merge(robots.begin() + first, robots.begin() + middle,
+                              robots.begin() + last, byID);
+            }));
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+    }
 }
 
-//Move nodes to an AVL tree
-void Swarm::transferNodes(Robot* root, Robot*& newRoot) {
-    if (root == nullptr) {
+/*
+Replaces the contents of the swarm with robots and sets the tree type to type.
+The robots do not need to be sorted. They are sorted by id on all cores, robots
+with a duplicate id after the first one are dropped, the nodes are allocated as
+one contiguous block and linked as a balanced tree (the left and right subtrees
+are built concurrently). The result satisfies the AVL property for every type,
+so no rebalancing is needed afterwards. A BPTREE is bulk loaded instead.
+If the type is NONE the swarm is left empty, as with setType(NONE).
+*/
+void Swarm::buildFrom(vector<Robot> robots, TREETYPE type) {
+    clear();
+    useType(type);
+    if (type == NONE or robots.empty()) {
         return;
     }
-    transferNodes(root->getLeft(), newRoot);
-    Robot * right = root->getRight();
-    //disconnect child nodes
-    root->setLeft(nullptr);
-    root->setRight(nullptr);
-    newRoot = insertAVL(newRoot, root);
-    transferNodes(right, newRoot);
+    parallelSort(robots);
+    auto sameID = [](const Robot& a, const Robot& b) {
+        return a.getID() == b.getID();
+    };
+    robots.erase(unique(robots.begin(), robots.end(), sameID), robots.end());
+
+    int size = (int)robots.size();
+    Robot* block = allocateBlock(size);
+    m_count = size;
+    vector<Robot*> nodes(size);
+    for (int i = 0; i < size; i++) {
+        block[i] = Robot(robots[i].getID(), robots[i].getType(), robots[i].getState());
+        nodes[i] = &block[i];
+    }
+    linkTree(nodes, forkDepth(0));
+}
+
+//Number of tree levels that fork work onto a new thread so that about threads
+//subtrees run at once. A threads value of 0 means one per core.
+int Swarm::forkDepth(unsigned int threads) {
+    if (threads == 0) {
+        threads = thread::hardware_concurrency();
+    }
+    int depth = 0;
+    for (unsigned int count = 1; count < threads; count = count * 2) {
+        depth++;
+    }
+    return depth;
 }
 
 //Print contents of the tree
 void Swarm::dumpTree() const 
 {
-    dump(m_root);
+    dumpTree(cout);
+}
+
+/*
+Writes the tree to out in one of the formats:
+- DUMPTEXT is the (left_subtree)ID:height(right_subtree) format of dumpTree()
+- DUMPJSON nests every node as {"id", "height", "type", "state", "left", "right"},
+  a missing child is null
+- DUMPDOT is a Graphviz digraph with one vertex per node labeled ID:height
+If maxDepth is not negative only the nodes down to that depth are written (the root
+has depth 0) and every deeper subtree is written as "..." instead.
+The tree is walked iteratively and the output is collected in DUMPBLOCKSIZE blocks,
+so huge trees neither exhaust the stack nor make one stream call per token.
+During an incremental setType only the tree being built is written.
+A BPTREE is written as its B+ nodes, and maxDepth counts their levels:
+- DUMPTEXT writes a node as [ ] around the ids of a leaf or the children of an
+  inner node, separated by spaces
+- DUMPJSON writes a leaf as {"ids", "robots"} with every robot as {"id", "type",
+  "state"} and an inner node as {"ids", "children"}
+- DUMPDOT has one vertex per node labeled with its ids
+*/
+void Swarm::dumpTree(ostream& out, DUMPFORMAT format, int maxDepth) const{
+    writeDump(format, maxDepth, [&out](const char* data, size_t length) {
+        out.write(data, length);
+    });
+    out.flush();
+}
+
+/*
+Writes the tree like dumpTree(out, format, maxDepth) into buffer, which holds size
+bytes, and null-terminates it. Returns the length of the whole dump, so a result
+of size or more means the output was truncated, as with snprintf.
+*/
+int Swarm::dumpTree(char* buffer, int size, DUMPFORMAT format, int maxDepth) const{
+    int length = 0;
+    writeDump(format, maxDepth, [&](const char* data, size_t count) {
+        if (length < size - 1) {
+            int copied = min((int)count, size - 1 - length);
+            memcpy(buffer + length, data, copied);
+        }
+        length = length + (int)count;
+    });
+    if (size > 0) {
+        buffer[min(length, size - 1)] = '\0';
+    }
+    return length;
+}
+
+//Append the decimal digits of value to block
+static void appendInt(string& block, int value){
+    char digits[12];
+    char* end = to_chars(digits, digits + sizeof(digits), value).ptr;
+    block.append(digits, end - digits);
+}
+
+//The dump engine: walks the tree with an explicit stack and passes the output
+//to flush(const char*, size_t) one block at a time
+template <class Flush>
+void Swarm::writeDump(DUMPFORMAT format, int maxDepth, Flush flush) const{
+    //a step is a node (nullptr for a missing child), its depth and how far it got
+    struct Step{
+        Robot* robot;
+        int depth;
+        int stage;
+    };
+    string block;
+    block.reserve(DUMPBLOCKSIZE + 256);
+    vector<Step> stack;
+    if (format == DUMPDOT) {
+        block.append("digraph swarm {\n");
+    }
+    if (m_type == BPTREE and m_bplus.m_root != nullptr) {
+        writeDumpBPlus(m_bplus.m_root, 0, format, maxDepth, block, flush);
+    }else if (m_root != nullptr or format == DUMPJSON) {
+        stack.push_back({m_root, 0, 0});
+    }
+    while (!stack.empty()) {
+        Step& step = stack.back();
+        Robot* robot = step.robot;
+        int depth = step.depth;
+        bool truncated = (maxDepth >= 0 and depth > maxDepth);
+        if (format == DUMPTEXT) {
+            //(left ID:height right), the children are only pushed when they exist
+            if (truncated) {
+                block.append("(...)");
+                stack.pop_back();
+            }else if (step.stage == 0) {
+                block.push_back('(');
+                step.stage = 1;
+                if (robot->m_left != nullptr) {
+                    stack.push_back({robot->m_left, depth + 1, 0});
+                }
+            }else if (step.stage == 1) {
+                appendInt(block, robot->m_id);
+                block.push_back(':');
+                appendInt(block, robot->m_height);
+                step.stage = 2;
+                if (robot->m_right != nullptr) {
+                    stack.push_back({robot->m_right, depth + 1, 0});
+                }
+            }else {
+                block.push_back(')');
+                stack.pop_back();
+            }
+        }else if (format == DUMPJSON) {
+            if (robot == nullptr) {
+                block.append("null");
+                stack.pop_back();
+            }else if (truncated) {
+                block.append("\"...\"");
+                stack.pop_back();
+            }else if (step.stage == 0) {
+                block.append("{\"id\":");
+                appendInt(block, robot->m_id);
+                block.append(",\"height\":");
+                appendInt(block, robot->m_height);
+                block.append(",\"type\":\"" + robot->getTypeStr() + "\",\"state\":\"" + robot->getStateStr() + "\",\"left\":");
+                step.stage = 1;
+                stack.push_back({robot->m_left, depth + 1, 0});
+            }else if (step.stage == 1) {
+                block.append(",\"right\":");
+                step.stage = 2;
+                stack.push_back({robot->m_right, depth + 1, 0});
+            }else {
+                block.push_back('}');
+                stack.pop_back();
+            }
+        }else {
+            //one vertex per node and one edge per child, in pre-order
+            stack.pop_back();
+            block.append("  n");
+            appendInt(block, robot->m_id);
+            block.append(" [label=\"");
+            appendInt(block, robot->m_id);
+            block.push_back(':');
+            appendInt(block, robot->m_height);
+            block.append("\"];\n");
+            Robot* children[] = {robot->m_right, robot->m_left};
+            for (Robot* child : children) {
+                if (child == nullptr) {
+                    continue;
+                }
+                block.append("  n");
+                appendInt(block, robot->m_id);
+                block.append(" -> n");
+                if (maxDepth >= 0 and depth + 1 > maxDepth) {
+                    //a stand-in vertex for the subtree that is not written
+                    appendInt(block, robot->m_id);
+                    block.append(child == robot->m_left ? "_left;\n  n" : "_right;\n  n");
+                    appendInt(block, robot->m_id);
+                    block.append(child == robot->m_left ? "_left" : "_right");
+                    block.append(" [label=\"...\", shape=plaintext];\n");
+                }else {
+                    appendInt(block, child->m_id);
+                    block.append(";\n");
+                    stack.push_back({child, depth + 1, 0});
+                }
+            }
+        }
+        if ((int)block.size() >= DUMPBLOCKSIZE) {
+            flush(block.data(), block.size());
+            block.clear();
+        }
+    }
+    if (format == DUMPDOT) {
+        block.append("}\n");
+    }
+    if (!block.empty()) {
+        flush(block.data(), block.size());
+    }
+}
+
+//Write the B+ subtree at node into block, recursion is bounded by the few levels of a B+ tree
+template <class Flush>
+void Swarm::writeDumpBPlus(const BPlusTree::Node* node, int depth, DUMPFORMAT format, int maxDepth,
+                           string& block, Flush& flush) const{
+    bool truncated = (maxDepth >= 0 and depth > maxDepth);
+    if (format == DUMPTEXT) {
+        if (truncated) {
+            block.append("[...]");
+            return;
+        }
+        block.push_back('[');
+        for (int i = 0; i < node->m_count; i++) {
+            if (i > 0) {
+                block.push_back(' ');
+            }
+            if (node->m_leaf) {
+                appendInt(block, node->m_ids[i]);
+            }else {
+                writeDumpBPlus(node->m_children[i], depth + 1, format, maxDepth, block, flush);
+            }
+        }
+        block.push_back(']');
+    }else if (format == DUMPJSON) {
+        if (truncated) {
+            block.append("\"...\"");
+            return;
+        }
+        block.append("{\"ids\":[");
+        for (int i = 0; i < node->m_count; i++) {
+            if (i > 0) {
+                block.push_back(',');
+            }
+            appendInt(block, node->m_ids[i]);
+        }
+        block.append(node->m_leaf ? "],\"robots\":[" : "],\"children\":[");
+        for (int i = 0; i < node->m_count; i++) {
+            if (i > 0) {
+                block.push_back(',');
+            }
+            if (node->m_leaf) {
+                Robot* robot = node->m_robots[i];
+                block.append("{\"id\":");
+                appendInt(block, robot->m_id);
+                block.append(",\"type\":\"" + robot->getTypeStr() + "\",\"state\":\"" + robot->getStateStr() + "\"}");
+            }else {
+                writeDumpBPlus(node->m_children[i], depth + 1, format, maxDepth, block, flush);
+            }
+        }
+        block.append("]}");
+    }else {
+        //a vertex is named after its level and its largest id, which no other node of the level has
+        auto appendName = [&block](int level, const BPlusTree::Node* vertex) {
+            block.push_back('b');
+            appendInt(block, level);
+            block.push_back('_');
+            appendInt(block, BPlusTree::maxID(vertex));
+        };
+        block.append("  ");
+        appendName(depth, node);
+        block.append(" [label=\"");
+        for (int i = 0; i < node->m_count; i++) {
+            if (i > 0) {
+                block.push_back(' ');
+            }
+            appendInt(block, node->m_ids[i]);
+        }
+        block.append("\", shape=box];\n");
+        for (int i = 0; i < node->m_count and !node->m_leaf; i++) {
+            block.append("  ");
+            appendName(depth, node);
+            block.append(" -> ");
+            if (maxDepth >= 0 and depth + 1 > maxDepth) {
+                //one stand-in vertex for the children that are not written
+                appendName(depth, node);
+                block.append("_more;\n  ");
+                appendName(depth, node);
+                block.append("_more [label=\"...\", shape=plaintext];\n");
+                break;
+            }
+            appendName(depth + 1, node->m_children[i]);
+            block.append(";\n");
+            writeDumpBPlus(node->m_children[i], depth + 1, format, maxDepth, block, flush);
+        }
+    }
+    if ((int)block.size() >= DUMPBLOCKSIZE) {
+        flush(block.data(), block.size());
+        block.clear();
+    }
+}
+
+
+/*
+Returns the robot with the id, or nullptr if there is no such robot.
+If the tree type is SPLAY, the found node (or the last node on the search path)
+is splayed to the root like any other access. If the swarm is frozen the lookup
+uses the frozen layout and does not change the tree.
+With the hot-id cache on (setCache) a found robot is remembered in the slot of
+its id and the next find of the id returns it without a search. A SPLAY tree
+does not use the cache since every access has to splay.
+With access counting on (setAccessCounting) the count of the found robot grows.
+*/
+Robot* Swarm::find(int id){
+    if (m_convertOld != nullptr) {
+        step(m_convertBudget);
+    }
+    Robot* robot = nullptr;
+    if (m_cache.empty() or m_type == SPLAY) {
+        robot = lookup(id);
+    }else {
+        Robot*& cached = m_cache[cacheSlot(id)];
+        if (cached != nullptr and cached->getID() == id) {
+            m_cacheHits++;
+            robot = cached;
+        }else {
+            m_cacheMisses++;
+            robot = lookup(id);
+            if (robot != nullptr and !robot->m_tombstone) {
+                cached = robot;
+            }
+        }
+    }
+    if (robot == nullptr or robot->m_tombstone) {
+        return nullptr;
+    }
+    if (m_counting) {
+        robot->m_accesses++;
+    }
+    return robot;
+}
+
+
+//Search the frozen layout or the tree for id
+Robot* Swarm::lookup(int id){
+    if (m_frozen and m_frozenLayout == BTREE) {
+        //compare with the leaf ids so that only the found node is loaded
+        int position = lowerBoundBTree(id);
+        if (position < (int)m_sortedNodes.size() and m_btreeLevels[0][position] == id) {
+            return m_sortedNodes[position];
+        }
+        return nullptr;
+    }
+    if (m_frozen) {
+        return findFrozen(id);
+    }
+    if (m_adaptive) {
+        noteAccess(id, false, false);
+    }
+    if (m_type == SPLAY) {
+        return get<RobotTree<SplayPolicy>>(m_tree).find(id);
+    }
+    return getRobotAtThisID(id);
 }
 
-//Recursively print contents of the left and right nodes of a tree
-void Swarm::dump(Robot* aBot) const{
-    if (aBot != nullptr){
-        cout << "(";
-        dump(aBot->m_left);//first visit the left child
-        cout << aBot->m_id << ":" << aBot->m_height;//second visit the node itself
-        dump(aBot->m_right);//third visit the right child
-        cout << ")";
+
+//Search the tree from the root without restructuring it, and then the tree an
+//incremental setType migrates from
+Robot* Swarm::getRobotAtThisID(int id){
+    if (m_type == BPTREE) {
+        SWARM_ADD(comparisons, m_bplus.height() + 1);
+        return m_bplus.find(id);
+    }
+    Robot* robot = m_root;
+    while (robot != nullptr and robot->getID() != id) {
+        SWARM_COUNT(comparisons);
+        if (id < robot->getID()) {
+            robot = robot->getLeft();
+        }else {
+            robot = robot->getRight();
+        }
+    }
+    if (robot == nullptr and m_convertOld != nullptr) {
+        robot = findOld(id);
+    }
+    return robot;
+}
+
+
+/*
+Compiles the tree into a read-only array layout for fast lookups.
+- EYTZINGER stores the ids in BFS order: the children of slot k are slots 2k and
+  2k+1, so the top levels of every search share a few cache lines and the next slot
+  is computed instead of loaded from a node.
+- BTREE stores the sorted ids as the leaves of an implicit B+ tree with BTREEKEYS
+  ids per node. Each node is searched with one SIMD compare, so a lookup in a 90k
+  swarm touches 5 nodes instead of 17, and range queries scan the sorted leaves.
+The tree itself is kept, so iteration and dumps still work, and find() uses the
+layout until the swarm is thawed. Any operation that modifies the swarm (insert,
+remove, setType, clear, assignment) thaws it first.
+*/
+void Swarm::freeze(FROZENLAYOUT layout){
+    thaw();
+    finishConversion();
+    if (m_tombstones > 0) {
+        purgeTombstones();
+    }
+    vector<Robot*> nodes;
+    collectTree(nodes);
+    m_frozenLayout = layout;
+    if (layout == EYTZINGER) {
+        m_frozenIDs.resize(nodes.size() + 1);
+        m_frozenNodes.resize(nodes.size() + 1);
+        int next = 0;
+        fillEytzinger(nodes, next, 1);
+    }else {
+        //level 0 holds every id, padded with INT_MAX to whole nodes. An entry of the
+        //next level is the largest id of one node below, until one node is left.
+        vector<int> level;
+        for (Robot* robot : nodes) {
+            level.push_back(robot->getID());
+        }
+        do {
+            while (level.size() % BTREEKEYS != 0 or level.empty()) {
+                level.push_back(INT_MAX);
+            }
+            m_btreeLevels.push_back(level);
+            vector<int> parent;
+            for (int i = BTREEKEYS - 1; i < (int)level.size(); i = i + BTREEKEYS) {
+                parent.push_back(level[i]);
+            }
+            level = parent;
+        } while (m_btreeLevels.back().size() > (size_t)BTREEKEYS);
+        m_sortedNodes = nodes;
+    }
+    m_frozen = true;
+}
+
+
+//Discards the frozen layout, the swarm is a regular mutable tree again
+void Swarm::thaw(){
+    m_frozen = false;
+    m_frozenIDs.clear();
+    m_frozenNodes.clear();
+    m_sortedNodes.clear();
+    m_btreeLevels.clear();
+}
+
+
+//Returns true if the swarm is frozen
+bool Swarm::isFrozen() const{
+    return m_frozen;
+}
+
+
+//Place the sorted nodes into the Eytzinger slots with an in-order walk of the implicit tree
+void Swarm::fillEytzinger(vector<Robot*>& nodes, int& next, int slot){
+    if (slot >= (int)m_frozenIDs.size()) {
+        return;
+    }
+    fillEytzinger(nodes, next, 2 * slot);
+    m_frozenIDs[slot] = nodes[next]->getID();
+    m_frozenNodes[slot] = nodes[next];
+    next++;
+    fillEytzinger(nodes, next, 2 * slot + 1);
+}
+
+
+/*
+Branch-free search of the frozen layout. Every step moves to child 2k or 2k+1
+depending on one comparison, so the loop has no data dependent branch. At the end
+the trailing ones of slot are the right turns taken after the last left turn, and
+shifting them out leaves the slot of the smallest id that is not less than id.
+*/
+Robot* Swarm::findFrozen(int id) const{
+    int size = (int)m_frozenIDs.size() - 1;
+    int slot = 1;
+    while (slot <= size) {
+        SWARM_COUNT(comparisons);
+        slot = 2 * slot + (m_frozenIDs[slot] < id);
+    }
+    slot = slot >> __builtin_ffs(~slot);
+    if (slot != 0 and m_frozenIDs[slot] == id) {
+        return m_frozenNodes[slot];
+    }
+    return nullptr;
+}
+
+
+/*
+Returns the position in m_sortedNodes of the first robot whose id is not less than id.
+Starting at the root node, the number of keys less than id in the current node is
+the child to descend into, because a key is the largest id of its child.
+*/
+int Swarm::lowerBoundBTree(int id) const{
+    int node = 0;
+    for (int level = (int)m_btreeLevels.size() - 1; level >= 0; level--) {
+        SWARM_COUNT(comparisons);
+        node = node * BTREEKEYS + countLess(&m_btreeLevels[level][node * BTREEKEYS], id);
+        if (level > 0 and node * BTREEKEYS >= (int)m_btreeLevels[level - 1].size()) {
+            //id is larger than every id in the swarm
+            return (int)m_sortedNodes.size();
+        }
+    }
+    return node;
+}
+
+
+//Counts how many of the BTREEKEYS sorted keys are less than id.
+//Uses AVX2 or SSE2 compares when the compiler targets them, a plain loop otherwise.
+int Swarm::countLess(const int* keys, int id){
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi32(id);
+    __m256i low = _mm256_cmpgt_epi32(key, _mm256_loadu_si256((const __m256i*)keys));
+    __m256i high = _mm256_cmpgt_epi32(key, _mm256_loadu_si256((const __m256i*)(keys + 8)));
+    unsigned int mask = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(low))
+                      | ((unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(high)) << 8);
+    return __builtin_popcount(mask);
+#elif defined(__SSE2__)
+    __m128i key = _mm_set1_epi32(id);
+    unsigned int mask = 0;
+    for (int i = 0; i < BTREEKEYS / 4; i++) {
+        __m128i less = _mm_cmpgt_epi32(key, _mm_loadu_si128((const __m128i*)(keys + 4 * i)));
+        mask = mask | ((unsigned int)_mm_movemask_ps(_mm_castsi128_ps(less)) << (4 * i));
+    }
+    return __builtin_popcount(mask);
+#else
+    int count = 0;
+    for (int i = 0; i < BTREEKEYS; i++) {
+        count += (keys[i] < id);
+    }
+    return count;
+#endif
+}
+
+
+/*
+Appends to robots every robot with an id in [low, high] in increasing id order.
+A frozen BTREE swarm scans its sorted leaves and a BPTREE its leaf chain, otherwise
+the tree is walked without restructuring it, skipping the subtrees that are outside
+of the range.
+*/
+void Swarm::findRange(int low, int high, vector<Robot*>& robots) const{
+    if (m_frozen and m_frozenLayout == BTREE) {
+        for (int i = lowerBoundBTree(low); i < (int)m_sortedNodes.size(); i++) {
+            if (m_btreeLevels[0][i] > high) {
+                break;
+            }
+            if (!m_sortedNodes[i]->m_tombstone) {
+                robots.push_back(m_sortedNodes[i]);
+            }
+        }
+        return;
+    }
+    if (m_type == BPTREE) {
+        m_bplus.findRange(low, high, robots);
+        return;
+    }
+    findRangeTree(m_root, low, high, robots);
+    if (m_convertOld != nullptr) {
+        //merge the robots of the tree an incremental setType migrates from
+        size_t middle = robots.size();
+        findRangeTree(m_convertOld, low, high, robots);
+        auto byID = [](Robot* a, Robot* b) {
+            return a->getID() < b->getID();
+        };
+        inplace_merge(robots.begin(), robots.begin() + middle, robots.end(), byID);
+    }
+}
+
+
+//Add the robots of the tree at robot with an id in [low, high] to robots in id order
+void Swarm::findRangeTree(Robot* robot, int low, int high, vector<Robot*>& robots) const{
+    //iterative in-order walk, a degenerate BST can be deeper than the call stack allows
+    vector<Robot*> stack;
+    while (robot != nullptr or !stack.empty()) {
+        while (robot != nullptr) {
+            if (robot->getID() < low) {
+                robot = robot->getRight();
+            }else {
+                stack.push_back(robot);
+                robot = robot->getLeft();
+            }
+        }
+        if (stack.empty()) {
+            break;
+        }
+        robot = stack.back();
+        stack.pop_back();
+        if (robot->getID() > high) {
+            break;
+        }
+        if (!robot->m_tombstone) {
+            robots.push_back(robot);
+        }
+        robot = robot->getRight();
+    }
+}
+
+
+/*
+Turns the spatial index on or off. While it is on, robots can be given a
+position (setPosition, or insert with a position) and found by findNearest and
+findRadius. Removing a robot, lazily too, drops its position, and copies keep
+the positions; save, the log and load do not. Turning the index off drops every
+position, changing cellSize moves the positions into a grid of the new size.
+*/
+void Swarm::setSpatialIndex(bool enabled, float cellSize){
+    if (!enabled or cellSize <= 0) {
+        delete m_spatial;
+        m_spatial = nullptr;
+        return;
+    }
+    if (m_spatial != nullptr and m_spatial->m_cellSize == cellSize) {
+        return;
+    }
+    SpatialIndex* index = new SpatialIndex(cellSize);
+    if (m_spatial != nullptr) {
+        for (const auto& cell : m_spatial->m_cells) {
+            for (const SpatialIndex::Entry& entry : cell.second) {
+                index->set(entry.m_robot, entry.m_position);
+            }
+        }
+        delete m_spatial;
+    }
+    m_spatial = index;
+}
+
+
+//Inserts robot like insert and, if it was added, sets its position
+void Swarm::insert(const Robot& robot, const Position& position){
+    pair<Robot*, bool> result = emplace(robot.getID(), robot.getType(), robot.getState());
+    if (result.second and m_spatial != nullptr) {
+        m_spatial->set(result.first, position);
+    }
+}
+
+
+/*
+Places the robot with id at position, or moves it there, and returns true. Returns
+false if the spatial index is off or there is no robot with id.
+*/
+bool Swarm::setPosition(int id, const Position& position){
+    if (m_spatial == nullptr) {
+        return false;
+    }
+    Robot* robot = getRobotAtThisID(id);
+    if (robot == nullptr or robot->m_tombstone) {
+        return false;
+    }
+    m_spatial->set(robot, position);
+    return true;
+}
+
+
+//Sets position to the position of the robot with id, returns false if it has none
+bool Swarm::getPosition(int id, Position& position) const{
+    return m_spatial != nullptr and m_spatial->get(id, position);
+}
+
+
+/*
+Sets robots to the k robots closest to center, nearest first, among the robots
+with a position whose type and state are in the masks (bit 1 << type of typeMask,
+bit 1 << state of stateMask). Fewer robots are returned if fewer match.
+*/
+void Swarm::findNearest(const Position& center, int k, vector<Robot*>& robots,
+                        int typeMask, int stateMask) const{
+    robots.clear();
+    if (m_spatial != nullptr) {
+        m_spatial->findNearest(center, k, robots, typeMask, stateMask);
+    }
+}
+
+
+//Sets robots to the robots within radius of center that match the masks, in no particular order
+void Swarm::findRadius(const Position& center, float radius, vector<Robot*>& robots,
+                       int typeMask, int stateMask) const{
+    robots.clear();
+    if (m_spatial != nullptr) {
+        m_spatial->findRadius(center, radius, robots, typeMask, stateMask);
+    }
+}
+
+/*
+Looks up n ids at once, out[i] is set to the robot with id ids[i] or nullptr.
+A single lookup waits for one cache miss per level before it knows where to go
+next. Here the searches are advanced in groups of BATCHGROUP: each round moves every
+search of the group one level down and prefetches its next node, so the misses of
+independent searches overlap instead of adding up.
+A SPLAY tree that is not frozen restructures on every access, so its lookups are
+done one after the other with find().
+*/
+void Swarm::findBatch(const int* ids, size_t n, Robot** out){
+    if ((m_type == SPLAY and !m_frozen) or m_convertOld != nullptr) {
+        for (size_t i = 0; i < n; i++) {
+            out[i] = find(ids[i]);
+        }
+        return;
+    }
+    for (size_t first = 0; first < n; first = first + BATCHGROUP) {
+        int count = (int)min((size_t)BATCHGROUP, n - first);
+        if (m_frozen and m_frozenLayout == BTREE) {
+            findGroupBTree(ids + first, count, out + first);
+        }else if (m_frozen) {
+            findGroupEytzinger(ids + first, count, out + first);
+        }else if (m_type == BPTREE) {
+            m_bplus.findBatch(ids + first, count, out + first);
+        }else {
+            findGroupTree(ids + first, count, out + first);
+        }
+    }
+    if (m_tombstones > 0 or m_counting) {
+        for (size_t i = 0; i < n; i++) {
+            if (out[i] != nullptr and out[i]->m_tombstone) {
+                out[i] = nullptr;
+            }else if (out[i] != nullptr and m_counting) {
+                out[i]->m_accesses++;
+            }
+        }
+    }
+}
+
+
+//Interleaved descents from the root of the tree, a search stops at its node or at nullptr
+void Swarm::findGroupTree(const int* ids, int count, Robot** out) const{
+    for (int i = 0; i < count; i++) {
+        out[i] = m_root;
+    }
+    bool active = true;
+    while (active) {
+        active = false;
+        for (int i = 0; i < count; i++) {
+            Robot* robot = out[i];
+            if (robot != nullptr and robot->m_id != ids[i]) {
+                SWARM_COUNT(comparisons);
+                robot = (ids[i] < robot->m_id) ? robot->m_left : robot->m_right;
+                __builtin_prefetch(robot);
+                out[i] = robot;
+                active = true;
+            }
+        }
+    }
+}
+
+
+//Interleaved branch-free descents of the Eytzinger layout, see findFrozen
+void Swarm::findGroupEytzinger(const int* ids, int count, Robot** out) const{
+    int size = (int)m_frozenIDs.size() - 1;
+    int slots[BATCHGROUP];
+    for (int i = 0; i < count; i++) {
+        slots[i] = 1;
+    }
+    bool active = (size > 0);
+    while (active) {
+        active = false;
+        for (int i = 0; i < count; i++) {
+            int slot = slots[i];
+            if (slot <= size) {
+                SWARM_COUNT(comparisons);
+                slot = 2 * slot + (m_frozenIDs[slot] < ids[i]);
+                if (slot <= size) {
+                    __builtin_prefetch(&m_frozenIDs[slot]);
+                    active = true;
+                }
+                slots[i] = slot;
+            }
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        int slot = slots[i] >> __builtin_ffs(~slots[i]);
+        if (size > 0 and slot != 0 and m_frozenIDs[slot] == ids[i]) {
+            out[i] = m_frozenNodes[slot];
+        }else {
+            out[i] = nullptr;
+        }
+    }
+}
+
+
+//Interleaved descents of the B+ tree layout one level at a time, see lowerBoundBTree
+void Swarm::findGroupBTree(const int* ids, int count, Robot** out) const{
+    int size = (int)m_sortedNodes.size();
+    int nodes[BATCHGROUP];
+    for (int i = 0; i < count; i++) {
+        nodes[i] = 0;
+    }
+    for (int level = (int)m_btreeLevels.size() - 1; level >= 0; level--) {
+        const vector<int>& keys = m_btreeLevels[level];
+        for (int i = 0; i < count; i++) {
+            if (nodes[i] < 0) {
+                continue;
+            }
+            SWARM_COUNT(comparisons);
+            int node = nodes[i] * BTREEKEYS + countLess(&keys[nodes[i] * BTREEKEYS], ids[i]);
+            if (level > 0 and node * BTREEKEYS >= (int)m_btreeLevels[level - 1].size()) {
+                //id is larger than every id in the swarm
+                node = -1;
+            }else if (level > 0) {
+                __builtin_prefetch(&m_btreeLevels[level - 1][node * BTREEKEYS]);
+            }
+            nodes[i] = node;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (nodes[i] >= 0 and nodes[i] < size and m_btreeLevels[0][nodes[i]] == ids[i]) {
+            out[i] = m_sortedNodes[nodes[i]];
+        }else {
+            out[i] = nullptr;
+        }
+    }
+}
+
+
+/*
+Returns a snapshot of the operation counters and of the current tree shape.
+The counters are only collected in a build with -DSWARM_STATS and are zero otherwise.
+The shape (node count, height, average and maximum node depth) is computed here by
+walking the tree, so it is always available but costs O(n). For BPTREE the depths
+are those of the B+ nodes, the root node has depth 0.
+*/
+SwarmStats Swarm::stats() const{
+    SwarmStats result;
+#ifdef SWARM_STATS
+    result = m_stats;
+#endif
+    long long depthSum = 0;
+    long long accessDepthSum = 0;
+    long long accessSum = 0;
+    if (m_type == BPTREE) {
+        //every robot is in a leaf and all leaves are at the same depth
+        result.nodeCount = m_count;
+        result.height = result.maxDepth = m_bplus.height();
+        result.averageDepth = result.accessDepth = max(m_bplus.height(), 0);
+        return result;
+    }
+    vector<pair<Robot*, int>> stack;
+    if (m_root != nullptr) {
+        stack.push_back(make_pair(m_root, 0));
+    }
+    if (m_convertOld != nullptr) {
+        stack.push_back(make_pair(m_convertOld, 0));
+    }
+    while (!stack.empty()) {
+        Robot* robot = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+        result.nodeCount++;
+        depthSum += depth;
+        accessDepthSum += (long long)robot->m_accesses * depth;
+        accessSum += robot->m_accesses;
+        if (robot->m_tombstone) {
+            result.tombstones++;
+        }
+        if (depth > result.maxDepth) {
+            result.maxDepth = depth;
+        }
+        if (robot->getLeft() != nullptr) {
+            stack.push_back(make_pair(robot->getLeft(), depth + 1));
+        }
+        if (robot->getRight() != nullptr) {
+            stack.push_back(make_pair(robot->getRight(), depth + 1));
+        }
+    }
+    if (result.nodeCount > 0) {
+        result.averageDepth = (double)depthSum / result.nodeCount;
+    }
+    if (accessSum > 0) {
+        result.accessDepth = (double)accessDepthSum / accessSum;
+    }
+    //the deepest node, the height field of a WAVL root is its rank
+    result.height = result.maxDepth;
+    return result;
+}
+
+
+//Sets all operation counters back to zero
+void Swarm::resetStats(){
+#ifdef SWARM_STATS
+    m_stats = SwarmStats();
+#endif
+}
+
+
+/*
+Turns the hot-id cache on with slots slots (rounded up to a power of two) or off
+with 0, and resets its counters. The cache maps an id to its node so that finds
+of hot robots in a BST, AVL or WAVL tree take O(1). A slot holds the latest
+found robot whose id hashes to it. A node that is removed or released by clear
+(and so by setType(NONE), operator= and load) is dropped from the cache.
+*/
+void Swarm::setCache(int slots){
+    int size = 0;
+    m_cacheShift = 32;
+    if (slots > 0) {
+        size = 1;
+        while (size < slots) {
+            size = size * 2;
+            m_cacheShift--;
+        }
+    }
+    m_cache.assign(size, nullptr);
+    m_cacheHits = 0;
+    m_cacheMisses = 0;
+}
+
+
+//Returns the counters of the hot-id cache
+CacheStats Swarm::cacheStats() const{
+    CacheStats result;
+    result.hits = m_cacheHits;
+    result.misses = m_cacheMisses;
+    result.slots = (int)m_cache.size();
+    if (m_cacheHits + m_cacheMisses > 0) {
+        result.hitRate = (double)m_cacheHits / (m_cacheHits + m_cacheMisses);
+    }
+    return result;
+}
+
+
+//Fibonacci hashing, the top bits of the 32 bit product pick the slot
+int Swarm::cacheSlot(int id) const{
+    return (int)(((unsigned long long)((unsigned int)id * 2654435769u)) >> m_cacheShift);
+}
+
+
+//Returns the number of robots in the swarm, tombstones are not counted
+int Swarm::size() const{
+    return m_count - m_tombstones;
+}
+
+
+/*
+Turns lazy deletion on or off. While it is on, remove in a BST, AVL or WAVL tree
+does not unlink the node but marks it as a tombstone: find, findBatch, findRange,
+setState and the parallel walks skip it, size does not count it and inserting
+its id revives it. Once more than threshold of the nodes are tombstones they are
+all reclaimed in one pass by purgeTombstones. Bursts of removes then cost a search
+each instead of a search and a rebalance, at the price of longer search paths
+until the compaction. Turning it off purges the tombstones left.
+A SPLAY tree keeps its remove, which only splays.
+*/
+void Swarm::setLazyDelete(bool enabled, double threshold){
+    m_lazyDelete = enabled;
+    m_tombstoneRatio = threshold;
+    if (!enabled and m_tombstones > 0) {
+        purgeTombstones();
+    }
+}
+
+
+/*
+Releases every tombstoned node and relinks the remaining nodes as a balanced
+tree, which is a valid tree of every type. It is called by a lazy remove when the
+tombstone ratio crosses the threshold and by freeze, and can be called any time.
+*/
+void Swarm::purgeTombstones(){
+    thaw();
+    finishConversion();
+    vector<Robot*> nodes;
+    collectTree(nodes);
+    dropTombstones(nodes);
+    linkTree(nodes, 0);
+}
+
+
+//Mark the node of id as a tombstone and compact once the ratio crosses the threshold
+void Swarm::markTombstone(int id){
+    Robot* robot = getRobotAtThisID(id);
+    if (robot == nullptr or robot->m_tombstone) {
+        return;
+    }
+    robot->m_tombstone = true;
+    m_tombstones++;
+    if (!m_cache.empty() and m_cache[cacheSlot(id)] == robot) {
+        m_cache[cacheSlot(id)] = nullptr;
+    }
+    if (m_spatial != nullptr) {
+        m_spatial->erase(robot);
+    }
+    //an incremental setType releases the tombstones it migrates, a purge would finish it at once
+    if (m_convertOld == nullptr and m_tombstones > m_tombstoneRatio * m_count) {
+        purgeTombstones();
+    }
+}
+
+
+//Release the tombstones among nodes and remove them from the list, keeping its order
+void Swarm::dropTombstones(vector<Robot*>& nodes){
+    if (m_tombstones == 0) {
+        return;
+    }
+    size_t kept = 0;
+    for (Robot* robot : nodes) {
+        if (robot->m_tombstone) {
+            releaseNode(robot);
+        }else {
+            nodes[kept++] = robot;
+        }
+    }
+    nodes.resize(kept);
+}
+
+
+/*
+Sets how many microseconds an operation may spend on a conversion. With 0 (the
+default) setType rebuilds the tree at once. Otherwise a setType that rebuilds
+(to AVL, or to WAVL from BST or SPLAY) only starts an empty tree of the new type,
+and every later find, insert, remove and setState first calls step(microseconds)
+to move nodes over, so no call pauses much longer than the budget. Until the
+conversion is done lookups search both trees.
+*/
+void Swarm::setConversionBudget(int microseconds){
+    m_convertBudget = max(microseconds, 0);
+}
+
+
+/*
+Moves nodes of an incremental conversion (setConversionBudget) into the new tree
+for about budget microseconds and returns true once the conversion is done, or
+if there is none. At least CONVERTCHECK nodes are moved per call. The nodes are
+taken from the old tree in post-order, so each one is a leaf when it is unlinked
+and the rest of the old tree stays searchable. Nodes are moved, not copied, and
+tombstones are released on the way.
+*/
+bool Swarm::step(int budget){
+    if (m_convertOld == nullptr) {
+        return true;
+    }
+    auto start = chrono::steady_clock::now();
+    long long limit = (long long)budget * 1000;
+    do {
+        for (int i = 0; i < CONVERTCHECK and m_convertOld != nullptr; i++) {
+            migrateNode();
+        }
+    } while (m_convertOld != nullptr
+             and chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count() < limit);
+    return m_convertOld == nullptr;
+}
+
+
+/*
+Returns the memory held by the swarm: its nodes, the pool blocks they live in
+and the overhead around them. The overhead counts the free slots of the pool,
+an estimate of BLOCKHEADERSIZE heap bytes per block and the capacity of the side
+tables (block list, cache, frozen layout, adaptive window, log buffer) and the
+nodes of a BPTREE.
+fragmentation is the fraction of the pool slots that are free, which removes
+leave behind until inserts reuse them or compact() releases them.
+*/
+MemoryUsage Swarm::memoryUsage() const{
+    MemoryUsage result;
+    result.nodes = m_count;
+    result.nodeBytes = (long long)m_count * sizeof(Robot);
+    result.poolBytes = m_poolSlots * sizeof(Robot);
+    result.blocks = (int)m_blocks.size();
+    long long sideBytes = (m_blocks.capacity() + m_cache.capacity() + m_frozenNodes.capacity()
+                           + m_sortedNodes.capacity() + m_convertPath.capacity()) * sizeof(Robot*)
+                          + (m_frozenIDs.capacity() + m_adaptRecent.capacity() + m_adaptLatest.capacity()) * sizeof(int)
+                          + m_adaptWindow.capacity() * sizeof(AdaptSample)
+                          + m_adaptLog.capacity() * sizeof(AdaptDecision) + m_logBuffer.capacity();
+    for (const vector<int>& level : m_btreeLevels) {
+        sideBytes += level.capacity() * sizeof(int);
+    }
+    if (m_spatial != nullptr) {
+        sideBytes += sizeof(SpatialIndex) + m_spatial->bytes();
+    }
+    sideBytes += m_bplus.bytes();
+    result.overheadBytes = result.poolBytes - result.nodeBytes + result.blocks * BLOCKHEADERSIZE + sideBytes;
+    result.totalBytes = sizeof(Swarm) + result.nodeBytes + result.overheadBytes;
+    if (m_poolSlots > 0) {
+        result.fragmentation = (double)(m_poolSlots - m_count) / m_poolSlots;
+    }
+    return result;
+}
+
+
+/*
+Limits the pool blocks to bytes, 0 removes the limit. Once the pool is full and
+no more nodes fit in the budget, inserts of new ids are rejected, while removed
+nodes are still reused. Copies, load, buildFrom and replay are not limited. A
+budget below the current pool frees nothing, compact() shrinks the pool.
+*/
+void Swarm::setMemoryBudget(long long bytes){
+    m_memoryBudget = max(bytes, 0LL);
+}
+
+
+/*
+Moves every robot into one new block holding exactly the robots, in id order,
+and frees the old blocks. The shape of the tree is kept, a BPTREE is loaded
+again with full leaves. After heavy churn the
+nodes are spread over many half empty blocks; compacting returns the free slots
+and places the nodes of an in-order walk next to each other. A conversion in
+progress is finished first, and tombstones are purged, which rebalances.
+The nodes move, so robots returned by find or emplace before the call must not
+be used after it.
+*/
+void Swarm::compact(){
+    thaw();
+    finishConversion();
+    if (m_tombstones > 0) {
+        purgeTombstones();
+    }
+    vector<Robot*> nodes;
+    collectTree(nodes);
+    vector<Robot*> oldBlocks;
+    oldBlocks.swap(m_blocks);
+    m_poolSlots = 0;
+    m_freeList = nullptr;
+    int count = (int)nodes.size();
+    if (count > 0) {
+        Robot* block = allocateBlock(count);
+        //copy every node to its slot and leave the slot number in the old node,
+        //the child pointers are then translated through the old nodes
+        for (int i = 0; i < count; i++) {
+            block[i] = *nodes[i];
+            nodes[i]->m_id = i;
+        }
+        for (int i = 0; i < count; i++) {
+            if (block[i].m_left != nullptr) {
+                block[i].m_left = &block[block[i].m_left->m_id];
+            }
+            if (block[i].m_right != nullptr) {
+                block[i].m_right = &block[block[i].m_right->m_id];
+            }
+        }
+        if (m_type == BPTREE) {
+            for (int i = 0; i < count; i++) {
+                nodes[i] = &block[i];
+            }
+            m_bplus.build(nodes);
+        }else {
+            m_root = &block[m_root->m_id];
+        }
+        if (m_spatial != nullptr) {
+            m_spatial->remap([block](Robot* robot) {
+                return &block[robot->m_id];
+            });
+        }
+    }else {
+        m_root = nullptr;
+    }
+    for (Robot* block : oldBlocks) {
+        delete [] block;
+    }
+    fill(m_cache.begin(), m_cache.end(), nullptr);
+}
+
+
+/*
+Turns the counting of accesses on or off. While it is on, every robot returned
+by find or findBatch has its count (Robot::getAccesses) increased. The counts
+are kept when counting is turned off, so a workload can be recorded and the tree
+rebuilt for it later with rebuildWeighted.
+*/
+void Swarm::setAccessCounting(bool enabled){
+    m_counting = enabled;
+}
+
+
+//Sets the access count of every robot back to zero
+void Swarm::resetAccessCounts(){
+    vector<Robot*> nodes;
+    collectTree(nodes);
+    collectNodes(m_convertOld, nodes);
+    for (Robot* robot : nodes) {
+        robot->m_accesses = 0;
+    }
+}
+
+
+/*
+Relinks the robots as a tree shaped by their access counts for read-mostly
+periods. Every robot weighs its count plus one, and the root of every subtree
+is the robot where the weight of the subtree's id range is split in half
+(Mehlhorn's bisection rule). A robot with weight w then lies at depth at most
+about log2(W / w) + 1, where W is the total weight, so the expected depth of the
+counted finds is within a small constant of the optimal static BST. This can
+beat AVL and SPLAY on skewed lookups, without the writes of splaying. The nodes
+are relinked, not copied. The shape is not kept balanced by later inserts, so
+the tree becomes a BST; setType(AVL) balances it again. Tombstones are released
+and a conversion in progress is finished first. The counts are kept.
+*/
+void Swarm::rebuildWeighted(){
+    thaw();
+    finishConversion();
+    vector<Robot*> nodes;
+    collectTree(nodes);
+    m_bplus.clear();
+    dropTombstones(nodes);
+    //prefix[i] is the weight of nodes[0..i-1]
+    vector<long long> prefix(nodes.size() + 1, 0);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        prefix[i + 1] = prefix[i] + nodes[i]->m_accesses + 1;
+    }
+    m_root = linkWeighted(nodes, prefix, 0, (int)nodes.size() - 1);
+    if (m_type != NONE and m_type != BST) {
+        if (m_logging) {
+            appendLog(LOGSETTYPE, 0, BST);
+        }
+        useType(BST);
+    }
+}
+
+
+//Link nodes[low..high] with the node that splits their weight in half as the root
+Robot* Swarm::linkWeighted(vector<Robot*>& nodes, const vector<long long>& prefix, int low, int high){
+    if (low > high) {
+        return nullptr;
+    }
+    //the root is the node whose weight interval holds the middle of the range
+    long long middle = (prefix[low] + prefix[high + 1]) / 2;
+    int root = (int)(upper_bound(prefix.begin() + low + 1, prefix.begin() + high + 2, middle) - prefix.begin()) - 1;
+    Robot* robot = nodes[root];
+    robot->setLeft(linkWeighted(nodes, prefix, low, root - 1));
+    robot->setRight(linkWeighted(nodes, prefix, root + 1, high));
+    updateHeight(robot);
+    return robot;
+}
+
+
+//Returns true while an incremental conversion is in progress
+bool Swarm::isConverting() const{
+    return m_convertOld != nullptr;
+}
+
+
+//Unlink the next node of the old tree in post-order and insert it into the new tree
+void Swarm::migrateNode(){
+    if (m_convertPath.empty()) {
+        m_convertPath.push_back(m_convertOld);
+    }
+    //descend to the first leaf below the end of the path, left subtrees go first
+    Robot* robot = m_convertPath.back();
+    while (robot->getLeft() != nullptr or robot->getRight() != nullptr) {
+        robot = (robot->getLeft() != nullptr) ? robot->getLeft() : robot->getRight();
+        m_convertPath.push_back(robot);
+    }
+    m_convertPath.pop_back();
+    if (m_convertPath.empty()) {
+        m_convertOld = nullptr;
+    }else if (m_convertPath.back()->getLeft() == robot) {
+        m_convertPath.back()->setLeft(nullptr);
+    }else {
+        m_convertPath.back()->setRight(nullptr);
+    }
+    if (robot->m_tombstone) {
+        releaseNode(robot);
+    }else {
+        attachNode(robot);
+    }
+}
+
+
+//Move every node left by an incremental conversion
+void Swarm::finishConversion(){
+    while (m_convertOld != nullptr) {
+        migrateNode();
+    }
+}
+
+
+//Insert the unlinked node like emplace does for the current type, without allocating
+void Swarm::attachNode(Robot* node) {
+    visit([node](auto& tree) { tree.attach(node); }, m_tree);
+}
+
+
+//Search the tree an incremental conversion migrates from
+Robot* Swarm::findOld(int id) const{
+    Robot* robot = m_convertOld;
+    while (robot != nullptr and robot->getID() != id) {
+        SWARM_COUNT(comparisons);
+        robot = (id < robot->getID()) ? robot->getLeft() : robot->getRight();
+    }
+    return robot;
+}
+
+
+/*
+Turns the adaptive mode on or off. While it is on, every ADAPTSAMPLE-th find,
+insert and remove is sampled into a sliding window covering the latest window
+operations: whether it was a write, its locality (whether the id was among the
+latest ADAPTHOT sampled ids, or in a table of ADAPTRECENT recently sampled ids)
+and its search depth. Four times per window the measured cost of the current
+type is compared with the projected cost of AVL and SPLAY, and the tree is
+switched with setType when a switch saves more than ADAPTMARGIN of the current
+cost and its conversion pays off within ADAPTHORIZON windows. After a switch the
+window starts over, so the next switch needs a full window measured on the new
+type. Every switch is added to getAdaptLog().
+BST is never chosen, a BST is only kept while it is as cheap as the others.
+Since remove does not delete in a SPLAY tree, SPLAY is only chosen for windows
+without removes and a remove on a SPLAY tree switches it to AVL first.
+A tree of type NONE, WAVL or BPTREE is not switched.
+*/
+void Swarm::setAdaptive(bool enabled, int window){
+    m_adaptive = enabled;
+    m_adaptTotal = 0;
+    m_adaptLog.clear();
+    m_adaptWindow.assign(enabled ? max(window / ADAPTSAMPLE, 4) : 0, AdaptSample());
+    m_adaptRecent.assign(enabled ? ADAPTRECENT : 0, 0);
+    m_adaptLatest.assign(enabled ? ADAPTHOT : 0, 0);
+    for (double& correction : m_adaptCorrection) {
+        correction = 1;
+    }
+    m_adaptProjected = 0;
+    resetAdaptWindow();
+}
+
+
+//Returns true while the adaptive mode chooses the tree type
+bool Swarm::isAdaptive() const{
+    return m_adaptive;
+}
+
+
+//Returns every switch the adaptive mode made since it was enabled
+const vector<AdaptDecision>& Swarm::getAdaptLog() const{
+    return m_adaptLog;
+}
+
+
+//Count one operation, add every ADAPTSAMPLE-th to the sliding window and decide
+//four times per full window
+void Swarm::noteAccess(int id, bool write, bool remove){
+    if (remove and m_type == SPLAY) {
+        //a SPLAY tree would keep the robot
+        switchAdaptive(AVL, 0, 0, 2.0 * m_count);
+    }
+    m_adaptTotal++;
+    if (m_adaptTotal % ADAPTSAMPLE != 0) {
+        return;
+    }
+    int window = (int)m_adaptWindow.size();
+    AdaptSample& sample = m_adaptWindow[m_adaptOps % window];
+    if (m_adaptOps >= window) {
+        //the oldest sample leaves the window
+        m_adaptWrites = m_adaptWrites - sample.write;
+        m_adaptRemoves = m_adaptRemoves - sample.remove;
+        m_adaptRepeats = m_adaptRepeats - sample.repeat;
+        m_adaptHot = m_adaptHot - sample.hot;
+        m_adaptDepthSum = m_adaptDepthSum - sample.depth;
+    }
+    int& recent = m_adaptRecent[(((unsigned int)id * 2654435761u) >> 16) % ADAPTRECENT];
+    sample.write = write;
+    sample.remove = remove;
+    sample.repeat = (recent == id);
+    sample.hot = (std::find(m_adaptLatest.begin(), m_adaptLatest.end(), id) != m_adaptLatest.end());
+    sample.depth = searchDepth(id);
+    recent = id;
+    m_adaptLatest[m_adaptOps % ADAPTHOT] = id;
+    m_adaptWrites = m_adaptWrites + sample.write;
+    m_adaptRemoves = m_adaptRemoves + sample.remove;
+    m_adaptRepeats = m_adaptRepeats + sample.repeat;
+    m_adaptHot = m_adaptHot + sample.hot;
+    m_adaptDepthSum = m_adaptDepthSum + sample.depth;
+    m_adaptOps++;
+    if (m_adaptOps >= window and m_adaptOps % (window / 4) == 0) {
+        adapt();
+    }
+}
+
+
+/*
+Cost model of adapt, in node visits per operation (the measured depth counts the
+visited nodes). A find visits the search path once and an insert or remove in an
+AVL or BST walks it back up to update the heights. A splay rotates the path on
+every access, ADAPTSPLAYCOST visits per node, and keeps recently accessed ids
+near the root: a hot id at about the depth of a balanced tree of the hot ids, a
+recent one of ADAPTRECENT nodes and every other id at the balanced depth.
+The projection of a type is scaled by how far it was off the last time the tree
+switched to that type, so a model error does not make the tree switch back and
+forth.
+*/
+void Swarm::adapt(){
+    if (m_count < 2 or m_type == NONE or m_type == WAVL or m_type == BPTREE) {
+        return;
+    }
+    double window = (double)m_adaptWindow.size();
+    double writes = m_adaptWrites / window;
+    double hot = m_adaptHot / window;
+    double recent = max(0.0, m_adaptRepeats / window - hot);
+    double depth = m_adaptDepthSum / window;
+    //nodes a search visits in a balanced tree of the current size
+    double balanced = log2(m_count + 1.0);
+    double current = (m_type == SPLAY) ? ADAPTSPLAYCOST * depth : depth * (1 + writes);
+    double horizon = ADAPTHORIZON * window * ADAPTSAMPLE;
+    if (m_adaptProjected > 0) {
+        //the first full window after a switch tells how far off the projection of this type was
+        m_adaptCorrection[m_type] = current / m_adaptProjected;
+        m_adaptProjected = 0;
+    }
+
+    TREETYPE best = m_type;
+    double bestCost = current;
+    double bestConversion = 0;
+    double bestGain = 0;
+    //reconstructAVL inserts every node into the new tree again
+    double avl = balanced * (1 + writes) * m_adaptCorrection[AVL];
+    double avlGain = (current - avl) * horizon - balanced * m_count;
+    if (m_type != AVL and current - avl > ADAPTMARGIN * current and avlGain > bestGain) {
+        best = AVL;
+        bestCost = avl;
+        bestConversion = balanced * m_count;
+        bestGain = avlGain;
+    }
+    //switching to SPLAY keeps the shape, the hot ids sit in a subtree as large as
+    //the number of distinct ids among the latest samples
+    vector<int> latest = m_adaptLatest;
+    sort(latest.begin(), latest.end());
+    int hotIDs = (int)(unique(latest.begin(), latest.end()) - latest.begin());
+    double splay = ADAPTSPLAYCOST * (hot * log2(hotIDs + 1.0) + recent * log2(ADAPTRECENT + 1.0)
+                                     + (1 - hot - recent) * balanced) * m_adaptCorrection[SPLAY];
+    double splayGain = (current - splay) * horizon;
+    if (m_type != SPLAY and m_adaptRemoves == 0 and current - splay > ADAPTMARGIN * current
+        and splayGain > bestGain) {
+        best = SPLAY;
+        bestCost = splay;
+        bestConversion = 0;
+    }
+    if (best != m_type) {
+        switchAdaptive(best, current, bestCost, bestConversion);
+    }
+}
+
+
+//Log the switch with the rates of the window, convert the tree and start a new window
+void Swarm::switchAdaptive(TREETYPE type, double current, double projected, double conversion){
+    double window = (double)min<long long>(m_adaptOps, m_adaptWindow.size());
+    AdaptDecision decision;
+    decision.operation = m_adaptTotal;
+    decision.from = m_type;
+    decision.to = type;
+    decision.readRatio = (window > 0) ? 1 - m_adaptWrites / window : 0;
+    decision.locality = (window > 0) ? m_adaptRepeats / window : 0;
+    decision.hotLocality = (window > 0) ? m_adaptHot / window : 0;
+    decision.averageDepth = (window > 0) ? m_adaptDepthSum / window : 0;
+    decision.currentCost = current;
+    decision.projectedCost = projected;
+    decision.conversionCost = conversion;
+    m_adaptLog.push_back(decision);
+    m_adaptProjected = projected;
+    setType(type);
+    resetAdaptWindow();
+}
+
+
+//Start an empty window, the recently accessed ids are kept
+void Swarm::resetAdaptWindow(){
+    m_adaptOps = 0;
+    m_adaptWrites = 0;
+    m_adaptRemoves = 0;
+    m_adaptRepeats = 0;
+    m_adaptHot = 0;
+    m_adaptDepthSum = 0;
+}
+
+
+//Count the nodes a search for id visits, the robot itself included
+int Swarm::searchDepth(int id) const{
+    int depth = 0;
+    Robot* robot = m_root;
+    while (robot != nullptr) {
+        depth++;
+        if (id == robot->getID()) {
+            break;
+        }
+        robot = (id < robot->getID()) ? robot->getLeft() : robot->getRight();
+    }
+    return depth;
+}
+
+
+#ifdef SWARM_TRACE
+//Nanoseconds on the steady clock, the time base of the trace events
+static long long traceClock(){
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Swarm::TraceScope::TraceScope(Swarm* swarm, TRACEKIND kind, int id)
+    : m_swarm(swarm), m_kind(kind), m_id(id), m_start(traceClock()){}
+
+//Claims a slot with one atomic increment, so recording never takes a lock.
+//Once the buffer is full the oldest event is overwritten.
+Swarm::TraceScope::~TraceScope(){
+    unsigned long long slot = m_swarm->m_traceNext.fetch_add(1) & (TRACECAPACITY - 1);
+    TraceEvent& event = m_swarm->m_trace[slot];
+    event.kind = m_kind;
+    event.id = m_id;
+    event.depth = (m_swarm->m_type == BPTREE) ? m_swarm->m_bplus.height()
+                                              : m_swarm->getNodeHeight(m_swarm->m_root);
+    event.start = m_start;
+    event.end = traceClock();
+}
+#endif
+
+
+/*
+Writes the recorded events (the latest TRACECAPACITY of them) in the Chrome
+trace-event format, which chrome://tracing and Perfetto can open.
+Events are only recorded in a build with -DSWARM_TRACE, otherwise the array is empty.
+The times are microseconds with three decimals, so no nanosecond is lost, and the
+formatting of out is restored afterwards.
+*/
+void Swarm::writeTraceJSON(ostream& out) const{
+    const string names[] = {"insert", "remove", "setType"};
+    out << "[";
+#ifdef SWARM_TRACE
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+    out << fixed << setprecision(3);
+    unsigned long long last = m_traceNext;
+    unsigned long long first = (last > (unsigned long long)TRACECAPACITY) ? last - TRACECAPACITY : 0;
+    for (unsigned long long i = first; i < last; i++) {
+        const TraceEvent& event = m_trace[i & (TRACECAPACITY - 1)];
+        if (i != first) {
+            out << ",";
+        }
+        out << "\n{\"name\":\"" << names[event.kind] << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+            << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0
+            << ",\"args\":{\"id\":" << event.id << ",\"depth\":" << event.depth << "}}";
+    }
+    out.flags(flags);
+    out.precision(precision);
+#endif
+    out << "\n]\n";
+}
+
+
+//Returns TRACEBUCKETS counts of the recorded events of kind, bucket i counts the
+//events that took [2^i, 2^(i+1)) nanoseconds. All zero without -DSWARM_TRACE.
+vector<long long> Swarm::latencyHistogram([[maybe_unused]] TRACEKIND kind) const{
+    vector<long long> buckets(TRACEBUCKETS, 0);
+#ifdef SWARM_TRACE
+    unsigned long long last = m_traceNext;
+    unsigned long long first = (last > (unsigned long long)TRACECAPACITY) ? last - TRACECAPACITY : 0;
+    for (unsigned long long i = first; i < last; i++) {
+        const TraceEvent& event = m_trace[i & (TRACECAPACITY - 1)];
+        if (event.kind == kind) {
+            long long duration = event.end - event.start;
+            int bucket = 63 - __builtin_clzll((unsigned long long)duration | 1);
+            buckets[min(bucket, TRACEBUCKETS - 1)]++;
+        }
+    }
+#endif
+    return buckets;
+}
+
+
+/*
+Writes the swarm to a binary image at path and returns true on success.
+The image is a header (the bytes "SWRM", IMAGEVERSION, the tree type and the node
+count) followed by one IMAGERECORDSIZE byte record per node in pre-order: the id,
+the height and a flags byte holding the robot type (bits 0-2), the state (bit 3)
+whether the node has a left (bit 4) or right (bit 5) child and whether it is a
+tombstone (bit 6). A BPTREE is stored as a chain of right children in id order
+and loaded into a B+ tree again. Integers are stored in the byte order of the machine.
+The whole image is built in memory and written with a single call.
+A swarm in the middle of an incremental setType is written as a balanced tree of
+the new type holding the robots of both trees, so it is loaded fully converted
+while the swarm itself goes on stepping.
+*/
+bool Swarm::save(const string& path) const{
+    vector<char> image;
+    writeImage(image);
+    ofstream file(path, ios::binary | ios::trunc);
+    file.write(image.data(), image.size());
+    return file.good();
+}
+
+//Build the image that save writes in memory
+void Swarm::writeImage(vector<char>& image) const{
+    int count = 0;
+    vector<Robot*> stack;
+    if (m_root != nullptr) {
+        stack.push_back(m_root);
+    }
+    if (m_type == BPTREE) {
+        //written as a chain of right children in id order
+        m_bplus.collect(stack);
+        reverse(stack.begin(), stack.end());
+    }
+    //reserve the header, the count is known after the walk
+    image.resize(IMAGEHEADERSIZE);
+    if (m_convertOld != nullptr) {
+        //merge the migrated and the remaining robots, a balanced tree is valid for every type
+        stack.clear();
+        collectNodes(m_root, stack);
+        size_t migrated = stack.size();
+        collectNodes(m_convertOld, stack);
+        inplace_merge(stack.begin(), stack.begin() + migrated, stack.end(), [](Robot* a, Robot* b) {
+            return a->getID() < b->getID();
+        });
+        writeBalanced(image, stack, 0, (int)stack.size());
+        count = (int)stack.size();
+        stack.clear();
+    }
+    while (!stack.empty()) {
+        Robot* robot = stack.back();
+        stack.pop_back();
+        writeRecord(image, robot, robot->getHeight(), robot->getLeft() != nullptr,
+                    robot->getRight() != nullptr or (m_type == BPTREE and !stack.empty()));
+        count++;
+        //right is pushed first so that the left subtree is written first
+        if (robot->getRight() != nullptr) {
+            stack.push_back(robot->getRight());
+        }
+        if (robot->getLeft() != nullptr) {
+            stack.push_back(robot->getLeft());
+        }
+    }
+    int header[4] = {0, IMAGEVERSION, m_type, count};
+    memcpy(header, "SWRM", 4);
+    memcpy(image.data(), header, IMAGEHEADERSIZE);
+}
+
+
+//Append the image record of robot with the given height and children
+void Swarm::writeRecord(vector<char>& image, const Robot* robot, int height, bool left, bool right) {
+    char record[IMAGERECORDSIZE];
+    int id = robot->getID();
+    memcpy(record, &id, 4);
+    memcpy(record + 4, &height, 4);
+    record[8] = (char)(robot->getType() | (robot->getState() << 3) | (left << 4) | (right << 5)
+                       | (robot->m_tombstone << 6));
+    image.insert(image.end(), record, record + IMAGERECORDSIZE);
+}
+
+
+//Append the records of nodes[first, last) in pre-order as a balanced tree, the middle node is the root
+void Swarm::writeBalanced(vector<char>& image, const vector<Robot*>& nodes, int first, int last) {
+    int size = last - first;
+    if (size == 0) {
+        return;
+    }
+    //the left half holds size / 2 nodes and is never shorter than the right one
+    int middle = first + size / 2;
+    writeRecord(image, nodes[middle], 31 - __builtin_clz(size), middle > first, middle + 1 < last);
+    writeBalanced(image, nodes, first, middle);
+    writeBalanced(image, nodes, middle + 1, last);
+}
+
+
+/*
+Replaces the contents of the swarm with the image saved at path and returns true
+on success. The tree type, the exact tree shape and the stored heights are
+restored, so nothing is searched, rotated or recomputed: the file is read with
+one call, the nodes are allocated as one contiguous block and every record is
+linked to its parent in a single pass over the pre-order records.
+If the file is missing or is not a valid image the swarm is left empty.
+*/
+bool Swarm::load(const string& path){
+    clear();
+    ifstream file(path, ios::binary | ios::ate);
+    if (!file) {
+        return false;
+    }
+    streamsize size = file.tellg();
+    if (size < IMAGEHEADERSIZE) {
+        return false;
+    }
+    vector<char> image(size);
+    file.seekg(0);
+    if (!file.read(image.data(), size)) {
+        return false;
+    }
+    int header[4];
+    memcpy(header, image.data(), IMAGEHEADERSIZE);
+    int count = header[3];
+    if (memcmp(image.data(), "SWRM", 4) != 0 or header[1] != IMAGEVERSION
+        or header[2] < NONE or header[2] > BPTREE or count < 0
+        or size != IMAGEHEADERSIZE + (streamsize)count * IMAGERECORDSIZE) {
+        return false;
+    }
+    if (count == 0) {
+        useType(static_cast<TREETYPE>(header[2]));
+        return true;
+    }
+
+    Robot* block = allocateBlock(count);
+    m_count = count;
+    //nodes that have a right child which has not been read yet
+    vector<Robot*> waitingForRight;
+    Robot* previous = nullptr;
+    bool previousHasLeft = false;
+    const char* record = image.data() + IMAGEHEADERSIZE;
+    for (int i = 0; i < count; i++) {
+        int id;
+        int height;
+        memcpy(&id, record, 4);
+        memcpy(&height, record + 4, 4);
+        int flags = (unsigned char)record[8];
+        record = record + IMAGERECORDSIZE;
+        if ((flags & 7) > QUADRUPED) {
+            clear();
+            return false;
+        }
+        Robot* robot = &block[i];
+        *robot = Robot(id, static_cast<ROBOTTYPE>(flags & 7), static_cast<STATE>((flags >> 3) & 1));
+        robot->setHeight(height);
+        if (flags & 64) {
+            robot->m_tombstone = true;
+            m_tombstones++;
+        }
+        //in pre-order a node follows its parent if it is a left child, otherwise
+        //it is the right child of the latest node still waiting for one
+        if (previous == nullptr) {
+            m_root = robot;
+        }else if (previousHasLeft) {
+            previous->setLeft(robot);
+        }else if (!waitingForRight.empty()) {
+            waitingForRight.back()->setRight(robot);
+            waitingForRight.pop_back();
+        }else {
+            clear();
+            return false;
+        }
+        if (flags & 32) {
+            waitingForRight.push_back(robot);
+        }
+        previous = robot;
+        previousHasLeft = (flags & 16) != 0;
+    }
+    if (previousHasLeft or !waitingForRight.empty()) {
+        //a child was announced but the image ended
+        clear();
+        return false;
+    }
+    useType(static_cast<TREETYPE>(header[2]));
+    if (m_type == BPTREE) {
+        //in-order without recursion, the image of a BPTREE is one long chain
+        vector<Robot*> nodes;
+        vector<Robot*> stack;
+        for (Robot* robot = m_root; robot != nullptr or !stack.empty(); robot = robot->getRight()) {
+            while (robot != nullptr) {
+                stack.push_back(robot);
+                robot = robot->getLeft();
+            }
+            robot = stack.back();
+            stack.pop_back();
+            nodes.push_back(robot);
+        }
+        dropTombstones(nodes);
+        linkTree(nodes, 0);
+    }
+    return true;
+}
+
+
+/*
+Starts appending every insert, remove, setState and setType call to the write-ahead
+log at path and returns true on success. An existing log is kept and appended to,
+a missing one is created. An existing file has to start with the header of a log
+of LOGVERSION, or with a part of it left by a crash while the log was created;
+any other file is left untouched and false is returned. A record torn at the end
+by a crash is cut off before appending. Records are buffered and written and flushed groupSize
+at a time (group commit), so a crash loses at most the operations of the unwritten
+group; syncLog() commits the buffered records at once.
+clear, buildFrom, load and assignment are not logged, call compactLog afterwards
+to make their result durable.
+*/
+bool Swarm::openLog(const string& path, int groupSize){
+    closeLog();
+    error_code error;
+    uintmax_t size = filesystem::file_size(path, error);
+    if (error) {
+        size = 0;
+    }
+    //the header the file has to start with, a shorter file only a prefix of it
+    char expected[LOGHEADERSIZE];
+    int version = LOGVERSION;
+    memcpy(expected, "SWAL", 4);
+    memcpy(expected + 4, &version, 4);
+    if (size > 0) {
+        char header[LOGHEADERSIZE];
+        size_t length = (size_t)min(size, (uintmax_t)LOGHEADERSIZE);
+        ifstream existing(path, ios::binary);
+        if (!existing.read(header, length) or memcmp(header, expected, length) != 0) {
+            return false;
+        }
+    }
+    if (size >= (uintmax_t)LOGHEADERSIZE) {
+        //drop a record torn by a crash so that new records stay aligned
+        uintmax_t records = (size - LOGHEADERSIZE) / LOGRECORDSIZE;
+        filesystem::resize_file(path, LOGHEADERSIZE + records * LOGRECORDSIZE, error);
+        if (error) {
+            return false;
+        }
+        m_logFile.open(path, ios::binary | ios::app);
+    }else {
+        m_logFile.open(path, ios::binary | ios::trunc);
+        m_logFile.write(expected, LOGHEADERSIZE);
+        m_logFile.flush();
+    }
+    if (!m_logFile) {
+        m_logFile.close();
+        return false;
+    }
+    m_logPath = path;
+    m_logGroupSize = max(groupSize, 1);
+    m_logging = true;
+    return true;
+}
+
+
+//Writes and flushes the records buffered for the next group commit
+void Swarm::syncLog(){
+    if (!m_logging or m_logBuffer.empty()) {
+        return;
+    }
+    m_logFile.write(m_logBuffer.data(), m_logBuffer.size());
+    m_logFile.flush();
+    m_logBuffer.clear();
+}
+
+
+//Commits the buffered records, waits for a running compaction and stops logging
+void Swarm::closeLog(){
+    joinCompactor();
+    if (!m_logging) {
+        return;
+    }
+    syncLog();
+    m_logFile.close();
+    m_logging = false;
+    m_logPath.clear();
+}
+
+
+//Record checksum, offset so that a zeroed record is not valid
+static unsigned short logChecksum(const char* record){
+    unsigned int sum = 0x5A5A;
+    for (int i = 0; i < LOGRECORDSIZE - 2; i++) {
+        sum = sum * 31 + (unsigned char)record[i];
+    }
+    return (unsigned short)sum;
+}
+
+
+//Add one record to the buffer and commit the group once it is full
+void Swarm::appendLog(LOGOP op, int id, int argument){
+    char record[LOGRECORDSIZE];
+    memcpy(record, &id, 4);
+    record[4] = (char)op;
+    record[5] = (char)argument;
+    unsigned short checksum = logChecksum(record);
+    memcpy(record + 6, &checksum, 2);
+    m_logBuffer.insert(m_logBuffer.end(), record, record + LOGRECORDSIZE);
+    if ((int)m_logBuffer.size() >= m_logGroupSize * LOGRECORDSIZE) {
+        syncLog();
+    }
+}
+
+
+/*
+Applies the operations of the log at path to the swarm in the order they were
+logged and returns true if the whole log was valid. Runs of at least LOGBULKRUN
+consecutive inserts are merged into the tree in one pass over its nodes instead
+of being inserted one by one. A record torn at the end of the log by a crash is
+ignored; a corrupt record stops the replay and false is returned, with the
+records before it applied. Replayed operations are not logged again.
+*/
+bool Swarm::replay(const string& path){
+    ifstream file(path, ios::binary | ios::ate);
+    if (!file) {
+        return false;
+    }
+    streamsize size = file.tellg();
+    vector<char> log(max(size, (streamsize)0));
+    file.seekg(0);
+    if (size < LOGHEADERSIZE or !file.read(log.data(), size)) {
+        return false;
+    }
+    int header[2];
+    memcpy(header, log.data(), LOGHEADERSIZE);
+    if (memcmp(log.data(), "SWAL", 4) != 0 or header[1] != LOGVERSION) {
+        return false;
+    }
+    bool logging = m_logging;
+    m_logging = false;
+    thaw();
+    bool valid = true;
+    vector<Robot> inserts;
+    int count = (int)((size - LOGHEADERSIZE) / LOGRECORDSIZE);
+    const char* record = log.data() + LOGHEADERSIZE;
+    for (int i = 0; i <= count; i++, record = record + LOGRECORDSIZE) {
+        int id = 0;
+        int op = -1;
+        int argument = 0;
+        if (i < count) {
+            unsigned short checksum;
+            memcpy(&id, record, 4);
+            memcpy(&checksum, record + 6, 2);
+            op = (unsigned char)record[4];
+            argument = (unsigned char)record[5];
+            if (checksum != logChecksum(record) or op > LOGSETTYPE) {
+                valid = false;
+                count = i;
+                op = -1;
+            }
+        }
+        //collect consecutive inserts, any other record (or the end) applies them first
+        if (op == LOGINSERT and m_type != NONE) {
+            inserts.push_back(Robot(id, static_cast<ROBOTTYPE>(argument & 7),
+                                    static_cast<STATE>((argument >> 3) & 1)));
+            continue;
+        }
+        if ((int)inserts.size() >= LOGBULKRUN) {
+            mergeInserts(inserts);
+        }else {
+            for (const Robot& robot : inserts) {
+                insert(robot);
+            }
+        }
+        inserts.clear();
+        if (op == LOGINSERT) {
+            insert(Robot(id, static_cast<ROBOTTYPE>(argument & 7),
+                         static_cast<STATE>((argument >> 3) & 1)));
+        }else if (op == LOGREMOVE) {
+            remove(id);
+        }else if (op == LOGSETSTATE) {
+            setState(id, static_cast<STATE>(argument & 1));
+        }else if (op == LOGSETTYPE and argument <= BPTREE) {
+            setType(static_cast<TREETYPE>(argument));
+        }
+    }
+    m_logging = logging;
+    return valid;
+}
+
+
+/*
+Adds robots to the tree as if each was inserted in order: an id already in the
+tree, or repeated in robots, keeps its first robot. The new robots are sorted,
+merged with the nodes of the tree in id order and the result is relinked as a
+balanced tree, which is a valid BST, AVL and splay tree, or loaded into the B+
+tree of a BPTREE. Tombstones are released
+on the way, so an insert of a tombstoned id adds the robot again.
+*/
+void Swarm::mergeInserts(vector<Robot>& robots){
+    finishConversion();
+    parallelSort(robots);
+    auto sameID = [](const Robot& a, const Robot& b) {
+        return a.getID() == b.getID();
+    };
+    robots.erase(unique(robots.begin(), robots.end(), sameID), robots.end());
+    vector<Robot*> nodes;
+    collectTree(nodes);
+    dropTombstones(nodes);
+    vector<Robot*> merged;
+    merged.reserve(nodes.size() + robots.size());
+    Robot* block = allocateBlock((int)robots.size());
+    //the slots left over are counted off again when they go to the pool
+    m_count = m_count + (int)robots.size();
+    int used = 0;
+    size_t next = 0;
+    for (const Robot& robot : robots) {
+        while (next < nodes.size() and nodes[next]->getID() < robot.getID()) {
+            merged.push_back(nodes[next++]);
+        }
+        if (next < nodes.size() and nodes[next]->getID() == robot.getID()) {
+            continue;
+        }
+        block[used] = Robot(robot.getID(), robot.getType(), robot.getState());
+        merged.push_back(&block[used++]);
+    }
+    merged.insert(merged.end(), nodes.begin() + next, nodes.end());
+    //slots of the block left over by ids that already existed go to the pool
+    for (int i = used; i < (int)robots.size(); i++) {
+        releaseNode(&block[i]);
+    }
+    linkTree(merged, forkDepth(0));
+}
+
+
+/*
+Restores the swarm after a restart or crash from the image at imagePath (written
+by save or compactLog) and the log at logPath, and returns true if every file
+that exists was read without error. A missing image or log counts as empty.
+It also finishes or rolls back a compaction the crash interrupted: the
+compaction is committed when its old log (logPath + ".compacting") is removed,
+so while that file exists the new image (imagePath + ".tmp") is discarded and the
+old log is replayed, and once it is gone the new image replaces the old one.
+*/
+bool Swarm::recover(const string& imagePath, const string& logPath){
+    closeLog();
+    string oldLog = logPath + ".compacting";
+    string newImage = imagePath + ".tmp";
+    error_code error;
+    bool valid = true;
+    if (filesystem::exists(oldLog)) {
+        filesystem::remove(newImage, error);
+    }else if (filesystem::exists(newImage)) {
+        filesystem::rename(newImage, imagePath, error);
+        valid = !error;
+    }
+    if (filesystem::exists(imagePath)) {
+        valid = load(imagePath) and valid;
+    }else {
+        clear();
+    }
+    if (filesystem::exists(oldLog)) {
+        valid = replay(oldLog) and valid;
+    }
+    if (filesystem::exists(logPath)) {
+        valid = replay(logPath) and valid;
+    }
+    return valid;
+}
+
+
+/*
+Folds the open log into a fresh image at imagePath and returns true if the
+compaction was started. The image is built in memory and the log is switched to
+a new empty file right away; writing the image and retiring the old log happen
+on a background thread while the swarm keeps working. recover() completes or
+undoes a compaction a crash interrupted, and if the background step fails the
+old log is kept and folded into the next compaction.
+*/
+bool Swarm::compactLog(const string& imagePath){
+    if (!m_logging) {
+        return false;
+    }
+    joinCompactor();
+    syncLog();
+    finishConversion();
+    vector<char> image;
+    writeImage(image);
+    m_logFile.close();
+    string oldLog = m_logPath + ".compacting";
+    error_code error;
+    if (filesystem::exists(oldLog)) {
+        //an earlier compaction failed, keep its records in front of the new ones
+        uintmax_t size = filesystem::file_size(m_logPath, error);
+        if (!error and size > (uintmax_t)LOGHEADERSIZE) {
+            ifstream current(m_logPath, ios::binary);
+            current.seekg(LOGHEADERSIZE);
+            ofstream previous(oldLog, ios::binary | ios::app);
+            previous << current.rdbuf();
+            if (!previous) {
+                error = make_error_code(errc::io_error);
+            }
+        }
+    }else {
+        filesystem::rename(m_logPath, oldLog, error);
+    }
+    string path = m_logPath;
+    int groupSize = m_logGroupSize;
+    m_logging = false;
+    if (error) {
+        //the log was not retired, keep appending to it
+        openLog(path, groupSize);
+        return false;
+    }
+    filesystem::remove(path, error);
+    if (!openLog(path, groupSize)) {
+        return false;
+    }
+    m_compactor = thread([imagePath, oldLog](vector<char> image) {
+        string newImage = imagePath + ".tmp";
+        ofstream file(newImage, ios::binary | ios::trunc);
+        file.write(image.data(), image.size());
+        file.close();
+        if (!file) {
+            return;
+        }
+        error_code error;
+        if (filesystem::remove(oldLog, error)) {
+            filesystem::rename(newImage, imagePath, error);
+        }
+    }, move(image));
+    return true;
+}
+
+
+//Wait for the background part of the latest compaction to finish
+void Swarm::joinCompactor(){
+    if (m_compactor.joinable()) {
+        m_compactor.join();
+    }
+}
+
+
+SpatialIndex::SpatialIndex(float cellSize)
+    : m_cellSize(cellSize), m_size(0) {
+    for (int axis = 0; axis < 3; axis++) {
+        m_low[axis] = SPATIALRANGE;
+        m_high[axis] = -SPATIALRANGE;
+    }
+}
+
+
+//Place robot at position, a robot already in the index is moved
+void SpatialIndex::set(Robot* robot, const Position& position){
+    int id = robot->getID();
+    int cell[3];
+    cellOf(position, cell);
+    long long key = cellKey(cell);
+    auto current = m_cellOf.find(id);
+    if (current != m_cellOf.end()) {
+        if (current->second == key) {
+            for (Entry& entry : m_cells[key]) {
+                if (entry.m_id == id) {
+                    entry.m_position = position;
+                    entry.m_robot = robot;
+                    return;
+                }
+            }
+        }
+        erase(robot);
+    }
+    m_cells[key].push_back(Entry{id, position, robot});
+    m_cellOf[id] = key;
+    m_size++;
+    for (int axis = 0; axis < 3; axis++) {
+        m_low[axis] = min(m_low[axis], cell[axis]);
+        m_high[axis] = max(m_high[axis], cell[axis]);
+    }
+}
+
+
+//Take the robot out of the index, nothing happens if its node has no position
+void SpatialIndex::erase(const Robot* robot){
+    int id = robot->getID();
+    auto current = m_cellOf.find(id);
+    if (current == m_cellOf.end()) {
+        return;
+    }
+    auto cell = m_cells.find(current->second);
+    vector<Entry>& entries = cell->second;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].m_id == id) {
+            if (entries[i].m_robot != robot) {
+                return;
+            }
+            entries[i] = entries.back();
+            entries.pop_back();
+            break;
+        }
+    }
+    if (entries.empty()) {
+        m_cells.erase(cell);
+    }
+    m_cellOf.erase(current);
+    m_size--;
+}
+
+
+//Copy the position of id into position, false if it has none
+bool SpatialIndex::get(int id, Position& position) const{
+    auto current = m_cellOf.find(id);
+    if (current == m_cellOf.end()) {
+        return false;
+    }
+    for (const Entry& entry : m_cells.at(current->second)) {
+        if (entry.m_id == id) {
+            position = entry.m_position;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+//Drop every position
+void SpatialIndex::clear(){
+    m_cells.clear();
+    m_cellOf.clear();
+    m_size = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        m_low[axis] = SPATIALRANGE;
+        m_high[axis] = -SPATIALRANGE;
+    }
+}
+
+
+int SpatialIndex::size() const{
+    return m_size;
+}
+
+
+//Bytes of the two tables and the cell vectors, estimated like the heap lays them out
+long long SpatialIndex::bytes() const{
+    long long total = (m_cells.bucket_count() + m_cellOf.bucket_count()) * sizeof(void*)
+                      + m_cells.size() * (sizeof(pair<long long, vector<Entry>>) + sizeof(void*) + 2 * BLOCKHEADERSIZE)
+                      + m_cellOf.size() * (sizeof(pair<int, long long>) + sizeof(void*) + BLOCKHEADERSIZE);
+    for (const auto& cell : m_cells) {
+        total += cell.second.capacity() * sizeof(Entry);
+    }
+    return total;
+}
+
+
+/*
+Visits the cells in rings of growing Chebyshev distance around the cell of center
+and keeps the k best matches in a max-heap. The search stops once the k-th best
+distance is no more than the distance from center to the nearest face of the
+visited box that has cells behind it. When the rings would visit more cells than hold robots
+(robots far apart, or a filter that few robots match) every non-empty cell is
+scanned instead.
+*/
+void SpatialIndex::findNearest(const Position& center, int k, vector<Robot*>& robots,
+                               int typeMask, int stateMask) const{
+    if (k <= 0 or m_cells.empty()) {
+        return;
+    }
+    vector<pair<float, Robot*>> best;
+    auto offer = [&](const Entry& entry) {
+        if (!matches(entry.m_robot, typeMask, stateMask)) {
+            return;
+        }
+        float dx = entry.m_position.x - center.x;
+        float dy = entry.m_position.y - center.y;
+        float dz = entry.m_position.z - center.z;
+        float distance = dx * dx + dy * dy + dz * dz;
+        if ((int)best.size() < k) {
+            best.push_back(make_pair(distance, entry.m_robot));
+            push_heap(best.begin(), best.end());
+        }else if (distance < best.front().first) {
+            pop_heap(best.begin(), best.end());
+            best.back() = make_pair(distance, entry.m_robot);
+            push_heap(best.begin(), best.end());
+        }
+    };
+    float coordinates[3] = {center.x, center.y, center.z};
+    int c[3];
+    cellOf(center, c);
+    int lastRing = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        lastRing = max(lastRing, max(c[axis] - m_low[axis], m_high[axis] - c[axis]));
+    }
+    long long visited = 0;
+    for (int ring = 0; ring <= lastRing; ring++) {
+        visited += boxCells(c, ring) - (ring > 0 ? boxCells(c, ring - 1) : 0);
+        if (visited > (long long)m_cells.size()) {
+            best.clear();
+            for (const auto& cell : m_cells) {
+                for (const Entry& entry : cell.second) {
+                    offer(entry);
+                }
+            }
+            break;
+        }
+        //the shell of the ring inside the bounds: every z where x or y is on the
+        //shell, otherwise only the two z faces
+        auto visit = [&](const int cell[3]) {
+            auto found = m_cells.find(cellKey(cell));
+            if (found != m_cells.end()) {
+                for (const Entry& entry : found->second) {
+                    offer(entry);
+                }
+            }
+        };
+        int cell[3];
+        for (cell[0] = max(c[0] - ring, m_low[0]); cell[0] <= min(c[0] + ring, m_high[0]); cell[0]++) {
+            for (cell[1] = max(c[1] - ring, m_low[1]); cell[1] <= min(c[1] + ring, m_high[1]); cell[1]++) {
+                if (abs(cell[0] - c[0]) == ring or abs(cell[1] - c[1]) == ring) {
+                    for (cell[2] = max(c[2] - ring, m_low[2]); cell[2] <= min(c[2] + ring, m_high[2]); cell[2]++) {
+                        visit(cell);
+                    }
+                    continue;
+                }
+                cell[2] = c[2] - ring;
+                if (cell[2] >= m_low[2]) {
+                    visit(cell);
+                }
+                cell[2] = c[2] + ring;
+                if (cell[2] <= m_high[2]) {
+                    visit(cell);
+                }
+            }
+        }
+        //the nearest a robot outside the box can be, through a face with cells behind it
+        float reach = -1;
+        for (int axis = 0; axis < 3; axis++) {
+            if (c[axis] - ring > m_low[axis]) {
+                float gap = coordinates[axis] - (c[axis] - ring) * m_cellSize;
+                reach = (reach < 0) ? gap : min(reach, gap);
+            }
+            if (c[axis] + ring < m_high[axis]) {
+                float gap = (c[axis] + ring + 1) * m_cellSize - coordinates[axis];
+                reach = (reach < 0) ? gap : min(reach, gap);
+            }
+        }
+        if ((int)best.size() == k and (reach < 0 or best.front().first <= reach * reach)) {
+            break;
+        }
+    }
+    sort_heap(best.begin(), best.end());
+    for (const pair<float, Robot*>& match : best) {
+        robots.push_back(match.second);
+    }
+}
+
+
+//Checks the cells of the box around center, or every non-empty cell if there are fewer of those
+void SpatialIndex::findRadius(const Position& center, float radius, vector<Robot*>& robots,
+                              int typeMask, int stateMask) const{
+    if (radius < 0 or m_cells.empty()) {
+        return;
+    }
+    float limit = radius * radius;
+    auto check = [&](const Entry& entry) {
+        float dx = entry.m_position.x - center.x;
+        float dy = entry.m_position.y - center.y;
+        float dz = entry.m_position.z - center.z;
+        if (dx * dx + dy * dy + dz * dz <= limit and matches(entry.m_robot, typeMask, stateMask)) {
+            robots.push_back(entry.m_robot);
+        }
+    };
+    int low[3];
+    int high[3];
+    cellOf(Position{center.x - radius, center.y - radius, center.z - radius}, low);
+    cellOf(Position{center.x + radius, center.y + radius, center.z + radius}, high);
+    long long cells = 1;
+    for (int axis = 0; axis < 3; axis++) {
+        low[axis] = max(low[axis], m_low[axis]);
+        high[axis] = min(high[axis], m_high[axis]);
+        cells = cells * max(0, high[axis] - low[axis] + 1);
+    }
+    if (cells > (long long)m_cells.size()) {
+        for (const auto& cell : m_cells) {
+            for (const Entry& entry : cell.second) {
+                check(entry);
+            }
+        }
+        return;
+    }
+    int cell[3];
+    for (cell[0] = low[0]; cell[0] <= high[0]; cell[0]++) {
+        for (cell[1] = low[1]; cell[1] <= high[1]; cell[1]++) {
+            for (cell[2] = low[2]; cell[2] <= high[2]; cell[2]++) {
+                auto found = m_cells.find(cellKey(cell));
+                if (found != m_cells.end()) {
+                    for (const Entry& entry : found->second) {
+                        check(entry);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+//Cell coordinates of position, clamped to the packable range
+void SpatialIndex::cellOf(const Position& position, int cell[3]) const{
+    float coordinates[3] = {position.x, position.y, position.z};
+    for (int axis = 0; axis < 3; axis++) {
+        float scaled = floor(coordinates[axis] / m_cellSize);
+        scaled = max(scaled, (float)-SPATIALRANGE);
+        scaled = min(scaled, (float)(SPATIALRANGE - 1));
+        cell[axis] = (int)scaled;
+    }
+}
+
+
+//Pack the three cell coordinates into 21 bits each
+long long SpatialIndex::cellKey(const int cell[3]){
+    return ((long long)(cell[0] + SPATIALRANGE) << 42) | ((long long)(cell[1] + SPATIALRANGE) << 21)
+           | (long long)(cell[2] + SPATIALRANGE);
+}
+
+
+//Number of cells within ring of center, per axis cut to the cells that were ever used
+long long SpatialIndex::boxCells(const int center[3], int ring) const{
+    long long cells = 1;
+    for (int axis = 0; axis < 3; axis++) {
+        cells = cells * max(0, min(center[axis] + ring, m_high[axis]) - max(center[axis] - ring, m_low[axis]) + 1);
+    }
+    return cells;
+}
+
+
+//True if the type and state of robot are in the masks and it is not removed
+bool SpatialIndex::matches(const Robot* robot, int typeMask, int stateMask){
+    return !robot->isTombstone() and ((typeMask >> robot->getType()) & 1) and ((stateMask >> robot->getState()) & 1);
+}
+
+
+BPlusTree::BPlusTree() : m_root(nullptr), m_height(-1), m_nodes(0) {}
+
+
+BPlusTree::~BPlusTree(){
+    clear();
+}
+
+
+//Search one node per level, the first id of a node that is not less than id leads down
+Robot* BPlusTree::find(int id) const{
+    Node* node = m_root;
+    if (node == nullptr) {
+        return nullptr;
+    }
+    while (!node->m_leaf) {
+        int index = Swarm::countLess(node->m_ids, id);
+        if (index == node->m_count) {
+            return nullptr;
+        }
+        node = node->m_children[index];
+    }
+    int index = Swarm::countLess(node->m_ids, id);
+    if (index < node->m_count and node->m_ids[index] == id) {
+        return node->m_robots[index];
+    }
+    return nullptr;
+}
+
+
+/*
+Returns the leaf slot of id. If the id was not in the tree the slot is new and
+added is set, the slot then holds nullptr and the caller stores the robot in it,
+so a duplicate id costs no allocation. The slot stays valid until the next insert
+or erase. A full root is split into a new root, which is the only way the tree
+grows higher.
+*/
+Robot** BPlusTree::insert(int id, bool& added){
+    if (m_root == nullptr) {
+        m_root = newNode(true);
+        m_height = 0;
+    }
+    Node* split = nullptr;
+    Robot** slot = insertNode(m_root, id, added, split);
+    if (split != nullptr) {
+        Node* root = newNode(false);
+        root->m_count = 2;
+        root->m_children[0] = m_root;
+        root->m_children[1] = split;
+        root->m_ids[0] = maxID(m_root);
+        root->m_ids[1] = maxID(split);
+        m_root = root;
+        m_height++;
+    }
+    return slot;
+}
+
+
+//Insert id below node, a full node is split before the id goes into one of its halves
+Robot** BPlusTree::insertNode(Node* node, int id, bool& added, Node*& split){
+    split = nullptr;
+    int index = Swarm::countLess(node->m_ids, id);
+    if (node->m_leaf) {
+        if (index < node->m_count and node->m_ids[index] == id) {
+            added = false;
+            return &node->m_robots[index];
+        }
+        added = true;
+        if (node->m_count == BTREEKEYS) {
+            split = splitNode(node);
+            if (index > BTREEKEYS / 2) {
+                node = split;
+                index = index - BTREEKEYS / 2;
+            }
+        }
+        openSlot(node, index);
+        node->m_ids[index] = id;
+        node->m_robots[index] = nullptr;
+        return &node->m_robots[index];
+    }
+    //an id larger than every id goes into the last child, whose largest id it becomes
+    index = min(index, node->m_count - 1);
+    Node* child = node->m_children[index];
+    Node* childSplit = nullptr;
+    Robot** slot = insertNode(child, id, added, childSplit);
+    if (!added) {
+        return slot;
+    }
+    node->m_ids[index] = maxID(child);
+    if (childSplit != nullptr) {
+        index++;
+        if (node->m_count == BTREEKEYS) {
+            split = splitNode(node);
+            if (index > BTREEKEYS / 2) {
+                node = split;
+                index = index - BTREEKEYS / 2;
+            }
+        }
+        openSlot(node, index);
+        node->m_ids[index] = maxID(childSplit);
+        node->m_children[index] = childSplit;
+    }
+    return slot;
+}
+
+
+/*
+Takes id out of the tree and returns its robot, or nullptr if it is not there.
+A node left less than half full is refilled from a sibling, a root with one child
+is replaced by the child and an empty root leaf is deleted.
+*/
+Robot* BPlusTree::erase(int id){
+    if (m_root == nullptr) {
+        return nullptr;
+    }
+    Robot* robot = eraseNode(m_root, id);
+    if (!m_root->m_leaf and m_root->m_count == 1) {
+        Node* root = m_root;
+        m_root = root->m_children[0];
+        delete root;
+        m_nodes--;
+        m_height--;
+    }else if (m_root->m_leaf and m_root->m_count == 0) {
+        delete m_root;
+        m_nodes--;
+        m_root = nullptr;
+        m_height = -1;
+    }
+    return robot;
+}
+
+
+//Erase id below node and repair the child it was erased from
+Robot* BPlusTree::eraseNode(Node* node, int id){
+    int index = Swarm::countLess(node->m_ids, id);
+    if (index == node->m_count) {
+        return nullptr;
+    }
+    if (node->m_leaf) {
+        if (node->m_ids[index] != id) {
+            return nullptr;
+        }
+        Robot* robot = node->m_robots[index];
+        closeSlot(node, index);
+        return robot;
+    }
+    Node* child = node->m_children[index];
+    Robot* robot = eraseNode(child, id);
+    if (robot == nullptr) {
+        return nullptr;
+    }
+    if (child->m_count < BTREEKEYS / 2) {
+        fixChild(node, index);
+    }else {
+        node->m_ids[index] = maxID(child);
+    }
+    return robot;
+}
+
+
+//Refill child index of node from its left sibling (the right one for the first
+//child): take one entry if the sibling can spare it, otherwise merge the two
+void BPlusTree::fixChild(Node* node, int index){
+    if (index > 0) {
+        index--;
+    }
+    //left and right are neighbours, one of them is the child that is short
+    Node* left = node->m_children[index];
+    Node* right = node->m_children[index + 1];
+    if (left->m_count > BTREEKEYS / 2 and left->m_count > right->m_count) {
+        openSlot(right, 0);
+        moveEntries(left, left->m_count - 1, 1, right, 0);
+        closeSlot(left, left->m_count - 1);
+    }else if (right->m_count > BTREEKEYS / 2) {
+        moveEntries(right, 0, 1, left, left->m_count);
+        left->m_count++;
+        closeSlot(right, 0);
+    }else {
+        moveEntries(right, 0, right->m_count, left, left->m_count);
+        left->m_count = left->m_count + right->m_count;
+        if (left->m_leaf) {
+            left->m_next = right->m_next;
+        }
+        delete right;
+        m_nodes--;
+        node->m_ids[index] = maxID(left);
+        closeSlot(node, index + 1);
+        return;
+    }
+    node->m_ids[index] = maxID(left);
+    node->m_ids[index + 1] = maxID(right);
+}
+
+
+//Move the upper half of the full node into a new node that follows it
+BPlusTree::Node* BPlusTree::splitNode(Node* node){
+    Node* right = newNode(node->m_leaf);
+    int half = BTREEKEYS / 2;
+    moveEntries(node, half, BTREEKEYS - half, right, 0);
+    right->m_count = BTREEKEYS - half;
+    node->m_count = half;
+    fill(node->m_ids + half, node->m_ids + BTREEKEYS, INT_MAX);
+    if (node->m_leaf) {
+        right->m_next = node->m_next;
+        node->m_next = right;
+    }
+    return right;
+}
+
+
+//Copy count ids and their children or robots from position first of from to position at of to
+void BPlusTree::moveEntries(Node* from, int first, int count, Node* to, int at){
+    memmove(to->m_ids + at, from->m_ids + first, count * sizeof(int));
+    if (from->m_leaf) {
+        memmove(to->m_robots + at, from->m_robots + first, count * sizeof(Robot*));
+    }else {
+        memmove(to->m_children + at, from->m_children + first, count * sizeof(Node*));
+    }
+}
+
+
+void BPlusTree::openSlot(Node* node, int index){
+    moveEntries(node, index, node->m_count - index, node, index + 1);
+    node->m_count++;
+}
+
+
+void BPlusTree::closeSlot(Node* node, int index){
+    moveEntries(node, index + 1, node->m_count - index - 1, node, index);
+    node->m_count--;
+    node->m_ids[node->m_count] = INT_MAX;
+}
+
+
+/*
+Replaces the tree with robots, which are sorted by id. Every level is cut into
+as few nodes as hold it, with the entries spread evenly, so every node but the
+root is at least half full and the leaves are mostly full.
+*/
+void BPlusTree::build(const vector<Robot*>& robots){
+    clear();
+    if (robots.empty()) {
+        return;
+    }
+    vector<Node*> level;
+    int size = (int)robots.size();
+    int count = (size + BTREEKEYS - 1) / BTREEKEYS;
+    for (int i = 0; i < count; i++) {
+        Node* leaf = newNode(true);
+        int first = (int)((long long)size * i / count);
+        leaf->m_count = (int)((long long)size * (i + 1) / count) - first;
+        for (int j = 0; j < leaf->m_count; j++) {
+            leaf->m_ids[j] = robots[first + j]->getID();
+            leaf->m_robots[j] = robots[first + j];
+        }
+        if (!level.empty()) {
+            level.back()->m_next = leaf;
+        }
+        level.push_back(leaf);
+    }
+    m_height = 0;
+    while (level.size() > 1) {
+        vector<Node*> parents;
+        size = (int)level.size();
+        count = (size + BTREEKEYS - 1) / BTREEKEYS;
+        for (int i = 0; i < count; i++) {
+            Node* parent = newNode(false);
+            int first = (int)((long long)size * i / count);
+            parent->m_count = (int)((long long)size * (i + 1) / count) - first;
+            for (int j = 0; j < parent->m_count; j++) {
+                parent->m_ids[j] = maxID(level[first + j]);
+                parent->m_children[j] = level[first + j];
+            }
+            parents.push_back(parent);
+        }
+        level.swap(parents);
+        m_height++;
+    }
+    m_root = level[0];
+}
+
+
+//Append every robot in id order by following the leaf chain
+void BPlusTree::collect(vector<Robot*>& robots) const{
+    if (m_root == nullptr) {
+        return;
+    }
+    Node* node = m_root;
+    while (!node->m_leaf) {
+        node = node->m_children[0];
+    }
+    for (; node != nullptr; node = node->m_next) {
+        robots.insert(robots.end(), node->m_robots, node->m_robots + node->m_count);
+    }
+}
+
+
+//Descend to the leaf of low and scan the leaf chain until an id passes high
+void BPlusTree::findRange(int low, int high, vector<Robot*>& robots) const{
+    Node* node = m_root;
+    if (node == nullptr) {
+        return;
+    }
+    while (!node->m_leaf) {
+        int index = Swarm::countLess(node->m_ids, low);
+        if (index == node->m_count) {
+            return;
+        }
+        node = node->m_children[index];
+    }
+    for (int index = Swarm::countLess(node->m_ids, low); node != nullptr; node = node->m_next, index = 0) {
+        for (; index < node->m_count; index++) {
+            if (node->m_ids[index] > high) {
+                return;
+            }
+            robots.push_back(node->m_robots[index]);
+        }
+    }
+}
+
+
+//Interleaved descents like findGroupBTree, every search takes exactly one node per level
+void BPlusTree::findBatch(const int* ids, int count, Robot** out) const{
+    Node* nodes[BATCHGROUP];
+    for (int i = 0; i < count; i++) {
+        nodes[i] = m_root;
+    }
+    for (int level = 0; level < m_height; level++) {
+        for (int i = 0; i < count; i++) {
+            if (nodes[i] == nullptr) {
+                continue;
+            }
+            int index = Swarm::countLess(nodes[i]->m_ids, ids[i]);
+            nodes[i] = (index == nodes[i]->m_count) ? nullptr : nodes[i]->m_children[index];
+            if (nodes[i] != nullptr) {
+                __builtin_prefetch(nodes[i]);
+            }
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        out[i] = nullptr;
+        if (nodes[i] != nullptr) {
+            int index = Swarm::countLess(nodes[i]->m_ids, ids[i]);
+            if (index < nodes[i]->m_count and nodes[i]->m_ids[index] == ids[i]) {
+                out[i] = nodes[i]->m_robots[index];
+            }
+        }
+    }
+}
+
+
+//Delete every node, the robots belong to the pool of the swarm
+void BPlusTree::clear(){
+    freeNodes(m_root);
+    m_root = nullptr;
+    m_height = -1;
+    m_nodes = 0;
+}
+
+
+//Levels below the root, all leaves are this deep; -1 while empty
+int BPlusTree::height() const{
+    return m_height;
+}
+
+
+long long BPlusTree::bytes() const{
+    return (long long)m_nodes * sizeof(Node);
+}
+
+
+BPlusTree::Node* BPlusTree::newNode(bool leaf){
+    Node* node = new Node;
+    node->m_count = 0;
+    node->m_leaf = leaf;
+    fill(node->m_ids, node->m_ids + BTREEKEYS, INT_MAX);
+    node->m_next = nullptr;
+    m_nodes++;
+    return node;
+}
+
+
+void BPlusTree::freeNodes(Node* node){
+    if (node == nullptr) {
+        return;
+    }
+    if (!node->m_leaf) {
+        for (int i = 0; i < node->m_count; i++) {
+            freeNodes(node->m_children[i]);
+        }
     }
+    delete node;
 }
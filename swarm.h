@@ -2,87 +2,290 @@
 #ifndef SWARM_H
 #define SWARM_H
 #include <iostream>
+#include <fstream>
+#include <vector>
+#include <thread>
+#include <unordered_map>
+#include <variant>
+#include "basicswarm.h"
+#ifdef SWARM_TRACE
+#include <atomic>
+#endif
 using namespace std;
 class Grader;//this class is for grading purposes, no need to do anything
 class Tester;//this is your tester class, you add your test functions in this class
+class Fuzzer;//the differential fuzzer in fuzz.cpp, it checks the tree structure
 class Swarm;
-enum STATE {ALIVE, DEAD};   // possible states for a robot
-enum ROBOTTYPE {BIRD, DRONE, REPTILE, SUB, QUADRUPED};
-enum TREETYPE {NONE, BST, AVL, SPLAY};
+class BPlusTree;
+class RobotStorage;
+enum TREETYPE {NONE, BST, AVL, SPLAY, WAVL, BPTREE};
+enum FROZENLAYOUT {EYTZINGER, BTREE}; // array layouts a frozen swarm can use for lookups
+enum TRACEKIND {TRACEINSERT, TRACEREMOVE, TRACESETTYPE}; // operations recorded by the tracing layer
+enum DUMPFORMAT {DUMPTEXT, DUMPJSON, DUMPDOT};  // output formats of Swarm::dumpTree
+enum LOGOP {LOGINSERT, LOGREMOVE, LOGSETSTATE, LOGSETTYPE}; // operations recorded in the write-ahead log
 const int MINID = 10000;    // min robot ID
 const int MAXID = 99999;    // max robot ID
-#define DEFAULT_HEIGHT 0
-#define DEFAULT_ID 0
-#define DEFAULT_TYPE DRONE
-#define DEFAULT_STATE ALIVE
+const int POOLBLOCKSIZE = 16;       // nodes in the first block the pool allocates
+const int MAXPOOLBLOCKSIZE = 4096;  // cap for the geometric growth of pool blocks
+const int PARALLELCUTOFF = 4096;    // subtrees smaller than this are built on one thread
+const int CACHELINE = 64;           // bytes of a cache line, the partial results of parallel runs are kept this far apart
+const int BTREEKEYS = 16;           // sorted ids per node of the B+ trees, the frozen BTREE layout and BPTREE
+const int BATCHGROUP = 16;          // searches findBatch advances in lockstep
+const int TRACECAPACITY = 4096;     // events kept by the trace ring buffer, a power of two
+const int TRACEBUCKETS = 32;        // latency histogram buckets, bucket i counts [2^i, 2^(i+1)) ns
+const int DUMPBLOCKSIZE = 65536;    // bytes the dump engine collects before each write
+const int IMAGEVERSION = 1;         // version of the binary image written by Swarm::save
+const int IMAGEHEADERSIZE = 16;     // magic, version, tree type and node count, 4 bytes each
+const int IMAGERECORDSIZE = 9;      // id and height (4 bytes each) and one byte of flags per node
+const int LOGVERSION = 1;           // version of the write-ahead log written by Swarm::openLog
+const int LOGHEADERSIZE = 8;        // magic and version, 4 bytes each
+const int LOGRECORDSIZE = 8;        // id (4 bytes), operation, argument and a 2 byte checksum
+const int LOGGROUPSIZE = 64;        // default records buffered before a group commit
+const int LOGBULKRUN = 1024;        // consecutive logged inserts that replay merges in one pass
+const int BATCHMERGERATIO = 8;      // a batch is merged once it is 1/BATCHMERGERATIO of the tree
+const int CACHESLOTS = 1024;        // default slots of the hot-id cache, rounded up to a power of two
+const int ADAPTWINDOW = 4096;       // default operations in the sliding window of the adaptive mode
+const int ADAPTSAMPLE = 16;         // every ADAPTSAMPLE-th operation is sampled by the adaptive mode
+const int ADAPTRECENT = 256;        // slots of the table of recently sampled ids
+const int ADAPTHOT = 16;            // latest sampled ids that count as hot
+const double ADAPTSPLAYCOST = 6;    // node visits a splay costs per node it rotates, measured against AVL finds
+const int ADAPTHORIZON = 8;         // windows of the same workload a switch has to pay for itself in
+const double ADAPTMARGIN = 0.1;     // fraction of the current cost a switch has to save at least
+const double TOMBSTONERATIO = 0.25; // default fraction of tombstoned nodes that triggers a compaction
+const int CONVERTBUDGET = 50;       // default microseconds a step() call migrates nodes for
+const int CONVERTCHECK = 8;         // nodes an incremental conversion migrates between two reads of the clock
+const int BLOCKHEADERSIZE = 16;     // bytes the heap keeps in front of every pool block, an estimate
+const float SPATIALCELL = 10;       // default edge length of a cell of the spatial index
+const int SPATIALRANGE = 1 << 20;   // cell coordinates are clamped to [-SPATIALRANGE, SPATIALRANGE)
+const int ALLTYPES = (1 << (QUADRUPED + 1)) - 1;    // type mask of the spatial queries that matches every ROBOTTYPE
+const int ALLSTATES = (1 << (DEAD + 1)) - 1;        // state mask of the spatial queries that matches every STATE
 
-class Robot{
+/*
+Operation counters and tree shape reported by Swarm::stats().
+The counters are only collected when the program is compiled with -DSWARM_STATS,
+otherwise the counting statements compile to nothing and the counters stay zero.
+The shape fields are computed by stats() in every build.
+*/
+struct SwarmStats{
+    long long comparisons = 0;      // key comparisons, one per node visited on a search path
+    long long leftRotations = 0;    // left rotations
+    long long rightRotations = 0;   // right rotations
+    long long rebalances = 0;       // rebalance calls that found an imbalance
+    long long splays = 0;           // splay operations
+    long long splayDepth = 0;       // total depth of the splayed nodes
+    long long heightUpdates = 0;    // node heights recomputed
+    int nodeCount = 0;              // nodes in the tree, tombstones included
+    int tombstones = 0;             // nodes removed lazily and not compacted yet
+    int height = -1;                // height of the root, -1 for an empty tree
+    double averageDepth = 0;        // average depth of a node, the root has depth 0
+    double accessDepth = 0;         // average depth of a counted find (Swarm::setAccessCounting)
+    int maxDepth = -1;              // depth of the deepest node
+};
+//Counters of the hot-id cache (Swarm::setCache), kept in every build
+struct CacheStats{
+    long long hits = 0;     // finds answered by the cache
+    long long misses = 0;   // finds that searched the tree
+    int slots = 0;          // 0 while the cache is off
+    double hitRate = 0;     // hits / (hits + misses)
+};
+//Memory held by a swarm (Swarm::memoryUsage), in bytes unless noted
+struct MemoryUsage{
+    int nodes = 0;                  // nodes in the tree, tombstones included
+    long long nodeBytes = 0;        // bytes of those nodes
+    long long poolBytes = 0;        // bytes of all pool blocks, used and free
+    long long overheadBytes = 0;    // free pool slots, block headers and the block list, caches and other side tables
+    long long totalBytes = 0;       // the Swarm object, its nodes and the overhead
+    int blocks = 0;                 // pool blocks
+    double fragmentation = 0;       // fraction of the pool slots that are free
+};
+//Coordinates of a robot in the spatial index (Swarm::setPosition), z stays 0 in the plane
+struct Position{
+    float x = 0;
+    float y = 0;
+    float z = 0;
+};
+/*
+One tree type switch of the adaptive mode (Swarm::setAdaptive) and the window it
+was decided on. The costs are node visits per operation.
+*/
+struct AdaptDecision{
+    long long operation;    // operations sampled since the adaptive mode was enabled
+    TREETYPE from;
+    TREETYPE to;
+    double readRatio;       // fraction of the window that were finds
+    double locality;        // fraction of the window that accessed a recently sampled id
+    double hotLocality;     // fraction of the window that accessed one of the latest ADAPTHOT sampled ids
+    double averageDepth;    // measured average of the nodes a search visits
+    double currentCost;     // measured cost of the old type
+    double projectedCost;   // projected cost of the new type
+    double conversionCost;  // node visits of the conversion, 0 if no rebuild is needed
+};
+//One operation in the window of the adaptive mode
+struct AdaptSample{
+    bool write;
+    bool remove;
+    bool repeat;    // the id was sampled recently
+    bool hot;       // the id was among the latest ADAPTHOT sampled ids
+    int depth;      // nodes the search visited
+};
+/*
+One traced operation. For TRACESETTYPE the id is the new TREETYPE.
+The times are steady clock nanoseconds, depth is the height of the tree after the operation.
+*/
+struct TraceEvent{
+    TRACEKIND kind;
+    int id;
+    int depth;
+    long long start;
+    long long end;
+};
+#ifdef SWARM_TRACE
+#define SWARM_TRACE_SCOPE(kind, id) TraceScope traceScope(this, kind, id)
+#else
+#define SWARM_TRACE_SCOPE(kind, id) ((void)0)
+#endif
+
+#ifdef SWARM_STATS
+#define SWARM_COUNT(counter) (m_stats.counter++)
+#define SWARM_ADD(counter, amount) (m_stats.counter += (amount))
+#else
+#define SWARM_COUNT(counter) ((void)0)
+#define SWARM_ADD(counter, amount) ((void)0)
+#endif
+
+/*
+The spatial index of a Swarm (Swarm::setSpatialIndex), a uniform grid of robot
+positions. Space is cut into cubes of cellSize and every cell that holds robots
+keeps their nodes and positions in a vector, found through a hash of the cell
+coordinates. Unlike a k-d tree the grid never has to be rebuilt: an insert, a
+remove or a move touches one or two cells. Queries visit the cells around the
+center ring by ring, so the cell size should be about the distance between
+neighbouring robots. Robots in the plane all have z = 0 and use one layer of cells.
+*/
+class SpatialIndex{
     public:
     friend class Swarm;
-    friend class Grader;
-    friend class Tester;
-    Robot(int id, ROBOTTYPE type = DEFAULT_TYPE, STATE state = DEFAULT_STATE)
-        :m_id(id),m_type(type), m_state(state) {
-            m_left = nullptr;
-            m_right = nullptr;
-            m_height = DEFAULT_HEIGHT;
-        }
-    Robot(){
-        m_id = DEFAULT_ID;
-        m_type = DEFAULT_TYPE;
-        m_state = DEFAULT_STATE;
-        m_left = nullptr;
-        m_right = nullptr;
-        m_height = DEFAULT_HEIGHT;
-    }
-    int getID() const {return m_id;}
-    STATE getState() const {return m_state;}
-    string getStateStr() const {
-        string text = "";
-        switch (m_state)
-        {
-        case DEAD:text = "DEAD";break;
-        case ALIVE:text = "ALIVE";break;
-        default:text = "UNKOWN";break;
-        }
-        return text;
-    }
-    ROBOTTYPE getType() const {return m_type;}
-    string getTypeStr() const {
-        string text = "";
-        switch (m_type)
-        {
-        case BIRD:text = "BIRD";break;
-        case DRONE:text = "DRONE";break;
-        case REPTILE:text = "REPTILE";break;
-        case SUB:text = "SUB";break;
-        case QUADRUPED:text = "QUADRUPED";break;
-        default:text = "UNKNOWN";break;
+    SpatialIndex(float cellSize = SPATIALCELL);
+    void set(Robot* robot, const Position& position);
+    void erase(const Robot* robot);
+    bool get(int id, Position& position) const;
+    void clear();
+    int size() const;
+    long long bytes() const;
+    void findNearest(const Position& center, int k, vector<Robot*>& robots, int typeMask, int stateMask) const;
+    void findRadius(const Position& center, float radius, vector<Robot*>& robots, int typeMask, int stateMask) const;
+    private:
+    //A robot in a cell, the position is kept next to the node for the distance checks
+    struct Entry{
+        int m_id;
+        Position m_position;
+        Robot* m_robot;
+    };
+    float m_cellSize;
+    unordered_map<long long, vector<Entry>> m_cells;    // the robots of every non-empty cell
+    unordered_map<int, long long> m_cellOf;             // the cell key of every id with a position
+    int m_size;                                         // robots in the index
+    int m_low[3];   // the smallest cell coordinates a robot was placed at, only ever widened
+    int m_high[3];  // the largest ones
+
+    void cellOf(const Position& position, int cell[3]) const; //helper to find the cell coordinates of position
+    static long long cellKey(const int cell[3]); //helper to pack cell coordinates into a hash key
+    long long boxCells(const int center[3], int ring) const; //helper to count the cells within ring of center inside the bounds
+    static bool matches(const Robot* robot, int typeMask, int stateMask); //helper for the query filters
+    //helper to point every entry at a new node, for copies and compact
+    template <class Remap>
+    void remap(Remap remap) {
+        for (auto& cell : m_cells) {
+            for (Entry& entry : cell.second) {
+                entry.m_robot = remap(entry.m_robot);
+            }
         }
-        return text
-        ;
     }
-    int getHeight() const {return m_height;}
-    Robot* getLeft() const {return m_left;}
-    Robot* getRight() const {return m_right;}
-    void setID(const int id){m_id=id;}
-    void setState(STATE state){m_state=state;}
-    void setType(ROBOTTYPE type){m_type=type;}
-    void setHeight(int height){m_height=height;}
-    void setLeft(Robot* left){m_left=left;}
-    void setRight(Robot* right){m_right=right;}
+};
+/*
+The nodes of a BPTREE swarm, a mutable B+ tree over the robots of the pool.
+Every node holds up to BTREEKEYS sorted ids: a leaf the robots of its ids and an
+inner node one child per id, where the id is the largest one below that child.
+A node is searched with the SIMD compare of the frozen BTREE layout, so a lookup
+in a 90k swarm touches 5 nodes instead of the 17 of a balanced binary tree, and
+the leaves are chained in id order for range scans. Every node but the root is
+at least half full: an insert splits a full node in two, and a remove that
+leaves a node less than half full takes an id from a sibling or merges with it.
+All leaves are at the same depth. Only the B+ nodes are allocated here, the
+robots stay in the pool of the swarm.
+*/
+class BPlusTree{
+    public:
+    friend class Swarm;
+    friend class Fuzzer;
+    BPlusTree();
+    ~BPlusTree();
+    BPlusTree(const BPlusTree&) = delete;
+    BPlusTree& operator=(const BPlusTree&) = delete;
+    Robot* find(int id) const;
+    Robot** insert(int id, bool& added);
+    Robot* erase(int id);
+    void build(const vector<Robot*>& robots);
+    void collect(vector<Robot*>& robots) const;
+    void findRange(int low, int high, vector<Robot*>& robots) const;
+    void findBatch(const int* ids, int count, Robot** out) const;
+    void clear();
+    int height() const;
+    long long bytes() const;
     private:
-    int m_id;
-    ROBOTTYPE m_type;
-    STATE m_state;
-    Robot* m_left;  //the pointer to the left child in the BST
-    Robot* m_right; //the pointer to the right child in the BST
-    int m_height;   //the height of this node in the BST 
+    struct Node{
+        int m_count;            // ids in use
+        bool m_leaf;
+        int m_ids[BTREEKEYS];   // sorted ids, the unused slots hold INT_MAX
+        union{
+            Node* m_children[BTREEKEYS];    // inner node: child i holds the ids up to m_ids[i]
+            Robot* m_robots[BTREEKEYS];     // leaf: the robot of m_ids[i]
+        };
+        Node* m_next;           // leaf: the next leaf in id order, nullptr for the last one
+    };
+    Node* m_root;   // nullptr while empty
+    int m_height;   // levels below the root, -1 while empty
+    int m_nodes;    // nodes allocated
+
+    Node* newNode(bool leaf); //helper to allocate an empty node
+    void freeNodes(Node* node); //helper to delete the subtree at node
+    Robot** insertNode(Node* node, int id, bool& added, Node*& split); //helper for insert, split is the new right sibling of a split node
+    Robot* eraseNode(Node* node, int id); //helper for erase
+    void fixChild(Node* node, int index); //helper to refill a child left less than half full by a sibling
+    Node* splitNode(Node* node); //helper to move the upper half of a full node into a new right sibling
+    static void moveEntries(Node* from, int first, int count, Node* to, int at); //helper to copy ids and pointers between nodes
+    static void openSlot(Node* node, int index); //helper to shift the entries from index one slot right
+    static void closeSlot(Node* node, int index); //helper to shift the entries after index one slot left
+    static int maxID(const Node* node) {return node->m_ids[node->m_count - 1];}
+};
+/*
+The storage of the trees of a Swarm (see BasicSwarm): the nodes are the Robots of
+the pool of the swarm, each its own payload, and the root is Swarm::m_root. The
+work of the tree is added to the statistics of the swarm.
+*/
+class RobotStorage{
+    public:
+    typedef Robot Node;
+    typedef Robot Record;
+    RobotStorage(Swarm* swarm) : m_swarm(swarm) {}
+    Robot*& root() const;
+    int size() const;
+    static int keyOf(const Robot* robot) {return robot->getID();}
+    static Robot& payloadOf(Robot* robot) {return *robot;}
+    Robot* allocate(int id, ROBOTTYPE type = DEFAULT_TYPE, STATE state = DEFAULT_STATE);
+    void release(Robot* robot);
+    void clear();
+    void count(TREECOUNTER counter, int amount = 1);
+    private:
+    Swarm* m_swarm;
 };
 class Swarm{
     public:
     friend class Grader;
     friend class Tester;
+    friend class Fuzzer;
+    friend class BPlusTree;
+    friend class RobotStorage;
     Swarm();
     Swarm(TREETYPE type);
     ~Swarm();
@@ -91,32 +294,314 @@ class Swarm{
     TREETYPE getType() const;
     void setType(TREETYPE type);
     void insert(const Robot& robot);
+    pair<Robot*, bool> tryInsert(const Robot& robot);
+    int insertBatch(const vector<Robot>& robots, vector<bool>& added);
+    pair<Robot*, bool> emplace(int id, ROBOTTYPE type = DEFAULT_TYPE, STATE state = DEFAULT_STATE);
     void remove(int id);
+    int removeBatch(const vector<int>& ids, vector<bool>& removed);
+    bool setState(int id, STATE state);
+    void buildFrom(vector<Robot> robots, TREETYPE type);
+    Robot* find(int id);
+    void findBatch(const int* ids, size_t n, Robot** out);
+    void freeze(FROZENLAYOUT layout = EYTZINGER);
+    void thaw();
+    bool isFrozen() const;
+    void findRange(int low, int high, vector<Robot*>& robots) const;
+    void setSpatialIndex(bool enabled, float cellSize = SPATIALCELL);
+    void insert(const Robot& robot, const Position& position);
+    bool setPosition(int id, const Position& position);
+    bool getPosition(int id, Position& position) const;
+    void findNearest(const Position& center, int k, vector<Robot*>& robots,
+                     int typeMask = ALLTYPES, int stateMask = ALLSTATES) const;
+    void findRadius(const Position& center, float radius, vector<Robot*>& robots,
+                    int typeMask = ALLTYPES, int stateMask = ALLSTATES) const;
+    SwarmStats stats() const;
+    int size() const;
+    void resetStats();
+    void setAdaptive(bool enabled, int window = ADAPTWINDOW);
+    bool isAdaptive() const;
+    const vector<AdaptDecision>& getAdaptLog() const;
+    void setCache(int slots = CACHESLOTS);
+    CacheStats cacheStats() const;
+    void setLazyDelete(bool enabled, double threshold = TOMBSTONERATIO);
+    void purgeTombstones();
+    void setConversionBudget(int microseconds);
+    bool step(int budget = CONVERTBUDGET);
+    bool isConverting() const;
+    MemoryUsage memoryUsage() const;
+    void setMemoryBudget(long long bytes);
+    void compact();
+    void setAccessCounting(bool enabled);
+    void resetAccessCounts();
+    void rebuildWeighted();
+    bool save(const string& path) const;
+    bool load(const string& path);
+    bool openLog(const string& path, int groupSize = LOGGROUPSIZE);
+    void syncLog();
+    void closeLog();
+    bool replay(const string& path);
+    bool recover(const string& imagePath, const string& logPath);
+    bool compactLog(const string& imagePath);
+    void writeTraceJSON(ostream& out) const;
+    vector<long long> latencyHistogram(TRACEKIND kind) const;
+    template <class Visit>
+    void parallelForEach(Visit visit, unsigned int threads = 0) const;
+    template <class T, class Fold, class Combine>
+    T parallelReduce(T identity, Fold fold, Combine combine, unsigned int threads = 0) const;
     void dumpTree() const;
+    void dumpTree(ostream& out, DUMPFORMAT format = DUMPTEXT, int maxDepth = -1) const;
+    int dumpTree(char* buffer, int size, DUMPFORMAT format = DUMPTEXT, int maxDepth = -1) const;
     private:
+    //The robot tree of one tree type, its inserts, removes and splays compiled for the policy
+    template <class BalancePolicy>
+    using RobotTree = BasicSwarm<BalancePolicy, HeightLayout, RobotStorage>;
+
     Robot* m_root;  // the root of the BST
     TREETYPE m_type;// the type of tree
+    variant<RobotTree<BSTPolicy>, RobotTree<AVLPolicy>, RobotTree<SplayPolicy>, RobotTree<WAVLPolicy>> m_tree; // the tree of m_type, NONE and BPTREE keep the BST one
+    int m_count;    // robots in the tree
+    Robot* m_freeList;          // recycled nodes, chained through m_left
+    vector<Robot*> m_blocks;    // node blocks owned by this swarm
+    int m_nextBlockSize;        // size of the next block the pool allocates
+    long long m_poolSlots;      // nodes in all blocks, used and free
+    long long m_memoryBudget;   // bytes the blocks may take, 0 for no limit
+    bool m_counting;            // true while find counts the accesses of every robot
+    bool m_frozen;                  // true while the frozen layout below is valid
+    vector<int> m_frozenIDs;        // ids in Eytzinger (BFS) order, slot 0 is unused
+    vector<Robot*> m_frozenNodes;   // the node of every slot in m_frozenIDs
+    FROZENLAYOUT m_frozenLayout;    // the layout find() uses while frozen
+    vector<Robot*> m_sortedNodes;   // nodes in id order for the BTREE layout
+    vector<vector<int>> m_btreeLevels; // BTREE levels, level 0 holds all ids, the last level is the root node
+    bool m_logging;                 // true while operations are appended to the log
+    string m_logPath;               // path of the open log
+    ofstream m_logFile;             // the open log
+    vector<char> m_logBuffer;       // records waiting for the next group commit
+    int m_logGroupSize;             // records per group commit
+    thread m_compactor;             // background part of the latest compactLog
+    bool m_adaptive;                // true while the workload chooses the tree type
+    vector<AdaptSample> m_adaptWindow;  // ring of the latest samples
+    long long m_adaptOps;           // samples taken since the window was reset
+    long long m_adaptTotal;         // operations since the adaptive mode was enabled
+    int m_adaptWrites;              // inserts and removes in the window
+    int m_adaptRemoves;             // removes in the window
+    int m_adaptRepeats;             // samples in the window of a recently sampled id
+    int m_adaptHot;                 // samples in the window of one of the latest sampled ids
+    long long m_adaptDepthSum;      // sum of the search depths in the window
+    vector<int> m_adaptRecent;      // recently sampled ids, direct-mapped by a hash of the id
+    vector<int> m_adaptLatest;      // the latest ADAPTHOT sampled ids
+    double m_adaptCorrection[WAVL + 1]; // measured over projected cost of every type, from its last switch
+    double m_adaptProjected;        // projected cost of the latest switch until the new type is measured
+    vector<Robot*> m_cache;         // hot-id cache, direct-mapped by a hash of the id, empty while off
+    int m_cacheShift;               // shift that turns the hash of an id into a cache slot
+    long long m_cacheHits;          // finds answered by the cache
+    long long m_cacheMisses;        // finds that searched the tree
+    bool m_lazyDelete;              // true while remove marks tombstones instead of unlinking
+    double m_tombstoneRatio;        // fraction of tombstoned nodes that triggers purgeTombstones
+    int m_tombstones;               // tombstoned nodes still in the tree, counted in m_count
+    Robot* m_convertOld;            // the tree an incremental setType migrates from, nullptr when none
+    vector<Robot*> m_convertPath;   // path from m_convertOld down to the next node to migrate
+    int m_convertBudget;            // microseconds every operation migrates for, 0 converts at once
+    SpatialIndex* m_spatial;        // positions of the robots, nullptr while the spatial index is off
+    BPlusTree m_bplus;              // the nodes of a BPTREE swarm, whose m_root stays nullptr, empty for the other types
+    vector<AdaptDecision> m_adaptLog;   // every switch of the adaptive mode
+#ifdef SWARM_STATS
+    mutable SwarmStats m_stats;     // operation counters, lookups are const but still counted
+#endif
+#ifdef SWARM_TRACE
+    TraceEvent m_trace[TRACECAPACITY];      // ring buffer of the latest events
+    atomic<unsigned long long> m_traceNext; // events recorded so far, the next slot is this modulo the capacity
+
+    //Records the operation of its enclosing scope into the ring buffer when it ends
+    class TraceScope{
+        public:
+        TraceScope(Swarm* swarm, TRACEKIND kind, int id);
+        ~TraceScope();
+        private:
+        Swarm* m_swarm;
+        TRACEKIND m_kind;
+        int m_id;
+        long long m_start;
+    };
+#endif
 
     // ***************************************************
     // Any private helper functions must be delared here!
     // ***************************************************
 
-    void dump(Robot* aBot) const;//helper for recursive traversal
-    void recursiveClear(Robot* robot); //helper for clear
-    Robot* insertBST(Robot *m_root, Robot *robot); //helper to insert into a BST
-    Robot* insertAVL(Robot *m_root, Robot *robot); //helper to insert into a AVL
-    Robot* insertSplay(Robot *m_root, Robot *robot); //helper to insert into a SPLAY
-    Robot* removeRobotNode(Robot * robot, int id);
+    template <class Flush>
+    void writeDump(DUMPFORMAT format, int maxDepth, Flush flush) const;//helper for the dump engine
+    template <class Flush>
+    void writeDumpBPlus(const BPlusTree::Node* node, int depth, DUMPFORMAT format, int maxDepth,
+                        string& block, Flush& flush) const; //helper for the dump engine to write a BPTREE
+    void useType(TREETYPE type); //helper to set m_type and the tree that runs its operations
     Robot* deepCopy(Robot* robot); //helper for recursive copy
     void reconstructAVL(); //helper to reform into an AVL
-    Robot* leftRotate(Robot* robot);
-    Robot* rightRotate(Robot* robot);
-    Robot* rebalance(Robot * robot);
     int getBalance(Robot * robot);
-    Robot* splay(Robot * robot, int id);
     int getNodeHeight(Robot * robot);
-    void transferNodes(Robot* root, Robot*& newRoot);
     int recalculateHeight(Robot* node);
+    void updateHeight(Robot* robot); //helper to set height from the cached child heights
+    Robot* allocateNode(int id, ROBOTTYPE type, STATE state); //helper to take a node from the pool
+    void releaseNode(Robot* robot); //helper to return a node to the pool
+    Robot* allocateBlock(int count); //helper to add a contiguous block of nodes to the pool
+    long long budgetSlots() const; //helper to get how many more nodes the memory budget allows the pool
+    static void collectNodes(Robot* robot, vector<Robot*>& nodes); //helper to list nodes in order
+    Robot* linkBalanced(vector<Robot*>& nodes, int low, int high, int depth); //helper to link sorted nodes as a balanced tree
+    void collectTree(vector<Robot*>& nodes); //helper to list the nodes of the tree of any type in order
+    void linkTree(vector<Robot*>& nodes, int depth); //helper to link sorted nodes as the tree of the current type
+    Robot* linkWeighted(vector<Robot*>& nodes, const vector<long long>& prefix, int low, int high); //helper to link sorted nodes by their access weights
+    static void parallelSort(vector<Robot>& robots); //helper to sort robots by id on all cores
     Robot* getRobotAtThisID(int id);
+    Robot* lookup(int id); //helper for find to search without the cache
+    int cacheSlot(int id) const; //helper to get the cache slot of id
+    void markTombstone(int id); //helper for a lazy remove
+    void dropTombstones(vector<Robot*>& nodes); //helper to release the tombstones of a node list
+    void migrateNode(); //helper to move the next node of an incremental conversion into the new tree
+    void finishConversion(); //helper to migrate every node left at once
+    void attachNode(Robot* node); //helper to insert an unlinked node into the tree without allocating
+    Robot* findOld(int id) const; //helper to search the tree an incremental conversion migrates from
+    void findRangeTree(Robot* robot, int low, int high, vector<Robot*>& robots) const; //helper for findRange to walk one tree
+    void writeImage(vector<char>& image) const; //helper to build the image save writes
+    static void writeRecord(vector<char>& image, const Robot* robot, int height, bool left, bool right); //helper to append one image record
+    static void writeBalanced(vector<char>& image, const vector<Robot*>& nodes, int first, int last); //helper to write sorted nodes as a balanced tree
+    void appendLog(LOGOP op, int id, int argument); //helper to add one record to the log
+    void mergeInserts(vector<Robot>& robots); //helper for replay to add a run of inserts in one pass
+    void joinCompactor(); //helper to wait for a background compaction
+    void noteAccess(int id, bool write, bool remove); //helper for the adaptive mode to count and sample an operation
+    void adapt(); //helper to switch the tree type if the sampled window projects a saving
+    void switchAdaptive(TREETYPE type, double current, double projected, double conversion); //helper to log and make a switch
+    void resetAdaptWindow(); //helper to start a new sampling window
+    int searchDepth(int id) const; //helper to count the nodes a search for id visits, without restructuring
+    void fillEytzinger(vector<Robot*>& nodes, int& next, int slot); //helper for freeze
+    Robot* findFrozen(int id) const; //helper to search the frozen layout
+    int lowerBoundBTree(int id) const; //helper to get the position of the first id not less than id
+    static int countLess(const int* keys, int id); //helper to count the keys of a B+ tree node less than id
+    void findGroupTree(const int* ids, int count, Robot** out) const; //helpers for findBatch, one group of searches each
+    void findGroupEytzinger(const int* ids, int count, Robot** out) const;
+    void findGroupBTree(const int* ids, int count, Robot** out) const;
+    static int forkDepth(unsigned int threads); //helper to get how many tree levels fork onto new threads
+    template <class T, class Fold, class Combine>
+    T reduceSubtree(Robot* robot, int depth, const T& identity, Fold& fold, Combine& combine) const;
+    template <class T, class Fold, class Combine>
+    T reduceLeaves(int depth, const T& identity, Fold& fold, Combine& combine) const;
+    //The result of one run of reduceLeaves on a cache line of its own. Runs write their results
+    //concurrently, so no two may share a word (vector<bool> packs its elements) or a line.
+    template <class T>
+    struct alignas(CACHELINE) Partial{
+        T m_value;
+    };
 };
+
+inline Robot*& RobotStorage::root() const {return m_swarm->m_root;}
+inline int RobotStorage::size() const {return m_swarm->m_count;}
+inline Robot* RobotStorage::allocate(int id, ROBOTTYPE type, STATE state) {return m_swarm->allocateNode(id, type, state);}
+inline void RobotStorage::release(Robot* robot) {m_swarm->releaseNode(robot);}
+inline void RobotStorage::clear() {m_swarm->clear();}
+inline void RobotStorage::count([[maybe_unused]] TREECOUNTER counter, [[maybe_unused]] int amount) {
+#ifdef SWARM_STATS
+    SwarmStats& stats = m_swarm->m_stats;
+    long long* counters[] = {&stats.comparisons, &stats.leftRotations, &stats.rightRotations, &stats.rebalances,
+                             &stats.splays, &stats.splayDepth, &stats.heightUpdates};
+    *counters[counter] += amount;
+#endif
+}
+
+/*
+Calls visit(const Robot&) once for every robot in the tree. The upper levels of the
+tree are split across threads (all cores when threads is 0) and the subtrees below
+them are visited concurrently, so visit must be safe to call from several threads
+and the tree must not be modified until the call returns. The order is unspecified.
+*/
+template <class Visit>
+void Swarm::parallelForEach(Visit visit, unsigned int threads) const{
+    parallelReduce(0, [&visit](int&, const Robot& robot) { visit(robot); },
+                   [](int&, const int&) {}, threads);
+}
+
+/*
+Aggregates the whole tree on several threads. Every task starts from a copy of
+identity, fold(T& result, const Robot& robot) adds one robot to a task's result and
+combine(T& result, const T& other) merges the result of another task into result.
+combine must be associative and commutative since the visiting order is unspecified.
+Like parallelForEach the tree is read-only for the duration of the call.
+*/
+template <class T, class Fold, class Combine>
+T Swarm::parallelReduce(T identity, Fold fold, Combine combine, unsigned int threads) const{
+    if (m_type == BPTREE) {
+        return reduceLeaves(forkDepth(threads), identity, fold, combine);
+    }
+    T result = reduceSubtree(m_root, forkDepth(threads), identity, fold, combine);
+    if (m_convertOld != nullptr) {
+        //nodes an incremental setType has not migrated yet
+        combine(result, reduceSubtree(m_convertOld, forkDepth(threads), identity, fold, combine));
+    }
+    return result;
+}
+
+//Reduce the subtree at robot, forking the left child onto a new thread while depth is positive
+template <class T, class Fold, class Combine>
+T Swarm::reduceSubtree(Robot* robot, int depth, const T& identity, Fold& fold, Combine& combine) const{
+    T result = identity;
+    if (robot == nullptr) {
+        return result;
+    }
+    if (depth <= 0) {
+        //iterative walk, a degenerate BST can be deeper than the call stack allows
+        vector<Robot*> stack;
+        stack.push_back(robot);
+        while (!stack.empty()) {
+            Robot* node = stack.back();
+            stack.pop_back();
+            if (!node->m_tombstone) {
+                fold(result, *node);
+            }
+            if (node->m_left != nullptr) {
+                stack.push_back(node->m_left);
+            }
+            if (node->m_right != nullptr) {
+                stack.push_back(node->m_right);
+            }
+        }
+        return result;
+    }
+    T leftResult = identity;
+    thread worker([&]() {
+        leftResult = reduceSubtree(robot->m_left, depth - 1, identity, fold, combine);
+    });
+    T rightResult = reduceSubtree(robot->m_right, depth - 1, identity, fold, combine);
+    if (!robot->m_tombstone) {
+        fold(result, *robot);
+    }
+    worker.join();
+    combine(result, leftResult);
+    combine(result, rightResult);
+    return result;
+}
+
+//Reduce a BPTREE, its robots in id order are split into 2^depth runs that are folded concurrently
+template <class T, class Fold, class Combine>
+T Swarm::reduceLeaves(int depth, const T& identity, Fold& fold, Combine& combine) const{
+    vector<Robot*> robots;
+    m_bplus.collect(robots);
+    int runs = ((int)robots.size() < PARALLELCUTOFF) ? 1 : 1 << depth;
+    vector<Partial<T>> results(runs, Partial<T>{identity});
+    vector<thread> workers;
+    for (int i = 1; i < runs; i++) {
+        workers.push_back(thread([&, i]() {
+            size_t last = robots.size() * (i + 1) / runs;
+            for (size_t j = robots.size() * i / runs; j < last; j++) {
+                fold(results[i].m_value, *robots[j]);
+            }
+        }));
+    }
+    for (size_t j = 0; j < robots.size() / runs; j++) {
+        fold(results[0].m_value, *robots[j]);
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    for (int i = 1; i < runs; i++) {
+        combine(results[0].m_value, results[i].m_value);
+    }
+    return results[0].m_value;
+}
 #endif
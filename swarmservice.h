@@ -0,0 +1,391 @@
+// UMBC - CMSC 341 - Fall 2024 - Proj2
+#ifndef SWARMSERVICE_H
+#define SWARMSERVICE_H
+#include "swarm.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+SwarmService is a front end that lets many threads change one Swarm without
+sharing a lock. insert, remove and setState push a command on a lock-free
+multi-producer queue and return a future that is set once the command has
+been applied. A single owner thread takes everything queued so far, sorts it
+by id and applies it as one batch, through Swarm::insertBatch and removeBatch. The
+sort is stable, so the commands for one id keep the order they were queued in
+and every future gets the result the direct call would have returned.
+
+Readers do not touch the owner's tree. snapshot() returns a frozen copy taken
+between two batches, which holds every command queued before the call and can
+be searched by any number of threads. Copying is O(n), so a snapshot is
+shared by every reader until the next batch changes the tree.
+
+The service must not be used after its destructor starts; the destructor
+applies whatever is still queued before it returns.
+*/
+
+enum COMMANDOP {COMMANDINSERT, COMMANDREMOVE, COMMANDSETSTATE, COMMANDSNAPSHOT, COMMANDFLUSH};
+
+//A read-only frozen copy of a Swarm taken by the owner thread of a SwarmService
+class SwarmSnapshot{
+    public:
+    SwarmSnapshot(const Swarm& swarm, long long version) : m_version(version) {
+        m_swarm = swarm;
+        //the copy takes the settings of the swarm, turn off the ones a find writes to
+        m_swarm.setCache(0);
+        m_swarm.setAccessCounting(false);
+        m_swarm.setAdaptive(false);
+        m_swarm.freeze();
+    }
+    //A frozen find does not change the tree, so concurrent readers are safe
+    const Robot* find(int id) const { return m_swarm.find(id); }
+    //The copy for the const queries (findRange, stats, parallelForEach, ...)
+    const Swarm& getSwarm() const { return m_swarm; }
+    int size() const { return m_swarm.size(); }
+    //The number of commands the owner had applied when the copy was taken
+    long long getVersion() const { return m_version; }
+
+    private:
+    mutable Swarm m_swarm;
+    long long m_version;
+};
+
+class SwarmService{
+    public:
+    /******************************************
+    * Constructor
+    * Preconditions: None
+    * Postconditions: Creates an empty Swarm of the given type and starts the
+    * owner thread that applies the queued commands to it
+    * ***************************************/
+    SwarmService(TREETYPE type = AVL)
+        : m_swarm(type), m_head(nullptr), m_stopping(false), m_applied(0), m_batches(0) {
+        m_owner = thread(&SwarmService::run, this);
+    }
+
+    /******************************************
+    * Destructor
+    * Preconditions: No thread submits commands once destruction starts
+    * Postconditions: Applies the commands still queued, completes their
+    * futures and stops the owner thread
+    * ***************************************/
+    ~SwarmService() {
+        {
+            lock_guard<mutex> lock(m_sleepLock);
+            m_stopping = true;
+        }
+        m_wakeUp.notify_one();
+        m_owner.join();
+    }
+    SwarmService(const SwarmService&) = delete;
+    SwarmService& operator=(const SwarmService&) = delete;
+
+    /******************************************
+    * insert
+    * Preconditions: None
+    * Postconditions: Queues the insert of robot; the future is true if the
+    * robot was added, false for a duplicate
+    * ***************************************/
+    future<bool> insert(const Robot& robot) {
+        Command* command = new Command(COMMANDINSERT, robot);
+        future<bool> done = command->m_done.get_future();
+        submit(command);
+        return done;
+    }
+
+    /******************************************
+    * remove
+    * Preconditions: None
+    * Postconditions: Queues the remove of id; the future is true if a robot
+    * was taken out of the swarm (always false for a SPLAY tree)
+    * ***************************************/
+    future<bool> remove(int id) {
+        Command* command = new Command(COMMANDREMOVE, Robot(id));
+        future<bool> done = command->m_done.get_future();
+        submit(command);
+        return done;
+    }
+
+    /******************************************
+    * setState
+    * Preconditions: None
+    * Postconditions: Queues the state change; the future holds what
+    * Swarm::setState returned
+    * ***************************************/
+    future<bool> setState(int id, STATE state) {
+        Command* command = new Command(COMMANDSETSTATE, Robot(id, DEFAULT_TYPE, state));
+        future<bool> done = command->m_done.get_future();
+        submit(command);
+        return done;
+    }
+
+    /******************************************
+    * insertAll
+    * Preconditions: None
+    * Postconditions: Queues an insert of every robot, in order, as one
+    * command; element i of the future's vector is what insert(robots[i])
+    * would have returned. A future costs about as much as an insert, so
+    * producers with many robots at hand should use this.
+    * ***************************************/
+    future<vector<bool> > insertAll(const vector<Robot>& robots) {
+        return submitAll(COMMANDINSERT, robots);
+    }
+
+    /******************************************
+    * removeAll
+    * Preconditions: None
+    * Postconditions: Queues a remove of every id, in order, as one command;
+    * element i of the future's vector is what remove(ids[i]) would have
+    * returned
+    * ***************************************/
+    future<vector<bool> > removeAll(const vector<int>& ids) {
+        vector<Robot> robots;
+        robots.reserve(ids.size());
+        for (int id : ids) {
+            robots.push_back(Robot(id));
+        }
+        return submitAll(COMMANDREMOVE, robots);
+    }
+
+    /******************************************
+    * snapshot
+    * Preconditions: None
+    * Postconditions: Returns a frozen copy of the swarm taken between two
+    * batches that holds every command queued before this call
+    * ***************************************/
+    shared_ptr<const SwarmSnapshot> snapshot() {
+        Command* command = new Command(COMMANDSNAPSHOT, Robot());
+        future<bool> done = command->m_done.get_future();
+        submit(command);
+        done.wait();
+        lock_guard<mutex> lock(m_snapshotLock);
+        return m_snapshot;
+    }
+
+    /******************************************
+    * flush
+    * Preconditions: None
+    * Postconditions: Returns once every command queued before the call has
+    * been applied
+    * ***************************************/
+    void flush() {
+        Command* command = new Command(COMMANDFLUSH, Robot());
+        future<bool> done = command->m_done.get_future();
+        submit(command);
+        done.wait();
+    }
+
+    //The number of mutations applied and the batches they were applied in
+    long long getApplied() const { return m_applied.load(); }
+    long long getBatches() const { return m_batches.load(); }
+
+    private:
+    //A queued command, a single one or one for a vector of robots
+    struct Command{
+        COMMANDOP m_op;
+        Robot m_robot;                          // remove and setState only use its id and state
+        vector<Robot> m_robots;                 // the robots of insertAll and removeAll
+        bool m_result;
+        vector<bool> m_results;
+        promise<bool> m_done;
+        unique_ptr<promise<vector<bool> > > m_doneAll;
+        Command* m_next;
+        Command(COMMANDOP op, const Robot& robot) : m_op(op), m_robot(robot), m_result(false), m_next(nullptr) {}
+    };
+
+    //One mutation of a batch, m_index is -1 for a single command
+    struct Change{
+        int m_id;
+        int m_round;
+        Command* m_command;
+        int m_index;
+    };
+
+    Swarm m_swarm;                  // only the owner thread touches it
+    atomic<Command*> m_head;        // newest command first
+    mutex m_sleepLock;              // only held to sleep or to wake the owner
+    condition_variable m_wakeUp;
+    bool m_stopping;                // guarded by m_sleepLock
+    atomic<long long> m_applied;
+    atomic<long long> m_batches;
+    mutex m_snapshotLock;
+    shared_ptr<const SwarmSnapshot> m_snapshot;
+    thread m_owner;
+
+    //Queues a command for a vector of robots
+    future<vector<bool> > submitAll(COMMANDOP op, const vector<Robot>& robots) {
+        Command* command = new Command(op, Robot());
+        command->m_robots = robots;
+        command->m_doneAll.reset(new promise<vector<bool> >());
+        future<vector<bool> > done = command->m_doneAll->get_future();
+        submit(command);
+        return done;
+    }
+
+    //Pushes a command on the queue and wakes the owner if the queue was empty
+    void submit(Command* command) {
+        Command* head = m_head.load(memory_order_relaxed);
+        do {
+            command->m_next = head;
+        } while (!m_head.compare_exchange_weak(head, command, memory_order_release, memory_order_relaxed));
+        if (head == nullptr) {
+            //the owner may be between its check and its wait, the lock orders us after it
+            { lock_guard<mutex> lock(m_sleepLock); }
+            m_wakeUp.notify_one();
+        }
+    }
+
+    //The owner thread: takes the whole queue at once and applies it
+    void run() {
+        vector<Command*> commands;
+        while (true) {
+            Command* list = m_head.exchange(nullptr, memory_order_acquire);
+            if (list == nullptr) {
+                unique_lock<mutex> lock(m_sleepLock);
+                m_wakeUp.wait(lock, [this] { return m_head.load() != nullptr or m_stopping; });
+                if (m_head.load() == nullptr) {
+                    return;
+                }
+                continue;
+            }
+            //the queue is a stack, reverse it into the order of submission
+            commands.clear();
+            for (Command* command = list; command != nullptr; command = command->m_next) {
+                commands.push_back(command);
+            }
+            reverse(commands.begin(), commands.end());
+            applyBatch(commands);
+        }
+    }
+
+    //Applies the mutations between two snapshot or flush commands sorted by id
+    void applyBatch(vector<Command*>& commands) {
+        size_t start = 0;
+        for (size_t i = 0; i <= commands.size(); i++) {
+            if (i < commands.size() and commands[i]->m_op < COMMANDSNAPSHOT) {
+                continue;
+            }
+            if (i > start) {
+                applySorted(commands.begin() + start, commands.begin() + i);
+            }
+            if (i < commands.size()) {
+                if (commands[i]->m_op == COMMANDSNAPSHOT) {
+                    takeSnapshot();
+                }
+                complete(commands[i]);
+            }
+            start = i + 1;
+        }
+    }
+
+    //Applies one run of commands in id order and completes their futures
+    void applySorted(vector<Command*>::iterator first, vector<Command*>::iterator last) {
+        vector<Change> changes;
+        for (vector<Command*>::iterator it = first; it != last; ++it) {
+            Command* command = *it;
+            if (command->m_doneAll == nullptr) {
+                changes.push_back(Change{command->m_robot.getID(), 0, command, -1});
+                continue;
+            }
+            command->m_results.assign(command->m_robots.size(), false);
+            for (size_t i = 0; i < command->m_robots.size(); i++) {
+                changes.push_back(Change{command->m_robots[i].getID(), 0, command, (int)i});
+            }
+        }
+        //changes of different ids commute, so the k-th change of every id can
+        //run in round k; inside a round they go in id order and a run of inserts
+        //or removes goes to the swarm as one batch
+        stable_sort(changes.begin(), changes.end(), [](const Change& a, const Change& b) { return a.m_id < b.m_id; });
+        for (size_t i = 1; i < changes.size(); i++) {
+            if (changes[i].m_id == changes[i - 1].m_id) {
+                changes[i].m_round = changes[i - 1].m_round + 1;
+            }
+        }
+        stable_sort(changes.begin(), changes.end(), [](const Change& a, const Change& b) { return a.m_round < b.m_round; });
+        vector<Robot> robots;
+        vector<int> ids;
+        vector<bool> added, removed;
+        size_t next = 0;
+        while (next < changes.size()) {
+            size_t end = next;
+            while (end < changes.size() and changes[end].m_command->m_op == COMMANDINSERT) {
+                robots.push_back(robotOf(changes[end]));
+                end++;
+            }
+            if (end != next) {
+                m_swarm.insertBatch(robots, added);
+                for (size_t i = 0; i < robots.size(); i++) {
+                    setResult(changes[next + i], added[i]);
+                }
+                robots.clear();
+                next = end;
+                continue;
+            }
+            while (end < changes.size() and changes[end].m_command->m_op == COMMANDREMOVE) {
+                ids.push_back(changes[end].m_id);
+                end++;
+            }
+            if (end != next) {
+                m_swarm.removeBatch(ids, removed);
+                for (size_t i = 0; i < ids.size(); i++) {
+                    setResult(changes[next + i], removed[i]);
+                }
+                ids.clear();
+                next = end;
+                continue;
+            }
+            const Robot& robot = robotOf(changes[next]);
+            setResult(changes[next], m_swarm.setState(robot.getID(), robot.getState()));
+            next++;
+        }
+        for (vector<Command*>::iterator it = first; it != last; ++it) {
+            complete(*it);
+        }
+        m_applied += changes.size();
+        m_batches++;
+    }
+
+    //The robot a change applies
+    const Robot& robotOf(const Change& change) const {
+        return change.m_index < 0 ? change.m_command->m_robot : change.m_command->m_robots[change.m_index];
+    }
+
+    //Records the result of a change in its command
+    void setResult(const Change& change, bool result) {
+        if (change.m_index < 0) {
+            change.m_command->m_result = result;
+        }else {
+            change.m_command->m_results[change.m_index] = result;
+        }
+    }
+
+    //Hands the results to the future of command and frees it
+    void complete(Command* command) {
+        if (command->m_doneAll != nullptr) {
+            command->m_doneAll->set_value(move(command->m_results));
+        }else {
+            command->m_done.set_value(command->m_result or command->m_op >= COMMANDSNAPSHOT);
+        }
+        delete command;
+    }
+
+    //Publishes a frozen copy unless the current one is still up to date
+    void takeSnapshot() {
+        long long applied = m_applied.load();
+        {
+            lock_guard<mutex> lock(m_snapshotLock);
+            if (m_snapshot != nullptr and m_snapshot->getVersion() == applied) {
+                return;
+            }
+        }
+        shared_ptr<const SwarmSnapshot> snapshot = make_shared<SwarmSnapshot>(m_swarm, applied);
+        lock_guard<mutex> lock(m_snapshotLock);
+        m_snapshot = snapshot;
+    }
+};
+#endif